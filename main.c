@@ -1,934 +1,8857 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-#include <math.h>
-
-#define MAX_RECORDS 1000
-#define MAX_LINE 512
-#define MAX_NAME 100
-
-// Health data structure
-typedef struct {
-    char date[20];
-    int heart_rate;
-    int systolic_bp;
-    int diastolic_bp;
-    int blood_sugar;
-    float temperature;
-    int oxygen_level;
-    int steps;
-} HealthRecord;
-
-// Statistics structure
-typedef struct {
-    float avg_heart_rate;
-    float avg_systolic;
-    float avg_diastolic;
-    float avg_blood_sugar;
-    float avg_temperature;
-    float avg_oxygen;
-    int total_steps;
-    int record_count;
-} HealthStats;
-
-// Alert structure
-typedef struct {
-    char message[256];
-    int severity; // 1=Low, 2=Medium, 3=High, 4=Critical
-} Alert;
-
-// Function prototypes
-void print_banner();
-void print_menu();
-int load_csv_data(const char *filename, HealthRecord records[], int *count);
-int load_txt_data(const char *filename, HealthRecord records[], int *count);
-void calculate_statistics(HealthRecord records[], int count, HealthStats *stats);
-void analyze_health(HealthRecord records[], int count, HealthStats stats, Alert alerts[], int *alert_count);
-void display_report(HealthStats stats, Alert alerts[], int alert_count);
-void display_trends(HealthRecord records[], int count);
-void generate_advice(Alert alerts[], int alert_count);
-void export_report(HealthStats stats, Alert alerts[], int alert_count, const char *filename);
-void add_manual_record(HealthRecord records[], int *count);
-float calculate_bmi(float weight, float height);
-int calculate_health_score(HealthStats stats);
-void display_health_score(int score);
-void create_sample_data();
-void print_line(char c, int length);
-
-int main() {
-    HealthRecord records[MAX_RECORDS];
-    Alert alerts[50];
-    HealthStats stats = {0};
-    int record_count = 0;
-    int alert_count = 0;
-    int choice;
-    char filename[100];
-
-    print_banner();
-
-    while (1) {
-        print_menu();
-        printf("\nEnter your choice: ");
-        scanf("%d", &choice);
-        getchar(); // Clear newline
-
-        switch (choice) {
-            case 1:
-                printf("\nEnter CSV filename: ");
-                fgets(filename, sizeof(filename), stdin);
-                filename[strcspn(filename, "\n")] = 0;
-
-                if (load_csv_data(filename, records, &record_count)) {
-                    printf("[SUCCESS] Loaded %d records successfully!\n", record_count);
-                } else {
-                    printf("[ERROR] Failed to load data.\n");
-                }
-                break;
-
-            case 2:
-                printf("\nEnter TXT filename: ");
-                fgets(filename, sizeof(filename), stdin);
-                filename[strcspn(filename, "\n")] = 0;
-
-                if (load_txt_data(filename, records, &record_count)) {
-                    printf("[SUCCESS] Loaded %d records successfully!\n", record_count);
-                } else {
-                    printf("[ERROR] Failed to load data.\n");
-                }
-                break;
-
-            case 3:
-                if (record_count == 0) {
-                    printf("[WARNING] No data loaded. Please load data first.\n");
-                } else {
-                    calculate_statistics(records, record_count, &stats);
-                    analyze_health(records, record_count, stats, alerts, &alert_count);
-                    display_report(stats, alerts, alert_count);
-                }
-                break;
-
-            case 4:
-                if (record_count == 0) {
-                    printf("[WARNING] No data loaded. Please load data first.\n");
-                } else {
-                    display_trends(records, record_count);
-                }
-                break;
-
-            case 5:
-                if (alert_count == 0) {
-                    printf("[WARNING] No analysis performed yet. Please analyze data first (Option 3).\n");
-                } else {
-                    generate_advice(alerts, alert_count);
-                }
-                break;
-
-            case 6:
-                add_manual_record(records, &record_count);
-                break;
-
-            case 7:
-                if (record_count == 0) {
-                    printf("[WARNING] No data to export.\n");
-                } else {
-                    printf("\nEnter output filename: ");
-                    fgets(filename, sizeof(filename), stdin);
-                    filename[strcspn(filename, "\n")] = 0;
-                    export_report(stats, alerts, alert_count, filename);
-                }
-                break;
-
-            case 8:
-                create_sample_data();
-                break;
-
-            case 9:
-                print_line('=', 60);
-                printf("    Thank you for using Smart Health Monitor!\n");
-                printf("    Stay healthy!\n");
-                print_line('=', 60);
-                printf("\n");
-                return 0;
-
-            default:
-                printf("[ERROR] Invalid choice. Please try again.\n");
-        }
-
-        printf("\nPress Enter to continue...");
-        getchar();
-    }
-
-    return 0;
-}
-
-void print_line(char c, int length) {
-    for (int i = 0; i < length; i++) {
-        printf("%c", c);
-    }
-    printf("\n");
-}
-
-void print_banner() {
-    printf("\n");
-    print_line('=', 60);
-    printf("                                                            \n");
-    printf("                   SMART HEALTH MONITOR                     \n");
-    printf("                                                            \n");
-    printf("          Your Personal Health Analytics System            \n");
-    printf("                                                            \n");
-    print_line('=', 60);
-    printf("\n");
-}
-
-void print_menu() {
-    printf("\n");
-    print_line('-', 45);
-    printf("               MAIN MENU                     \n");
-    print_line('-', 45);
-    printf(" 1. Load CSV Health Data                    \n");
-    printf(" 2. Load TXT Health Data                    \n");
-    printf(" 3. Analyze Health & Get Report             \n");
-    printf(" 4. View Health Trends                      \n");
-    printf(" 5. Get Personalized Advice                 \n");
-    printf(" 6. Add Manual Health Record                \n");
-    printf(" 7. Export Report                           \n");
-    printf(" 8. Generate Sample Data File               \n");
-    printf(" 9. Exit                                    \n");
-    print_line('-', 45);
-}
-
-int load_csv_data(const char *filename, HealthRecord records[], int *count) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        return 0;
-    }
-
-    char line[MAX_LINE];
-    *count = 0;
-
-    // Skip header line
-    if (!fgets(line, sizeof(line), file)) {
-        fclose(file);
-        return 0;
-    }
-
-    while (fgets(line, sizeof(line), file) && *count < MAX_RECORDS) {
-        // Remove trailing newline/carriage return
-        line[strcspn(line, "\r\n")] = 0;
-
-        // Skip empty lines
-        if (strlen(line) < 5) continue;
-
-        // Initialize record with safe defaults
-        records[*count].heart_rate = 0;
-        records[*count].systolic_bp = 0;
-        records[*count].diastolic_bp = 0;
-        records[*count].blood_sugar = 0;
-        records[*count].temperature = 0.0;
-        records[*count].oxygen_level = 0;
-        records[*count].steps = 0;
-
-        int items = sscanf(line, "%[^,],%d,%d,%d,%d,%f,%d,%d",
-               records[*count].date,
-               &records[*count].heart_rate,
-               &records[*count].systolic_bp,
-               &records[*count].diastolic_bp,
-               &records[*count].blood_sugar,
-               &records[*count].temperature,
-               &records[*count].oxygen_level,
-               &records[*count].steps);
-
-        // Only count if we successfully read at least 5 fields
-        if (items >= 5) {
-            (*count)++;
-        }
-    }
-
-    fclose(file);
-    return (*count > 0);
-}
-
-int load_txt_data(const char *filename, HealthRecord records[], int *count) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        return 0;
-    }
-
-    char line[MAX_LINE];
-    *count = 0;
-
-    // Initialize current record
-    HealthRecord current;
-    int fields_read = 0;
-
-    while (fgets(line, sizeof(line), file) && *count < MAX_RECORDS) {
-        // Remove any trailing whitespace/newlines
-        line[strcspn(line, "\r\n")] = 0;
-
-        if (strstr(line, "Date:") && strlen(line) > 6) {
-            if (fields_read == 7 && *count < MAX_RECORDS) {
-                records[*count] = current;
-                (*count)++;
-                fields_read = 0;
-            }
-            sscanf(line, "Date: %s", current.date);
-            fields_read = 1;
-        }
-        else if (strstr(line, "Heart Rate:") && fields_read >= 1) {
-            sscanf(line, "Heart Rate: %d", &current.heart_rate);
-            fields_read = 2;
-        }
-        else if (strstr(line, "Blood Pressure:") && fields_read >= 2) {
-            sscanf(line, "Blood Pressure: %d/%d",
-                   &current.systolic_bp, &current.diastolic_bp);
-            fields_read = 3;
-        }
-        else if (strstr(line, "Blood Sugar:") && fields_read >= 3) {
-            sscanf(line, "Blood Sugar: %d", &current.blood_sugar);
-            fields_read = 4;
-        }
-        else if (strstr(line, "Temperature:") && fields_read >= 4) {
-            sscanf(line, "Temperature: %f", &current.temperature);
-            fields_read = 5;
-        }
-        else if (strstr(line, "Oxygen Level:") && fields_read >= 5) {
-            sscanf(line, "Oxygen Level: %d", &current.oxygen_level);
-            fields_read = 6;
-        }
-        else if (strstr(line, "Steps:") && fields_read >= 6) {
-            sscanf(line, "Steps: %d", &current.steps);
-            fields_read = 7;
-        }
-    }
-
-    // Don't forget the last record
-    if (fields_read == 7 && *count < MAX_RECORDS) {
-        records[*count] = current;
-        (*count)++;
-    }
-
-    fclose(file);
-    return (*count > 0);
-}
-
-void calculate_statistics(HealthRecord records[], int count, HealthStats *stats) {
-    float sum_hr = 0, sum_sys = 0, sum_dia = 0, sum_sugar = 0, sum_temp = 0, sum_oxy = 0;
-    int total_steps = 0;
-
-    for (int i = 0; i < count; i++) {
-        sum_hr += records[i].heart_rate;
-        sum_sys += records[i].systolic_bp;
-        sum_dia += records[i].diastolic_bp;
-        sum_sugar += records[i].blood_sugar;
-        sum_temp += records[i].temperature;
-        sum_oxy += records[i].oxygen_level;
-        total_steps += records[i].steps;
-    }
-
-    stats->record_count = count;
-    stats->avg_heart_rate = sum_hr / count;
-    stats->avg_systolic = sum_sys / count;
-    stats->avg_diastolic = sum_dia / count;
-    stats->avg_blood_sugar = sum_sugar / count;
-    stats->avg_temperature = sum_temp / count;
-    stats->avg_oxygen = sum_oxy / count;
-    stats->total_steps = total_steps;
-}
-
-void analyze_health(HealthRecord records[], int count, HealthStats stats, Alert alerts[], int *alert_count) {
-    *alert_count = 0;
-
-    // Heart Rate Analysis
-    if (stats.avg_heart_rate > 100) {
-        sprintf(alerts[*alert_count].message,
-                "Average heart rate is %.0f BPM - Possible tachycardia detected",
-                stats.avg_heart_rate);
-        alerts[*alert_count].severity = (stats.avg_heart_rate > 120) ? 4 : 3;
-        (*alert_count)++;
-    } else if (stats.avg_heart_rate < 60) {
-        sprintf(alerts[*alert_count].message,
-                "Average heart rate is %.0f BPM - Bradycardia detected",
-                stats.avg_heart_rate);
-        alerts[*alert_count].severity = (stats.avg_heart_rate < 40) ? 4 : 2;
-        (*alert_count)++;
-    }
-
-    // Blood Pressure Analysis
-    if (stats.avg_systolic > 140 || stats.avg_diastolic > 90) {
-        sprintf(alerts[*alert_count].message,
-                "Average BP is %.0f/%.0f mmHg - Hypertension (Stage 2)",
-                stats.avg_systolic, stats.avg_diastolic);
-        alerts[*alert_count].severity = 4;
-        (*alert_count)++;
-    } else if (stats.avg_systolic > 130 || stats.avg_diastolic > 80) {
-        sprintf(alerts[*alert_count].message,
-                "Average BP is %.0f/%.0f mmHg - Hypertension (Stage 1)",
-                stats.avg_systolic, stats.avg_diastolic);
-        alerts[*alert_count].severity = 3;
-        (*alert_count)++;
-    } else if (stats.avg_systolic < 90 || stats.avg_diastolic < 60) {
-        sprintf(alerts[*alert_count].message,
-                "Average BP is %.0f/%.0f mmHg - Hypotension detected",
-                stats.avg_systolic, stats.avg_diastolic);
-        alerts[*alert_count].severity = 2;
-        (*alert_count)++;
-    }
-
-    // Blood Sugar Analysis
-    if (stats.avg_blood_sugar > 200) {
-        sprintf(alerts[*alert_count].message,
-                "Average blood sugar is %.0f mg/dL - Severe hyperglycemia",
-                stats.avg_blood_sugar);
-        alerts[*alert_count].severity = 4;
-        (*alert_count)++;
-    } else if (stats.avg_blood_sugar > 125) {
-        sprintf(alerts[*alert_count].message,
-                "Average blood sugar is %.0f mg/dL - Diabetes risk detected",
-                stats.avg_blood_sugar);
-        alerts[*alert_count].severity = 3;
-        (*alert_count)++;
-    } else if (stats.avg_blood_sugar < 70) {
-        sprintf(alerts[*alert_count].message,
-                "Average blood sugar is %.0f mg/dL - Hypoglycemia detected",
-                stats.avg_blood_sugar);
-        alerts[*alert_count].severity = 3;
-        (*alert_count)++;
-    }
-
-    // Temperature Analysis
-    if (stats.avg_temperature > 100.4) {
-        sprintf(alerts[*alert_count].message,
-                "Average temperature is %.1f F - Fever detected",
-                stats.avg_temperature);
-        alerts[*alert_count].severity = 3;
-        (*alert_count)++;
-    } else if (stats.avg_temperature < 95.0) {
-        sprintf(alerts[*alert_count].message,
-                "Average temperature is %.1f F - Hypothermia risk",
-                stats.avg_temperature);
-        alerts[*alert_count].severity = 4;
-        (*alert_count)++;
-    }
-
-    // Oxygen Level Analysis
-    if (stats.avg_oxygen < 90) {
-        sprintf(alerts[*alert_count].message,
-                "Average oxygen saturation is %.0f%% - Hypoxemia (Critical)",
-                stats.avg_oxygen);
-        alerts[*alert_count].severity = 4;
-        (*alert_count)++;
-    } else if (stats.avg_oxygen < 95) {
-        sprintf(alerts[*alert_count].message,
-                "Average oxygen saturation is %.0f%% - Low oxygen levels",
-                stats.avg_oxygen);
-        alerts[*alert_count].severity = 2;
-        (*alert_count)++;
-    }
-
-    // Physical Activity Analysis
-    int avg_steps = stats.total_steps / count;
-    if (avg_steps < 5000) {
-        sprintf(alerts[*alert_count].message,
-                "Average daily steps: %d - Sedentary lifestyle detected",
-                avg_steps);
-        alerts[*alert_count].severity = 2;
-        (*alert_count)++;
-    }
-
-    // Trend Analysis - Check last 3 records
-    if (count >= 3) {
-        int increasing_hr = 1, increasing_bp = 1;
-        for (int i = count - 3; i < count - 1; i++) {
-            if (records[i].heart_rate >= records[i + 1].heart_rate) increasing_hr = 0;
-            if (records[i].systolic_bp >= records[i + 1].systolic_bp) increasing_bp = 0;
-        }
-
-        if (increasing_hr) {
-            sprintf(alerts[*alert_count].message,
-                    "Heart rate showing consistent upward trend");
-            alerts[*alert_count].severity = 2;
-            (*alert_count)++;
-        }
-
-        if (increasing_bp) {
-            sprintf(alerts[*alert_count].message,
-                    "Blood pressure showing consistent upward trend");
-            alerts[*alert_count].severity = 2;
-            (*alert_count)++;
-        }
-    }
-}
-
-void display_report(HealthStats stats, Alert alerts[], int alert_count) {
-    printf("\n");
-    print_line('=', 60);
-    printf("              HEALTH ANALYSIS REPORT\n");
-    print_line('=', 60);
-
-    printf("\nVITAL STATISTICS (Based on %d records)\n", stats.record_count);
-    print_line('-', 60);
-
-    printf("  Heart Rate:      %.0f BPM", stats.avg_heart_rate);
-    if (stats.avg_heart_rate >= 60 && stats.avg_heart_rate <= 100)
-        printf(" [NORMAL]\n");
-    else
-        printf(" [ABNORMAL]\n");
-
-    printf("  Blood Pressure:  %.0f/%.0f mmHg",
-           stats.avg_systolic, stats.avg_diastolic);
-    if (stats.avg_systolic < 120 && stats.avg_diastolic < 80)
-        printf(" [NORMAL]\n");
-    else
-        printf(" [ELEVATED]\n");
-
-    printf("  Blood Sugar:     %.0f mg/dL", stats.avg_blood_sugar);
-    if (stats.avg_blood_sugar >= 70 && stats.avg_blood_sugar <= 125)
-        printf(" [NORMAL]\n");
-    else
-        printf(" [ABNORMAL]\n");
-
-    printf("  Temperature:     %.1f F", stats.avg_temperature);
-    if (stats.avg_temperature >= 97.0 && stats.avg_temperature <= 99.0)
-        printf(" [NORMAL]\n");
-    else
-        printf(" [ABNORMAL]\n");
-
-    printf("  Oxygen Level:    %.0f%%", stats.avg_oxygen);
-    if (stats.avg_oxygen >= 95)
-        printf(" [NORMAL]\n");
-    else
-        printf(" [LOW]\n");
-
-    printf("  Total Steps:     %d steps\n", stats.total_steps);
-    printf("  Avg Daily Steps: %d steps/day\n",
-           stats.total_steps / stats.record_count);
-
-    // Health Score
-    int health_score = calculate_health_score(stats);
-    display_health_score(health_score);
-
-    // Alerts
-    if (alert_count > 0) {
-        printf("\nHEALTH ALERTS\n");
-        print_line('-', 60);
-
-        for (int i = 0; i < alert_count; i++) {
-            switch (alerts[i].severity) {
-                case 4:
-                    printf("  [CRITICAL] %s\n", alerts[i].message);
-                    break;
-                case 3:
-                    printf("  [HIGH]     %s\n", alerts[i].message);
-                    break;
-                case 2:
-                    printf("  [MEDIUM]   %s\n", alerts[i].message);
-                    break;
-                default:
-                    printf("  [LOW]      %s\n", alerts[i].message);
-            }
-        }
-    } else {
-        printf("\n[SUCCESS] All vitals are within normal ranges! Keep up the good work!\n");
-    }
-    printf("\n");
-}
-
-int calculate_health_score(HealthStats stats) {
-    int score = 100;
-
-    // Heart rate
-    if (stats.avg_heart_rate < 60 || stats.avg_heart_rate > 100) score -= 15;
-    else if (stats.avg_heart_rate < 65 || stats.avg_heart_rate > 95) score -= 5;
-
-    // Blood pressure
-    if (stats.avg_systolic > 140 || stats.avg_diastolic > 90) score -= 20;
-    else if (stats.avg_systolic > 130 || stats.avg_diastolic > 80) score -= 10;
-    else if (stats.avg_systolic < 90 || stats.avg_diastolic < 60) score -= 15;
-
-    // Blood sugar
-    if (stats.avg_blood_sugar > 200 || stats.avg_blood_sugar < 70) score -= 25;
-    else if (stats.avg_blood_sugar > 125) score -= 15;
-
-    // Temperature
-    if (stats.avg_temperature > 100.4 || stats.avg_temperature < 95.0) score -= 15;
-    else if (stats.avg_temperature > 99.5 || stats.avg_temperature < 97.0) score -= 5;
-
-    // Oxygen
-    if (stats.avg_oxygen < 90) score -= 25;
-    else if (stats.avg_oxygen < 95) score -= 10;
-
-    // Steps
-    int avg_steps = stats.total_steps / stats.record_count;
-    if (avg_steps < 5000) score -= 10;
-    else if (avg_steps > 10000) score += 5;
-
-    if (score < 0) score = 0;
-    if (score > 100) score = 100;
-
-    return score;
-}
-
-void display_health_score(int score) {
-    printf("\n");
-    print_line('-', 50);
-    printf("          OVERALL HEALTH SCORE\n");
-    print_line('-', 50);
-
-    // Score bar
-    printf("  [");
-    int bars = score / 5;
-    for (int i = 0; i < 20; i++) {
-        if (i < bars) printf("#");
-        else printf("-");
-    }
-    printf("]\n");
-
-    printf("          ");
-    if (score >= 80) printf("%d/100 - EXCELLENT!\n", score);
-    else if (score >= 60) printf("%d/100 - GOOD\n", score);
-    else if (score >= 40) printf("%d/100 - FAIR\n", score);
-    else printf("%d/100 - POOR\n", score);
-
-    print_line('-', 50);
-}
-
-void display_trends(HealthRecord records[], int count) {
-    printf("\n");
-    print_line('=', 70);
-    printf("                  HEALTH TRENDS\n");
-    print_line('=', 70);
-
-    int display_count = (count > 10) ? 10 : count;
-    int start = count - display_count;
-
-    printf("\nLast %d Records:\n", display_count);
-    print_line('-', 70);
-    printf("%-12s  HR   BP       Sugar  Temp   SpO2  Steps\n", "Date");
-    print_line('-', 70);
-
-    for (int i = start; i < count; i++) {
-        printf("%-12s  %3d  %3d/%-3d  %3d    %.1f   %2d%%  %5d\n",
-               records[i].date,
-               records[i].heart_rate,
-               records[i].systolic_bp,
-               records[i].diastolic_bp,
-               records[i].blood_sugar,
-               records[i].temperature,
-               records[i].oxygen_level,
-               records[i].steps);
-    }
-    print_line('-', 70);
-}
-
-void generate_advice(Alert alerts[], int alert_count) {
-    printf("\n");
-    print_line('=', 60);
-    printf("              PERSONALIZED HEALTH ADVICE\n");
-    print_line('=', 60);
-
-    int has_heart_issue = 0, has_bp_issue = 0, has_sugar_issue = 0;
-    int has_oxygen_issue = 0, has_activity_issue = 0;
-
-    for (int i = 0; i < alert_count; i++) {
-        if (strstr(alerts[i].message, "heart rate")) has_heart_issue = 1;
-        if (strstr(alerts[i].message, "pressure") || strstr(alerts[i].message, "BP")) has_bp_issue = 1;
-        if (strstr(alerts[i].message, "sugar")) has_sugar_issue = 1;
-        if (strstr(alerts[i].message, "oxygen")) has_oxygen_issue = 1;
-        if (strstr(alerts[i].message, "steps")) has_activity_issue = 1;
-    }
-
-    if (alert_count == 0) {
-        printf("\n[SUCCESS] Excellent! Your health metrics are optimal.\n\n");
-        printf("General Wellness Tips:\n");
-        printf("  * Maintain your current healthy lifestyle\n");
-        printf("  * Stay hydrated (8 glasses of water daily)\n");
-        printf("  * Continue regular physical activity\n");
-        printf("  * Get 7-9 hours of quality sleep\n");
-        printf("  * Practice stress management techniques\n");
-        return;
-    }
-
-    printf("\nRECOMMENDED ACTIONS:\n");
-    print_line('-', 60);
-
-    if (has_heart_issue) {
-        printf("\nFor Heart Rate Issues:\n");
-        printf("  * Consult a cardiologist for proper evaluation\n");
-        printf("  * Practice deep breathing exercises\n");
-        printf("  * Reduce caffeine and stimulant intake\n");
-        printf("  * Manage stress through meditation or yoga\n");
-        printf("  * Ensure adequate sleep (7-9 hours)\n");
-    }
-
-    if (has_bp_issue) {
-        printf("\nFor Blood Pressure Issues:\n");
-        printf("  * Reduce sodium intake (<2300mg/day)\n");
-        printf("  * Eat more fruits, vegetables, and whole grains\n");
-        printf("  * Maintain healthy weight\n");
-        printf("  * Limit alcohol consumption\n");
-        printf("  * Exercise regularly (30 min/day, 5 days/week)\n");
-        printf("  * Monitor BP daily and keep a log\n");
-    }
-
-    if (has_sugar_issue) {
-        printf("\nFor Blood Sugar Issues:\n");
-        printf("  * Consult an endocrinologist\n");
-        printf("  * Follow a balanced, low-glycemic diet\n");
-        printf("  * Eat smaller, frequent meals\n");
-        printf("  * Increase fiber intake\n");
-        printf("  * Exercise regularly to improve insulin sensitivity\n");
-        printf("  * Monitor blood sugar levels consistently\n");
-    }
-
-    if (has_oxygen_issue) {
-        printf("\nFor Oxygen Level Issues:\n");
-        printf("  * [URGENT] SEEK IMMEDIATE MEDICAL ATTENTION if severe\n");
-        printf("  * Practice breathing exercises\n");
-        printf("  * Ensure proper ventilation in living spaces\n");
-        printf("  * Avoid smoking and secondhand smoke\n");
-        printf("  * Consider pulmonary function tests\n");
-    }
-
-    if (has_activity_issue) {
-        printf("\nFor Low Physical Activity:\n");
-        printf("  * Start with 10-minute walks, gradually increase\n");
-        printf("  * Take stairs instead of elevators\n");
-        printf("  * Set hourly reminders to stand and stretch\n");
-        printf("  * Find activities you enjoy (dancing, sports, etc.)\n");
-        printf("  * Use a fitness tracker for motivation\n");
-        printf("  * Aim for 10,000 steps per day\n");
-    }
-
-    printf("\n[IMPORTANT DISCLAIMER]\n");
-    printf("This is an automated analysis tool and NOT a substitute\n");
-    printf("for professional medical advice. Please consult healthcare\n");
-    printf("professionals for proper diagnosis and treatment.\n");
-}
-
-void add_manual_record(HealthRecord records[], int *count) {
-    if (*count >= MAX_RECORDS) {
-        printf("[ERROR] Maximum records reached!\n");
-        return;
-    }
-
-    printf("\n");
-    print_line('=', 60);
-    printf("              ADD NEW HEALTH RECORD\n");
-    print_line('=', 60);
-
-    HealthRecord new_record;
-
-    printf("\nEnter date (YYYY-MM-DD): ");
-    scanf("%s", new_record.date);
-
-    printf("Enter heart rate (BPM): ");
-    scanf("%d", &new_record.heart_rate);
-
-    printf("Enter systolic BP: ");
-    scanf("%d", &new_record.systolic_bp);
-
-    printf("Enter diastolic BP: ");
-    scanf("%d", &new_record.diastolic_bp);
-
-    printf("Enter blood sugar (mg/dL): ");
-    scanf("%d", &new_record.blood_sugar);
-
-    printf("Enter temperature (F): ");
-    scanf("%f", &new_record.temperature);
-
-    printf("Enter oxygen level (%%): ");
-    scanf("%d", &new_record.oxygen_level);
-
-    printf("Enter steps: ");
-    scanf("%d", &new_record.steps);
-
-    records[*count] = new_record;
-    (*count)++;
-
-    printf("\n[SUCCESS] Record added successfully!\n");
-}
-
-void export_report(HealthStats stats, Alert alerts[], int alert_count, const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        printf("[ERROR] Failed to create report file.\n");
-        return;
-    }
-
-    time_t now = time(NULL);
-    char *timestamp = ctime(&now);
-
-    fprintf(file, "============================================================\n");
-    fprintf(file, "           SMART HEALTH MONITOR - ANALYSIS REPORT\n");
-    fprintf(file, "============================================================\n");
-    fprintf(file, "Generated: %s\n", timestamp);
-    fprintf(file, "Based on %d health records\n\n", stats.record_count);
-
-    fprintf(file, "VITAL STATISTICS SUMMARY\n");
-    fprintf(file, "------------------------------------------------------------\n");
-    fprintf(file, "Average Heart Rate:      %.0f BPM\n", stats.avg_heart_rate);
-    fprintf(file, "Average Blood Pressure:  %.0f/%.0f mmHg\n", stats.avg_systolic, stats.avg_diastolic);
-    fprintf(file, "Average Blood Sugar:     %.0f mg/dL\n", stats.avg_blood_sugar);
-    fprintf(file, "Average Temperature:     %.1f F\n", stats.avg_temperature);
-    fprintf(file, "Average Oxygen Level:    %.0f%%\n", stats.avg_oxygen);
-    fprintf(file, "Total Steps:             %d steps\n", stats.total_steps);
-    fprintf(file, "Average Daily Steps:     %d steps/day\n\n", stats.total_steps / stats.record_count);
-
-    int health_score = calculate_health_score(stats);
-    fprintf(file, "OVERALL HEALTH SCORE: %d/100\n", health_score);
-    if (health_score >= 80) fprintf(file, "Status: EXCELLENT\n\n");
-    else if (health_score >= 60) fprintf(file, "Status: GOOD\n\n");
-    else if (health_score >= 40) fprintf(file, "Status: FAIR\n\n");
-    else fprintf(file, "Status: POOR - NEEDS ATTENTION\n\n");
-
-    if (alert_count > 0) {
-        fprintf(file, "HEALTH ALERTS\n");
-        fprintf(file, "------------------------------------------------------------\n");
-        for (int i = 0; i < alert_count; i++) {
-            switch (alerts[i].severity) {
-                case 4: fprintf(file, "[CRITICAL] "); break;
-                case 3: fprintf(file, "[HIGH]     "); break;
-                case 2: fprintf(file, "[MEDIUM]   "); break;
-                default: fprintf(file, "[LOW]      "); break;
-            }
-            fprintf(file, "%s\n", alerts[i].message);
-        }
-        fprintf(file, "\n");
-    }
-
-    fprintf(file, "DISCLAIMER\n");
-    fprintf(file, "------------------------------------------------------------\n");
-    fprintf(file, "This report is generated by an automated analysis system\n");
-    fprintf(file, "and is NOT a substitute for professional medical advice.\n");
-    fprintf(file, "Please consult healthcare professionals for proper\n");
-    fprintf(file, "diagnosis and treatment.\n");
-    fprintf(file, "============================================================\n");
-
-    fclose(file);
-    printf("\n[SUCCESS] Report exported successfully to '%s'\n", filename);
-}
-
-void create_sample_data() {
-    printf("\n");
-    print_line('=', 60);
-    printf("              CREATE SAMPLE DATA FILE\n");
-    print_line('=', 60);
-
-    printf("\nSelect format:\n");
-    printf("1. CSV Format\n");
-    printf("2. TXT Format\n");
-    printf("\nEnter choice: ");
-
-    int choice;
-    scanf("%d", &choice);
-    getchar();
-
-    if (choice == 1) {
-        FILE *file = fopen("sample_health_data.csv", "w");
-        if (!file) {
-            printf("[ERROR] Failed to create file.\n");
-            return;
-        }
-
-        // Write header
-        fprintf(file, "Date,HeartRate,SystolicBP,DiastolicBP,BloodSugar,Temperature,OxygenLevel,Steps\n");
-
-        // Write 7 days of data
-        fprintf(file, "2025-10-26,72,118,78,95,98.2,98,8500\n");
-        fprintf(file, "2025-10-27,75,120,80,102,98.4,97,9200\n");
-        fprintf(file, "2025-10-28,78,122,82,98,98.6,98,7800\n");
-        fprintf(file, "2025-10-29,115,145,95,180,99.1,96,4500\n");
-        fprintf(file, "2025-10-30,118,148,96,185,99.3,95,4200\n");
-        fprintf(file, "2025-10-31,120,150,98,190,99.5,94,3800\n");
-        fprintf(file, "2025-11-01,122,152,99,195,99.8,93,3500\n");
-
-        fclose(file);
-        printf("[SUCCESS] Sample CSV created: sample_health_data.csv\n");
-        printf("File location: In your project's bin/Debug folder\n");
-        printf("This file contains 7 days of health data.\n");
-
-    } else if (choice == 2) {
-        FILE *file = fopen("sample_health_data.txt", "w");
-        if (!file) {
-            printf("[ERROR] Failed to create file.\n");
-            return;
-        }
-
-        // Record 1
-        fprintf(file, "Date: 2025-10-26\n");
-        fprintf(file, "Heart Rate: 72\n");
-        fprintf(file, "Blood Pressure: 118/78\n");
-        fprintf(file, "Blood Sugar: 95\n");
-        fprintf(file, "Temperature: 98.2\n");
-        fprintf(file, "Oxygen Level: 98\n");
-        fprintf(file, "Steps: 8500\n");
-        fprintf(file, "\n");
-
-        // Record 2
-        fprintf(file, "Date: 2025-10-27\n");
-        fprintf(file, "Heart Rate: 75\n");
-        fprintf(file, "Blood Pressure: 120/80\n");
-        fprintf(file, "Blood Sugar: 102\n");
-        fprintf(file, "Temperature: 98.4\n");
-        fprintf(file, "Oxygen Level: 97\n");
-        fprintf(file, "Steps: 9200\n");
-        fprintf(file, "\n");
-
-        // Record 3
-        fprintf(file, "Date: 2025-10-28\n");
-        fprintf(file, "Heart Rate: 78\n");
-        fprintf(file, "Blood Pressure: 122/82\n");
-        fprintf(file, "Blood Sugar: 98\n");
-        fprintf(file, "Temperature: 98.6\n");
-        fprintf(file, "Oxygen Level: 98\n");
-        fprintf(file, "Steps: 7800\n");
-        fprintf(file, "\n");
-
-        // Record 4
-        fprintf(file, "Date: 2025-10-29\n");
-        fprintf(file, "Heart Rate: 115\n");
-        fprintf(file, "Blood Pressure: 145/95\n");
-        fprintf(file, "Blood Sugar: 180\n");
-        fprintf(file, "Temperature: 99.1\n");
-        fprintf(file, "Oxygen Level: 96\n");
-        fprintf(file, "Steps: 4500\n");
-        fprintf(file, "\n");
-
-        // Record 5
-        fprintf(file, "Date: 2025-10-30\n");
-        fprintf(file, "Heart Rate: 118\n");
-        fprintf(file, "Blood Pressure: 148/96\n");
-        fprintf(file, "Blood Sugar: 185\n");
-        fprintf(file, "Temperature: 99.3\n");
-        fprintf(file, "Oxygen Level: 95\n");
-        fprintf(file, "Steps: 4200\n");
-        fprintf(file, "\n");
-
-        // Record 6
-        fprintf(file, "Date: 2025-10-31\n");
-        fprintf(file, "Heart Rate: 120\n");
-        fprintf(file, "Blood Pressure: 150/98\n");
-        fprintf(file, "Blood Sugar: 190\n");
-        fprintf(file, "Temperature: 99.5\n");
-        fprintf(file, "Oxygen Level: 94\n");
-        fprintf(file, "Steps: 3800\n");
-        fprintf(file, "\n");
-
-        // Record 7
-        fprintf(file, "Date: 2025-11-01\n");
-        fprintf(file, "Heart Rate: 122\n");
-        fprintf(file, "Blood Pressure: 152/99\n");
-        fprintf(file, "Blood Sugar: 195\n");
-        fprintf(file, "Temperature: 99.8\n");
-        fprintf(file, "Oxygen Level: 93\n");
-        fprintf(file, "Steps: 3500\n");
-
-        fclose(file);
-        printf("[SUCCESS] Sample TXT created: sample_health_data.txt\n");
-        printf("File location: In your project's bin/Debug folder\n");
-        printf("This file contains 7 days of health data.\n");
-    } else {
-        printf("[ERROR] Invalid choice.\n");
-    }
-}
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(HM_NO_SIMD)
+#define HM_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#define MAX_LINE 512
+#define MAX_NAME 100
+#define ALERT_CAPACITY 64 // alerts kept per analysis; older ones are counted, not stored
+#define DATE_LEN 20
+#define MAX_PATH_LEN 512
+
+// Record store tuning: records live in fixed-size chunks carved from arena blocks
+#define RECORD_CHUNK_SHIFT 12
+#define RECORD_CHUNK_SIZE (1 << RECORD_CHUNK_SHIFT)
+#define RECORD_CHUNK_MASK (RECORD_CHUNK_SIZE - 1)
+#define ARENA_FIRST_BLOCK (128 * 1024) // blocks double from here up to ARENA_BLOCK_SIZE
+#define ARENA_BLOCK_SIZE (4 * 1024 * 1024)
+#define SIMD_ALIGNMENT 64
+
+// Parallel ingest: never split inputs into ranges smaller than this
+#define MAX_INGEST_THREADS 64
+#define MIN_BYTES_PER_THREAD (1024 * 1024)
+
+// Streaming TXT loader read size
+#define TXT_BUFFER_SIZE (1024 * 1024)
+
+// Report rendering: a report is formatted into a buffer that starts on the
+// stack and is written out in one call
+#define OUTPUT_STACK_SIZE (16 * 1024)
+
+// Binary columnar (.shm) file format
+#define SHM_MAGIC "SHMD"
+#define SHM_VERSION 2
+#define SHM_BYTE_ORDER 0x01020304u
+#define SHM_ALIGNMENT 64
+#define SHM_COLUMN_COUNT (1 + VITAL_COUNT) // day, then one per vital
+
+// Compressed columnar (.shz) file format: one block per record chunk
+#define SHZ_MAGIC "SHMZ"
+#define SHZ_VERSION 1
+#define SHZ_VARINT_MAX 5 // bytes of the longest 32-bit varint
+// Largest encoded block: the column sizes, varints for the day and integer
+// vitals, and 44 bits per XOR-coded temperature
+#define SHZ_BLOCK_BOUND (SHM_COLUMN_COUNT * 4 + (SHM_COLUMN_COUNT - 1) * SHZ_VARINT_MAX * RECORD_CHUNK_SIZE + \
+                         (44 * RECORD_CHUNK_SIZE + 7) / 8 + 8)
+
+// Manual record log (.wal)
+#define WAL_MAGIC "SHMW"
+#define WAL_VERSION 1
+#define WAL_DEFAULT_FILE "manual_records.wal" // records added while no file is loaded
+#define WAL_SUFFIX ".wal"                      // a loaded file's records go to FILE.wal
+#define WAL_GROUP_RECORDS 1024   // most records written and synced together
+#define WAL_GROUP_SECONDS 0.01   // an append this long after the oldest staged one commits the group
+
+// Streaming mode (--stream)
+#define STREAM_MAX_CLIENTS 16          // Unix socket connections served at once
+#define STREAM_READ_SIZE (64 * 1024)   // bytes taken from a source per read
+
+// Patient-keyed store (multi-patient CSV files, --patient, --serve)
+#define PATIENT_SHARD_BITS 4
+#define PATIENT_SHARDS (1 << PATIENT_SHARD_BITS) // independently locked parts of the table
+#define PATIENT_ID_COLUMN "PatientID"            // first header field of a multi-patient CSV
+
+// Query server (--serve)
+#define SERVER_MAX_CONNECTIONS 256     // clients connected at once
+#define SERVER_MAX_REQUEST 1024        // longest request line
+#define SERVER_MAX_PENDING (1024 * 1024) // unsent answer bytes before a client's requests wait
+
+// Synthetic data generator
+#define SYNTH_START_DAY 18262     // 2020-01-01 as days since 1970-01-01
+#define SYNTH_MAX_DAYS 2900000    // keeps generated dates before year 10000
+#define SYNTH_ANOMALY_RATE 0.01   // default chance per record of an anomaly episode
+#define SYNTH_NOISE_LIMIT 3.0     // daily noise is cut off at this many standard deviations
+#define BENCH_REPEATS 3
+
+// Sliding-window trends
+#define TREND_WINDOW 7          // default records per window
+#define TREND_SAMPLES 8         // moving-average points shown across a range
+#define TREND_MIN_T 3.0         // slope must be this many standard errors from 0
+#define TREND_MIN_RISE 0.05     // and move the mean this much (fraction) over a window
+
+// Quantile sketches count integer values (temperature in tenths): one bin
+// per value below 2^SKETCH_PRECISION, then 2^(SKETCH_PRECISION - 1) bins per
+// power of two, so estimates are exact for most vitals and within 0.2%
+// above that. Values from 2^SKETCH_MAX_LOG share the last bin.
+#define SKETCH_PRECISION 9
+#define SKETCH_MAX_LOG 20
+#define SKETCH_HALF (1 << (SKETCH_PRECISION - 1))
+#define SKETCH_BINS (2 * SKETCH_HALF + (SKETCH_MAX_LOG - SKETCH_PRECISION) * SKETCH_HALF + 1)
+
+// Streaming anomaly detectors; deviations are in baseline standard deviations
+#define ZSCORE_WINDOW 32        // recent readings a new one is compared with
+#define ZSCORE_LIMIT 4.0        // |z| from here is a sudden change
+#define ZSCORE_CRITICAL 6.0     // and from here Critical, if a record rule flags it
+#define DETECT_BASELINE 0.02    // weight of each reading in the slow baseline
+#define DETECT_CLIP 3.0         // EWMA and CUSUM see readings clipped to this
+#define EWMA_LAMBDA 0.2         // weight of each reading in the EWMA
+#define EWMA_LIMIT 3.0          // EWMA control limits, in EWMA standard deviations
+#define CUSUM_SLACK 0.5         // CUSUM allowance k
+#define CUSUM_LIMIT 5.0         // CUSUM decision interval h
+#define DETECTOR_RING 4096      // most recent alarms a store keeps
+
+// Calendar rollups
+#define ROLLUP_ROWS 12          // most recent periods listed by display_rollups()
+#define TREND_WEEKLY_SPAN 21    // days of data before trends add weekly averages
+#define TREND_MONTHLY_SPAN 93   // ... and monthly ones instead
+
+// Alert rules
+#define MAX_RULES 64
+#define RULE_GROUP_LEN 24
+#define RULE_MESSAGE_LEN 160
+
+// Health data structure
+typedef struct {
+    int day;        // date as days since 1970-01-01
+    int heart_rate;
+    int systolic_bp;
+    int diastolic_bp;
+    int blood_sugar;
+    float temperature;
+    int oxygen_level;
+    int steps;
+} HealthRecord;
+
+// Numeric vitals, in HealthRecord field order
+typedef enum {
+    VITAL_HEART_RATE = 0,
+    VITAL_SYSTOLIC,
+    VITAL_DIASTOLIC,
+    VITAL_BLOOD_SUGAR,
+    VITAL_TEMPERATURE, // the only float column
+    VITAL_OXYGEN,
+    VITAL_STEPS,
+    VITAL_COUNT
+} Vital;
+
+// Per-vital aggregate produced by the column kernels
+typedef struct {
+    long long count;
+    double sum;
+    double sum_sq;
+    double min;
+    double max;
+} ColumnSummary;
+
+// Percentiles reported for every vital
+enum {
+    QUANTILE_P50 = 0,
+    QUANTILE_P90,
+    QUANTILE_P99,
+    QUANTILE_COUNT
+};
+
+// Mergeable quantile sketch of one vital: a histogram with exact bins for
+// small values and logarithmically wider ones above, fixed in size whatever
+// the number of values (about 13 KB)
+typedef struct {
+    long long count;
+    double min;
+    double max;
+    uint32_t bins[SKETCH_BINS];
+} VitalSketch;
+
+typedef struct {
+    VitalSketch vitals[VITAL_COUNT];
+} QuantileSketch;
+
+// Statistics structure
+typedef struct {
+    float avg_heart_rate;
+    float avg_systolic;
+    float avg_diastolic;
+    float avg_blood_sugar;
+    float avg_temperature;
+    float avg_oxygen;
+    long long total_steps;
+    int record_count;
+    ColumnSummary vitals[VITAL_COUNT];
+    double quantiles[VITAL_COUNT][QUANTILE_COUNT]; // from a QuantileSketch, NAN if unknown
+} HealthStats;
+
+// What raised an alert
+typedef enum {
+    ALERT_RULE = 0,  // a rule of the active rule table
+    ALERT_TREND,     // significant rise over the last trend window
+    ALERT_DETECTOR   // alarms of one streaming detector
+} AlertKind;
+
+// Streaming anomaly detectors, run on every record as it is stored
+typedef enum {
+    DETECTOR_ZSCORE = 0, // reading far from the last ZSCORE_WINDOW readings
+    DETECTOR_EWMA,       // EWMA of the readings left its control limits
+    DETECTOR_CUSUM,      // cumulative sum of deviations crossed its limit
+    DETECTOR_COUNT
+} DetectorKind;
+
+// Alert categories as bits, used to choose advice
+enum {
+    CATEGORY_HEART = 1 << 0,
+    CATEGORY_BLOOD_PRESSURE = 1 << 1,
+    CATEGORY_SUGAR = 1 << 2,
+    CATEGORY_TEMPERATURE = 1 << 3,
+    CATEGORY_OXYGEN = 1 << 4,
+    CATEGORY_ACTIVITY = 1 << 5
+};
+
+// Alert structure: 16 bytes of facts; the text is produced by format_alert()
+// only when the alert is displayed or exported
+typedef struct {
+    uint8_t kind;     // AlertKind
+    uint8_t severity; // 1=Low, 2=Medium, 3=High, 4=Critical
+    uint8_t vital;    // Vital the alert is about
+    uint8_t rule;     // rule index for ALERT_RULE, DetectorKind for ALERT_DETECTOR
+    int record;       // record the value comes from, -1 for averages
+    int count;        // records that matched
+    float value;      // the reading or average
+} Alert;
+
+// Fixed-capacity ring of alerts. When it is full the oldest entry is
+// overwritten; the totals below still cover every alert raised.
+typedef struct {
+    Alert entries[ALERT_CAPACITY];
+    int start;              // oldest entry
+    int count;              // entries held
+    long long emitted;      // alerts raised
+    long long dropped;      // alerts overwritten
+    int max_severity;
+    unsigned categories;    // CATEGORY_* bits of every alert raised
+} AlertLog;
+
+// Rule scope: the dataset average, or every single record
+typedef enum {
+    RULE_AVERAGE = 0,
+    RULE_RECORD
+} RuleScope;
+
+typedef enum {
+    RULE_ABOVE = 0,  // >
+    RULE_AT_LEAST,   // >=
+    RULE_BELOW,      // <
+    RULE_AT_MOST     // <=
+} RuleOp;
+
+// One threshold rule. Within a group only the first rule (in file order)
+// that fires produces an alert.
+typedef struct {
+    RuleScope scope;
+    Vital vital;
+    RuleOp op;
+    double threshold;
+    int above;       // compiled for int columns: value > bound (1) or value < bound (0)
+    int bound;
+    int severity;
+    int group;
+    char message[RULE_MESSAGE_LEN]; // may use {value}, {date}, {count}, {threshold}, {<vital>}
+} Rule;
+
+// Compiled rule table: record rules are indexed by vital so each column is
+// checked against all of its rules while it is in cache
+typedef struct {
+    Rule rules[MAX_RULES];
+    int count;
+    char groups[MAX_RULES][RULE_GROUP_LEN];
+    int group_count;
+    int record_rules[VITAL_COUNT][MAX_RULES];
+    int record_rule_count[VITAL_COUNT];
+} RuleSet;
+
+// Running matches of the record rules over the records scanned so far;
+// adding records only needs the new ones scanned
+typedef struct {
+    long long hits[MAX_RULES];
+    double peak[MAX_RULES];     // most extreme matching reading
+    int peak_index[MAX_RULES];  // its record, -1 if none
+} RuleTally;
+
+// Arena block: memory is handed out sequentially and released all at once
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t capacity;
+    unsigned char data[];
+} ArenaBlock;
+
+// Arena allocator
+typedef struct {
+    ArenaBlock *head;
+    size_t total_bytes;
+} Arena;
+
+// Read-only view of a whole input file (memory-mapped where supported)
+typedef struct {
+    const char *data;
+    size_t size;
+    int mapped; // 1 = mmap, 0 = heap copy
+} MappedFile;
+
+// RECORD_CHUNK_SIZE records stored column by column (structure of arrays)
+typedef struct {
+    int *day;                  // days since 1970-01-01, ascending across the store
+    void *vitals[VITAL_COUNT]; // int columns, float for VITAL_TEMPERATURE
+    int owned;                 // 0 = read-only columns of a mapped .shm file
+} RecordChunk;
+
+// Running totals of every vital over records [0, i)
+typedef struct {
+    double sum[VITAL_COUNT];
+    double sum_sq[VITAL_COUNT];
+} PrefixEntry;
+
+// Optional prefix-sum index: the mean and variance of any run of records
+// come from two entries. Values are summed relative to shift (the first
+// record's values) so that differences of large totals stay accurate.
+typedef struct {
+    PrefixEntry *entries; // count + 1 entries
+    int count;            // records covered
+    int capacity;
+    int enabled;
+    double shift[VITAL_COUNT];
+} PrefixIndex;
+
+// One detector alarm
+typedef struct {
+    int record;
+    uint8_t vital;
+    uint8_t detector;   // DetectorKind
+    uint8_t severity;
+    uint8_t padding;
+    float value;        // the reading
+    float score;        // signed deviation in standard deviations
+} DetectorEvent;
+
+// Online detector state for one vital; constant size whatever the record count
+typedef struct {
+    long long seen;
+    double baseline;        // slow exponentially weighted mean
+    double variance;        // and variance
+    double ewma;            // fast EWMA of the readings
+    int ewma_out;           // EWMA is outside its control limits
+    double cusum_high;      // one-sided CUSUM sums
+    double cusum_low;
+    double recent[ZSCORE_WINDOW]; // ring of the last readings
+    double recent_sum;
+    double recent_sum_sq;
+    int recent_next;
+} VitalDetector;
+
+// Alarms per detector and vital over the records scanned so far
+typedef struct {
+    int hits[DETECTOR_COUNT][VITAL_COUNT];
+    DetectorEvent strongest[DETECTOR_COUNT][VITAL_COUNT]; // valid when hits > 0
+} DetectorTally;
+
+// Detectors of every vital, the tally of all their alarms and a ring of
+// the most recent ones, in record order. Memory is bounded whatever the
+// number of records or alarms.
+typedef struct {
+    VitalDetector vitals[VITAL_COUNT];
+    DetectorTally total;    // every alarm raised
+    DetectorEvent *events;  // ring of the last event_capacity alarms
+    long long event_count;  // alarms raised; alarm n is events[n % event_capacity]
+    int event_capacity;     // grows up to DETECTOR_RING
+    int count;              // records seen
+    int enabled;
+} DetectorSet;
+
+// Calendar periods of the rollups
+typedef enum {
+    PERIOD_DAY = 0,
+    PERIOD_WEEK,   // Monday to Sunday
+    PERIOD_MONTH,
+    PERIOD_COUNT
+} Period;
+
+// Totals of every vital over one calendar period
+typedef struct {
+    int start_day;          // first day of the period
+    int end_day;            // first day after it
+    int first;              // first record in the period
+    int count;              // records in it
+    float min[VITAL_COUNT];
+    float max[VITAL_COUNT];
+    double sum[VITAL_COUNT];
+} RollupBucket;
+
+// The periods of one granularity that have records, in date order
+typedef struct {
+    RollupBucket *buckets;
+    int count;
+    int capacity;
+} RollupLevel;
+
+// Optional daily, weekly and monthly rollups. Records arrive in date order,
+// so each append updates the last bucket of every level or opens a new one.
+typedef struct {
+    RollupLevel levels[PERIOD_COUNT];
+    int count;              // records covered
+    int enabled;
+} RollupSet;
+
+// Monotonic deque entry of a SlidingWindow
+typedef struct {
+    double value;
+    long long position;
+} WindowEntry;
+
+// The last `size` values of one series, with their mean, min, max and
+// least-squares slope available in O(1). Min and max come from monotonic
+// deques, so each push costs O(1) amortized whatever the window size.
+typedef struct {
+    int size;
+    long long pushed;       // values pushed so far
+    int cursor;             // ring slot the next value goes to
+    double *values;         // ring of the last size values
+    double sum;             // sum of x
+    double sum_sq;          // sum of x^2
+    double weighted;        // sum of k * x, k = 0 for the oldest value held
+    WindowEntry *low;       // increasing values: front is the minimum
+    WindowEntry *high;      // decreasing values: front is the maximum
+    int low_head, low_count;
+    int high_head, high_count;
+} SlidingWindow;
+
+// Sliding-window figures for a range of records
+typedef struct {
+    int window;             // records per window (the range length if shorter)
+    int records;            // records in the range
+    int last;               // index just past the range
+    unsigned vitals;        // bit v set = vital v was computed
+    // The last window of the range
+    double mean[VITAL_COUNT];
+    double min[VITAL_COUNT];
+    double max[VITAL_COUNT];
+    double slope[VITAL_COUNT];   // change per record
+    double slope_t[VITAL_COUNT]; // slope / its standard error
+    // Moving average at evenly spaced window ends, oldest first
+    int sample_count;
+    int sample_record[TREND_SAMPLES];
+    double samples[VITAL_COUNT][TREND_SAMPLES];
+} TrendReport;
+
+// Growable columnar record store: a table of fixed-size chunks, so growing
+// never moves records that are already stored
+typedef struct {
+    Arena arena;
+    RecordChunk *chunks;
+    int chunk_count;
+    int chunk_capacity;
+    int count;
+    MappedFile backing; // .shm mapping that unowned chunks point into
+    PrefixIndex prefix; // kept up to date on every append once enabled
+    DetectorSet detectors; // likewise
+    RollupSet rollups;  // likewise, once enabled
+    unsigned long long version;   // bumped by every change to the records
+    unsigned long long rewritten; // version of the last change that moved or dropped records
+} RecordStore;
+
+// Whole-store statistics and alerts, kept against the store version they
+// describe. Records appended since then are folded into the running state;
+// anything else starts it over.
+typedef struct {
+    unsigned long long version; // store version of the results
+    int count;                  // records folded in, -1 = nothing computed yet
+    HealthStats stats;
+    AlertLog alerts;
+    QuantileSketch *sketch;     // running sketch behind stats.quantiles; NULL without memory
+    RuleTally rules;
+    DetectorTally detectors;
+} AnalysisCache;
+
+// TXT field keys, in the order a record lists them
+typedef enum {
+    TXT_KEY_NONE = 0,
+    TXT_KEY_DATE,
+    TXT_KEY_HEART_RATE,
+    TXT_KEY_BLOOD_PRESSURE,
+    TXT_KEY_BLOOD_SUGAR,
+    TXT_KEY_TEMPERATURE,
+    TXT_KEY_OXYGEN,
+    TXT_KEY_STEPS
+} TxtKey;
+
+// .shm file header; each column is a contiguous, 64-byte aligned array.
+// Column 0 is the day number, column 1 + v holds vital v.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint64_t record_count;
+    uint64_t column_offset[SHM_COLUMN_COUNT];
+    uint32_t column_width[SHM_COLUMN_COUNT];
+} ShmHeader;
+
+// .shz file header. Compressed blocks of block_records records (the last
+// one may be shorter) follow it, then a ShzBlock for each at index_offset.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint64_t record_count;
+    uint64_t index_offset;
+    uint32_t block_count;
+    uint32_t block_records;
+} ShzHeader;
+
+// Index entry of one .shz block. The block starts with the byte size of
+// each column, day first, then the columns themselves.
+typedef struct {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t rows;
+    int32_t first_day;
+    int32_t last_day;
+    uint32_t crc;      // CRC-32C of the block
+    uint32_t reserved;
+} ShzBlock;
+
+// Mapped .shm file with typed pointers to each column
+typedef struct {
+    MappedFile file;
+    int count;
+    const int *day;
+    const void *vitals[VITAL_COUNT];
+} ShmDataset;
+
+// .wal file header, followed by one WalFrame per logged record
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t frame_size;
+} WalHeader;
+
+// One logged record. The checksum covers the sequence number and the
+// record, so a torn or half-written frame is recognized on replay.
+typedef struct {
+    uint32_t sequence;   // position in the log, from 0
+    HealthRecord record;
+    uint32_t checksum;   // CRC-32C of everything before it
+} WalFrame;
+
+// Append-only log of manually added records. Appends are staged and then
+// written and synced as a group (group commit); replay keeps every record
+// up to the first damaged frame.
+typedef struct {
+    char path[MAX_PATH_LEN];  // empty = no log; appends fail
+    int fd;                   // -1 until the first commit creates the file
+    uint32_t sequence;        // of the next frame
+    long long committed;      // file bytes known to be on disk
+    WalFrame pending[WAL_GROUP_RECORDS];
+    int pending_count;
+    double pending_since;     // when the oldest staged frame was appended
+    HealthRecord *records;    // every record in the log, in log order
+    int count;
+    int capacity;
+    long long commits;        // group commits so far
+} WriteAheadLog;
+
+// One input of --stream (stdin, a FIFO or file, or a socket client) and
+// the start of a line that has not arrived completely yet
+typedef struct {
+    int fd;
+    size_t length;        // bytes of the unfinished line held in line
+    int overlong;         // the unfinished line is over MAX_LINE; dropped
+    char line[MAX_LINE];
+} StreamSource;
+
+// Running state of --stream, updated per record. Its size is fixed, so
+// memory does not grow however long the stream runs.
+typedef struct {
+    HealthStats stats;
+    QuantileSketch *sketch;          // NULL without memory: no percentiles
+    VitalDetector detectors[VITAL_COUNT];
+    AlertLog alerts;                 // the latest alerts, plus totals
+    long long rule_hits[MAX_RULES];  // readings that matched each record rule
+    int record_rule[MAX_RULES];      // per group: record rule the last reading matched, -1 = none
+    int average_rule[MAX_RULES];     // per group: average rule in effect, -1 = none
+    long long rejected;              // lines that are not records
+    double started;
+} StreamMonitor;
+
+// One patient's records and, once analyzed, their whole-range analysis,
+// so most --serve queries only render it
+typedef struct {
+    char name[MAX_NAME];       // patient ID: its PatientID value, or the file name without extension
+    char input[MAX_PATH_LEN];  // file the records came from
+    RecordStore store;
+    HealthStats stats;
+    AlertLog alerts;
+} Patient;
+
+// Slot of a shard's open-addressing table
+typedef struct {
+    uint64_t hash;             // of the patient ID; 0 = empty
+    Patient *patient;
+} PatientSlot;
+
+// One shard of a PatientStore: a linear-probing table with its own lock.
+// Patients are replaced but never removed, so probing needs no tombstones.
+typedef struct {
+#ifndef _WIN32
+    pthread_rwlock_t lock;
+#endif
+    PatientSlot *slots;
+    int capacity;              // power of two, 0 until the first insert
+    int count;
+} PatientShard;
+
+// Patients keyed by ID. The top bits of an ID's hash pick the shard and
+// the low bits its first slot, so a lookup is O(1), and a writer holds up
+// only the readers of its own shard.
+typedef struct {
+    PatientShard shards[PATIENT_SHARDS];
+} PatientStore;
+
+// What one shard holds, for memory reporting
+typedef struct {
+    int patients;
+    long long records;
+    size_t bytes;              // tables, patients and their record stores
+} PatientShardUsage;
+
+// What a --serve query returns
+typedef enum {
+    QUERY_STATS = 0,
+    QUERY_ALERTS,
+    QUERY_SCORE,
+    QUERY_TRENDS,
+    QUERY_REPORT     // all of the above but the trends
+} QueryKind;
+
+// Input file formats
+typedef enum {
+    FORMAT_AUTO = 0,
+    FORMAT_CSV,
+    FORMAT_TXT,
+    FORMAT_SHM,
+    FORMAT_SHZ
+} InputFormat;
+
+// Report file formats; REPORT_AUTO picks one from the file extension
+typedef enum {
+    REPORT_AUTO = 0,
+    REPORT_TEXT,
+    REPORT_CSV,
+    REPORT_JSON
+} ReportFormat;
+
+// Text being rendered. Starts in the caller's storage and moves to the heap
+// only if it outgrows it.
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int owned;   // data is heap memory of ours
+    int failed;  // memory ran out; the text is incomplete
+} OutputBuffer;
+
+// Batch mode exit codes
+enum {
+    EXIT_OK = 0,
+    EXIT_USAGE = 2,
+    EXIT_LOAD_FAILED = 3,
+    EXIT_EXPORT_FAILED = 4,
+    EXIT_ALERT_THRESHOLD = 5
+};
+
+// Output format for --profile
+typedef enum {
+    PROFILE_OFF = 0,
+    PROFILE_TABLE,
+    PROFILE_JSON
+} ProfileMode;
+
+// Timed pipeline stages
+typedef enum {
+    STAGE_CSV_LOAD = 0,
+    STAGE_TXT_LOAD,
+    STAGE_SHM_LOAD,
+    STAGE_SHM_EXPORT,
+    STAGE_SHZ_LOAD,
+    STAGE_SHZ_EXPORT,
+    STAGE_STATISTICS,
+    STAGE_ANALYSIS,
+    STAGE_TRENDS,
+    STAGE_REPORT_EXPORT,
+    STAGE_COUNT
+} Stage;
+
+// Per-thread profiling counters, merged into the main thread's copy when
+// worker threads finish
+typedef struct {
+    double seconds[STAGE_COUNT];
+    long long calls[STAGE_COUNT];
+    long long rows_read;
+    long long rows_rejected;
+    long long bytes_parsed;
+    long long alerts_emitted;
+} Profile;
+
+// Command line options for non-interactive batch runs
+typedef struct {
+    const char *input;
+    const char *report;   // NULL = print the report to stdout
+    const char *input_dir;  // multi-patient mode: one input file per patient
+    const char *report_dir; // per-patient reports and summary.txt go here
+    InputFormat format;
+    int threads;          // 0 = one per online CPU
+    int fail_on;          // exit with EXIT_ALERT_THRESHOLD at this severity (0 = never)
+    long long generate;   // records to synthesize into output (0 = off)
+    const char *output;
+    long long benchmark;  // records to benchmark with (0 = off)
+    uint64_t seed;
+    double anomaly_rate;
+    int repeat;
+    ProfileMode profile;
+    const char *rules;    // rule file (NULL = built-in rules)
+    int from_day;         // --input: analyze only records dated from_day..to_day
+    int to_day;
+    int last_days;        // --last-days N: the N days ending at to_day or the newest record
+    int compare_day;      // --compare: before/after means around this day (INT_MIN = off)
+    int window;           // records per trend window
+    int rollup;           // --rollup: Period to summarize by (-1 = off)
+    ReportFormat report_format; // --report-format; REPORT_AUTO = from the --report extension
+    const char *wal;      // interactive mode: manual record log (NULL = WAL_DEFAULT_FILE)
+    const char *stream;   // --stream: "-" (stdin), a FIFO or file, or unix:PATH
+    int summary_every;    // --stream: seconds between summaries (0 = only at the end)
+    const char *serve;    // --serve: unix:PATH or tcp:PORT (127.0.0.1 only)
+    const char *patient;  // --input: analyze this patient of a multi-patient CSV
+} BatchOptions;
+
+// One patient file in a multi-patient batch and the results of its analysis.
+// Each job is written only by the worker that runs it.
+typedef struct {
+    char input[MAX_PATH_LEN];
+    char report[MAX_PATH_LEN];
+    char name[MAX_NAME];
+    long long bytes;      // input size, used to schedule large files first
+    int loaded;
+    int exported;
+    HealthStats stats;
+    long long alert_count;
+    int max_severity;
+    int health_score;
+} PatientJob;
+
+// Deterministic random stream (splitmix64)
+typedef struct {
+    uint64_t state;
+} SynthRng;
+
+// Anomaly episodes the generator can inject
+typedef enum {
+    ANOMALY_NONE = 0,
+    ANOMALY_TACHYCARDIA,
+    ANOMALY_HYPERTENSION,
+    ANOMALY_HYPERGLYCEMIA,
+    ANOMALY_FEVER,
+    ANOMALY_HYPOXIA,
+    ANOMALY_SEDENTARY,
+    ANOMALY_COUNT
+} AnomalyType;
+
+// Synthetic patient: personal baselines that drift slowly from day to day,
+// plus the anomaly episode in progress
+typedef struct {
+    SynthRng rng;
+    long long index;
+    long long count;
+    long long span_days;
+    double anomaly_rate;
+    double base_heart_rate, base_systolic, base_diastolic, base_blood_sugar;
+    double base_temperature, base_oxygen, base_steps;
+    double heart_rate, systolic, blood_sugar, steps; // drifting baselines
+    AnomalyType anomaly;
+    int anomaly_days;
+    long long episodes;
+} SynthPatient;
+
+// Profiling is switched on once at startup, before any thread exists, and
+// only read afterwards. Counters are thread-local so workers never share them.
+static ProfileMode profile_mode = PROFILE_OFF;
+static _Thread_local Profile thread_profile;
+
+// Alert rules in effect; set up once in main() and read-only afterwards
+static RuleSet active_rules;
+
+// Records per trend window; set once in main() like active_rules
+static int trend_window = TREND_WINDOW;
+
+static const double quantile_levels[QUANTILE_COUNT] = { 0.50, 0.90, 0.99 };
+
+// Function prototypes
+void print_banner();
+void print_menu();
+void *arena_alloc(Arena *arena, size_t size);
+void arena_free(Arena *arena);
+void arena_reset(Arena *arena);
+void store_init(RecordStore *store);
+void store_clear(RecordStore *store);
+void store_free(RecordStore *store);
+int store_reserve_chunks(RecordStore *store, int chunk_count);
+int chunk_alloc(Arena *arena, RecordChunk *chunk);
+RecordChunk *store_tail_chunk(RecordStore *store);
+int store_append(RecordStore *store, const HealthRecord *record);
+void store_get(const RecordStore *store, int index, HealthRecord *record);
+int store_chunk_rows(const RecordStore *store, int c);
+int store_append_all(RecordStore *dst, const RecordStore *src);
+int store_attach_shm(RecordStore *store, ShmDataset *dataset);
+int store_day(const RecordStore *store, int index);
+int store_sort_by_day(RecordStore *store);
+int store_insert(RecordStore *store, const HealthRecord *record);
+void store_find_days(const RecordStore *store, int from_day, int to_day, int *first, int *last);
+int store_chunk_span(const RecordStore *store, int c, int first, int last, int *offset);
+int parse_date(const char *p, const char *end, int *day);
+int store_enable_prefix(RecordStore *store);
+int store_update_prefix(RecordStore *store);
+size_t store_prefix_bytes(const RecordStore *store);
+int store_enable_detectors(RecordStore *store);
+int store_update_detectors(RecordStore *store);
+int store_enable_rollups(RecordStore *store);
+int store_update_rollups(RecordStore *store);
+int store_update_indexes(RecordStore *store);
+size_t store_memory(const RecordStore *store);
+size_t store_rollup_bytes(const RecordStore *store);
+void period_bounds(Period period, int day, int *start, int *end);
+void store_find_periods(const RecordStore *store, Period period, int from_day, int to_day,
+                        int *first, int *last);
+int store_range_moments(const RecordStore *store, int first, int last, Vital vital,
+                        double *mean, double *variance);
+const char *vital_name(Vital vital);
+void summary_init(ColumnSummary *summary);
+void summary_add_block(ColumnSummary *summary, int n, double sum, double sum_sq, double min, double max);
+double summary_mean(const ColumnSummary *summary);
+double summary_stddev(const ColumnSummary *summary);
+void summarize_column(const void *column, Vital vital, int n, ColumnSummary *summary);
+void sketch_init(QuantileSketch *sketch);
+void sketch_add_column(VitalSketch *sketch, const void *column, Vital vital, int n);
+void sketch_merge(QuantileSketch *dst, const QuantileSketch *src);
+double sketch_quantile(const VitalSketch *sketch, Vital vital, double q);
+int load_csv_data(const char *filename, RecordStore *store);
+TxtKey match_txt_key(const char *p, const char *end, const char **value);
+int parse_txt_value(TxtKey key, const char *p, const char *end, HealthRecord *record);
+int load_txt_data(const char *filename, RecordStore *store, int *incomplete);
+int map_file(const char *filename, MappedFile *file);
+void unmap_file(MappedFile *file);
+int parse_int_field(const char **cursor, const char *end, int *value);
+int parse_float_field(const char **cursor, const char *end, float *value);
+int parse_csv_row(const char *line, const char *end, HealthRecord *record);
+int parse_csv_range(const char *p, const char *end, RecordStore *store, long long *rejected);
+int load_csv_data_mapped(const char *filename, RecordStore *store);
+int load_csv_data_parallel(const char *filename, RecordStore *store, int threads);
+int default_thread_count();
+int has_extension(const char *filename, const char *extension);
+int shm_open_dataset(const char *filename, ShmDataset *dataset);
+void shm_close_dataset(ShmDataset *dataset);
+int load_shm_data(const char *filename, RecordStore *store);
+int export_shm_data(const RecordStore *store, const char *filename);
+int convert_to_shm(const char *input, const char *output, int threads);
+size_t shz_encode_block(const RecordChunk *chunk, int rows, unsigned char *out);
+int shz_decode_block(const unsigned char *data, size_t size, int rows, RecordChunk *chunk);
+int load_shz_data(const char *filename, RecordStore *store);
+int export_shz_data(const RecordStore *store, const char *filename);
+uint32_t crc32c(const void *data, size_t size);
+int wal_open(WriteAheadLog *wal, const char *path);
+int wal_append(WriteAheadLog *wal, const HealthRecord *record);
+int wal_commit(WriteAheadLog *wal);
+int wal_close(WriteAheadLog *wal);
+int wal_restore(const WriteAheadLog *wal, RecordStore *store);
+void calculate_statistics(const RecordStore *store, HealthStats *stats);
+void calculate_statistics_range(const RecordStore *store, int from_day, int to_day, HealthStats *stats);
+void calculate_statistics_sketch(const RecordStore *store, int from_day, int to_day, HealthStats *stats,
+                                 QuantileSketch *sketch);
+void statistics_add(const RecordStore *store, int first, int last, HealthStats *stats, QuantileSketch *sketch);
+void statistics_finish(HealthStats *stats, QuantileSketch *sketch);
+void analyze_health(const RecordStore *store, HealthStats stats, AlertLog *alerts);
+int window_init(SlidingWindow *window, int size);
+void window_free(SlidingWindow *window);
+void window_push(SlidingWindow *window, double value);
+double window_mean(const SlidingWindow *window);
+double window_slope(const SlidingWindow *window, double *t_value);
+int compute_trends(const RecordStore *store, int first, int last, int window, unsigned vitals,
+                   TrendReport *report);
+int trend_direction(const TrendReport *report, Vital vital);
+void analyze_health_range(const RecordStore *store, int from_day, int to_day, HealthStats stats,
+                          AlertLog *alerts);
+void detector_alert(const DetectorEvent *event, int count, Alert *alert);
+void detector_alerts(const RecordStore *store, int first, int last, AlertLog *alerts);
+void detector_tally_add(const RecordStore *store, int first, int last, DetectorTally *tally);
+void detector_tally_alerts(const DetectorTally *tally, AlertLog *alerts);
+void trend_alerts(const RecordStore *store, int first, int last, AlertLog *alerts);
+void analysis_init(AnalysisCache *cache);
+void analysis_free(AnalysisCache *cache);
+int analysis_refresh(AnalysisCache *cache, RecordStore *store);
+void alert_log_init(AlertLog *log);
+void alert_log_push(AlertLog *log, const Alert *alert);
+const Alert *alert_log_at(const AlertLog *log, int i);
+unsigned vital_category(Vital vital);
+void format_alert(const Alert *alert, const HealthStats *stats, const RecordStore *store,
+                  char *out, size_t size);
+void format_alert_dated(const Alert *alert, const HealthStats *stats, const char *date,
+                        char *out, size_t size);
+const char *vital_key(Vital vital);
+double stats_average(const HealthStats *stats, Vital vital);
+int parse_rules(const char *text, const char *source, RuleSet *rules);
+int load_rules(const char *filename, RuleSet *rules);
+void evaluate_rules(const RuleSet *rules, const RecordStore *store, int first, int last,
+                    const HealthStats *stats, AlertLog *alerts);
+void rule_tally_init(const RuleSet *rules, RuleTally *tally);
+void rule_tally_add(const RuleSet *rules, const RecordStore *store, int first, int last, RuleTally *tally);
+void rule_alerts(const RuleSet *rules, const RuleTally *tally, const HealthStats *stats, AlertLog *alerts);
+void display_report(HealthStats stats, const AlertLog *alerts, const RecordStore *store);
+void render_console_report(OutputBuffer *out, HealthStats stats, const AlertLog *alerts,
+                           const RecordStore *store);
+void display_trends(const RecordStore *store);
+void display_trends_range(const RecordStore *store, int from_day, int to_day);
+void render_trends(OutputBuffer *out, const RecordStore *store, int from_day, int to_day);
+void display_comparison(const RecordStore *store, int split_day, int from_day, int to_day);
+void render_comparison(OutputBuffer *out, const RecordStore *store, int split_day, int from_day, int to_day);
+void display_rollups(const RecordStore *store, Period period, int from_day, int to_day);
+void render_rollups(OutputBuffer *out, const RecordStore *store, Period period, int from_day, int to_day);
+void generate_advice(const AlertLog *alerts);
+int export_report(HealthStats stats, const AlertLog *alerts, const RecordStore *store, ReportFormat format,
+                  const char *filename);
+int write_report_file(HealthStats stats, const AlertLog *alerts, const RecordStore *store,
+                      ReportFormat format, const char *filename);
+ReportFormat report_format_for(const char *filename);
+const char *report_extension(ReportFormat format);
+void render_report_as(OutputBuffer *out, ReportFormat format, HealthStats stats, const AlertLog *alerts,
+                      const RecordStore *store);
+void render_report_text(OutputBuffer *out, HealthStats stats, const AlertLog *alerts,
+                        const RecordStore *store);
+void render_report_csv(OutputBuffer *out, HealthStats stats, const AlertLog *alerts,
+                       const RecordStore *store);
+void render_report_json(OutputBuffer *out, HealthStats stats, const AlertLog *alerts,
+                        const RecordStore *store);
+void format_timestamp(char *buffer, size_t size);
+const char *severity_name(int severity);
+void print_usage(const char *program);
+int parse_options(int argc, char *argv[], BatchOptions *options);
+int load_data(const char *filename, InputFormat format, RecordStore *store, int threads);
+int run_batch(const BatchOptions *options);
+int discover_patient_files(const char *dir, InputFormat format, const char *report_dir,
+                           ReportFormat report_format, PatientJob **jobs);
+void analyze_patient(PatientJob *job, RecordStore *store, InputFormat format, QuantileSketch *cohort);
+int run_patient_pool(PatientJob *jobs, int job_count, InputFormat format, int threads,
+                     QuantileSketch *cohort);
+int write_patient_summary(const PatientJob *jobs, int job_count, const QuantileSketch *cohort,
+                          const char *filename);
+int run_patient_batch(const BatchOptions *options);
+void add_manual_record(RecordStore *store, WriteAheadLog *wal);
+void restore_manual_records(const WriteAheadLog *wal, RecordStore *store);
+void switch_manual_records(WriteAheadLog *wal, const char *input, const char *default_log, RecordStore *store);
+float calculate_bmi(float weight, float height);
+int calculate_health_score(HealthStats stats);
+void display_health_score(int score);
+void render_health_score(OutputBuffer *out, int score);
+void create_sample_data();
+uint64_t synth_next(SynthRng *rng);
+double synth_uniform(SynthRng *rng);
+double synth_normal(SynthRng *rng);
+void civil_from_days(long long days, int *year, int *month, int *mday);
+int days_from_civil(int year, int month, int mday);
+void days_to_date(long long days, char *date);
+void synth_init(SynthPatient *patient, uint64_t seed, long long count, double anomaly_rate);
+void synth_next_record(SynthPatient *patient, HealthRecord *record);
+int generate_dataset(const char *filename, InputFormat format, long long count,
+                     uint64_t seed, double anomaly_rate, long long *episodes);
+int run_generate(const BatchOptions *options);
+void stream_init(StreamMonitor *monitor);
+void stream_free(StreamMonitor *monitor);
+void stream_line(StreamMonitor *monitor, const char *line, const char *end, OutputBuffer *out);
+void stream_record(StreamMonitor *monitor, const HealthRecord *record, OutputBuffer *out);
+void stream_check_averages(StreamMonitor *monitor, OutputBuffer *out);
+void render_stream_summary(OutputBuffer *out, StreamMonitor *monitor);
+int run_stream(const BatchOptions *options);
+void patient_init(Patient *patient, const char *name, size_t length, const char *input);
+int patient_load(Patient *patient, const char *name, const char *input, InputFormat format);
+void patient_analyze(Patient *patient);
+void patient_free(Patient *patient);
+uint64_t patient_hash(const char *id, size_t length);
+void patients_init(PatientStore *patients);
+void patients_free(PatientStore *patients);
+Patient *patients_acquire(PatientStore *patients, const char *id, size_t length);
+void patients_release(PatientStore *patients, const Patient *patient);
+int patients_put(PatientStore *patients, Patient *patient, Patient **replaced);
+int patients_take_all(PatientStore *patients, Patient ***list);
+void patients_usage(PatientStore *patients, PatientShardUsage *usage);
+int csv_has_patient_column(const char *filename);
+int load_patient_csv(const char *filename, const char *only_id, Patient ***loaded);
+int load_patient_data(const char *filename, const char *id, RecordStore *store);
+void render_query(OutputBuffer *out, const Patient *patient, QueryKind kind, int from_day, int to_day);
+void render_query_error(OutputBuffer *out, const char *message);
+int run_server(const BatchOptions *options);
+double monotonic_seconds();
+int run_benchmark(const BatchOptions *options);
+const char *stage_name(Stage stage);
+double profile_start();
+void profile_stop(Stage stage, double started);
+void profile_rows(long long read, long long rejected, long long bytes);
+void profile_merge(const Profile *other);
+void profile_report(FILE *out);
+void print_line(char c, int length);
+void output_init(OutputBuffer *out, char *storage, size_t capacity);
+void output_free(OutputBuffer *out);
+void output_printf(OutputBuffer *out, const char *format, ...);
+void output_line(OutputBuffer *out, char c, int length);
+void output_append(OutputBuffer *out, const char *data, size_t length);
+void output_csv_field(OutputBuffer *out, const char *text);
+void output_json_string(OutputBuffer *out, const char *text);
+int output_flush(OutputBuffer *out, FILE *file);
+int output_save(OutputBuffer *out, const char *filename);
+
+int main(int argc, char *argv[]) {
+    RecordStore store;
+    AnalysisCache analysis;
+    WriteAheadLog wal;
+    int choice;
+    char filename[100];
+    BatchOptions options;
+
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return EXIT_USAGE;
+    }
+    profile_mode = options.profile;
+    if (!load_rules(options.rules, &active_rules)) {
+        return EXIT_USAGE;
+    }
+    trend_window = options.window;
+    crc32c(NULL, 0); // builds its table before any worker thread needs it
+
+    if (options.input || options.input_dir || options.generate > 0 || options.benchmark > 0 || options.stream) {
+        int status;
+        if (options.input) status = run_batch(&options);
+        else if (options.serve) status = run_server(&options);
+        else if (options.input_dir) status = run_patient_batch(&options);
+        else if (options.stream) status = run_stream(&options);
+        else if (options.generate > 0) status = run_generate(&options);
+        else status = run_benchmark(&options);
+        profile_report(stderr);
+        return status;
+    }
+    int ingest_threads = options.threads;
+
+    store_init(&store);
+    analysis_init(&analysis);
+    print_banner();
+
+    // Manual records from earlier sessions
+    const char *wal_file = options.wal ? options.wal : WAL_DEFAULT_FILE;
+    if (!wal_open(&wal, wal_file)) {
+        printf("[WARNING] '%s' is not a usable record log - manual records will not be saved.\n", wal_file);
+    }
+    restore_manual_records(&wal, &store);
+
+    while (1) {
+        print_menu();
+        printf("\nEnter your choice: ");
+        scanf("%d", &choice);
+        getchar(); // Clear newline
+
+        switch (choice) {
+            case 1: {
+                printf("\nEnter CSV filename: ");
+                fgets(filename, sizeof(filename), stdin);
+                filename[strcspn(filename, "\n")] = 0;
+
+                unsigned long long rewritten = store.rewritten;
+                if (load_csv_data_parallel(filename, &store, ingest_threads)) {
+                    printf("[SUCCESS] Loaded %d records successfully!\n", store.count);
+                } else {
+                    printf("[ERROR] Failed to load data.\n");
+                }
+                // A load replaces the records; the file's own manual ones come back
+                if (store.rewritten != rewritten) switch_manual_records(&wal, filename, wal_file, &store);
+                break;
+            }
+
+            case 2: {
+                printf("\nEnter TXT filename: ");
+                fgets(filename, sizeof(filename), stdin);
+                filename[strcspn(filename, "\n")] = 0;
+
+                int incomplete = 0;
+                unsigned long long rewritten = store.rewritten;
+                if (load_txt_data(filename, &store, &incomplete)) {
+                    printf("[SUCCESS] Loaded %d records successfully!\n", store.count);
+                } else {
+                    printf("[ERROR] Failed to load data.\n");
+                }
+                if (incomplete > 0) {
+                    printf("[WARNING] Skipped %d incomplete or malformed record(s).\n", incomplete);
+                }
+                if (store.rewritten != rewritten) switch_manual_records(&wal, filename, wal_file, &store);
+                break;
+            }
+
+            case 3:
+                if (store.count == 0) {
+                    printf("[WARNING] No data loaded. Please load data first.\n");
+                } else {
+                    // Recomputed only if records changed since the last report
+                    analysis_refresh(&analysis, &store);
+                    display_report(analysis.stats, &analysis.alerts, &store);
+                }
+                break;
+
+            case 4:
+                if (store.count == 0) {
+                    printf("[WARNING] No data loaded. Please load data first.\n");
+                } else {
+                    // Rollups are built on first use, like the range index
+                    if (!store.rollups.enabled && !store_enable_rollups(&store)) {
+                        printf("[WARNING] Out of memory - showing trends without period averages.\n");
+                    }
+                    display_trends(&store);
+                }
+                break;
+
+            case 5:
+                if (analysis.count < 0) {
+                    printf("[WARNING] No analysis performed yet. Please analyze data first (Option 3).\n");
+                } else {
+                    analysis_refresh(&analysis, &store);
+                    generate_advice(&analysis.alerts);
+                }
+                break;
+
+            case 6:
+                add_manual_record(&store, &wal);
+                break;
+
+            case 7:
+                if (store.count == 0) {
+                    printf("[WARNING] No data to export.\n");
+                } else {
+                    printf("\nEnter output filename: ");
+                    fgets(filename, sizeof(filename), stdin);
+                    filename[strcspn(filename, "\n")] = 0;
+                    analysis_refresh(&analysis, &store);
+                    export_report(analysis.stats, &analysis.alerts, &store, REPORT_AUTO, filename);
+                }
+                break;
+
+            case 8:
+                create_sample_data();
+                break;
+
+            case 9:
+                print_line('=', 60);
+                printf("    Thank you for using Smart Health Monitor!\n");
+                printf("    Stay healthy!\n");
+                print_line('=', 60);
+                printf("\n");
+                wal_close(&wal);
+                analysis_free(&analysis);
+                store_free(&store);
+                profile_report(stderr);
+                return 0;
+
+            case 10: {
+                printf("\nEnter .shm or .shz filename: ");
+                fgets(filename, sizeof(filename), stdin);
+                filename[strcspn(filename, "\n")] = 0;
+
+                unsigned long long rewritten = store.rewritten;
+                int loaded = has_extension(filename, ".shz") ? load_shz_data(filename, &store)
+                                                             : load_shm_data(filename, &store);
+                if (loaded) {
+                    printf("[SUCCESS] Loaded %d records successfully!\n", store.count);
+                } else {
+                    printf("[ERROR] Failed to load data.\n");
+                }
+                if (store.rewritten != rewritten) switch_manual_records(&wal, filename, wal_file, &store);
+                break;
+            }
+
+            case 11: {
+                char output[100];
+                printf("\nEnter CSV/TXT filename: ");
+                fgets(filename, sizeof(filename), stdin);
+                filename[strcspn(filename, "\n")] = 0;
+                printf("Enter output .shm or .shz filename: ");
+                fgets(output, sizeof(output), stdin);
+                output[strcspn(output, "\n")] = 0;
+
+                if (!convert_to_shm(filename, output, ingest_threads)) {
+                    printf("[ERROR] Conversion failed.\n");
+                }
+                break;
+            }
+
+            case 12: {
+                char date[DATE_LEN];
+                int split_day;
+                if (store.count == 0) {
+                    printf("[WARNING] No data loaded. Please load data first.\n");
+                    break;
+                }
+                printf("\nEnter split date (YYYY-MM-DD): ");
+                scanf("%19s", date);
+                getchar();
+                if (!parse_date(date, date + strlen(date), &split_day)) {
+                    printf("[ERROR] '%s' is not a valid date.\n", date);
+                    break;
+                }
+                // Built on first use; later loads and added records keep it current
+                if (!store.prefix.enabled && !store_enable_prefix(&store)) {
+                    printf("[ERROR] Out of memory - cannot build the range index.\n");
+                    break;
+                }
+                display_comparison(&store, split_day, INT_MIN, INT_MAX);
+                break;
+            }
+
+            case 13: {
+                char letter[8];
+                Period period;
+                if (store.count == 0) {
+                    printf("[WARNING] No data loaded. Please load data first.\n");
+                    break;
+                }
+                printf("\nSummarize by (d)ay, (w)eek or (m)onth: ");
+                scanf("%7s", letter);
+                getchar();
+                if (letter[0] == 'd' || letter[0] == 'D') period = PERIOD_DAY;
+                else if (letter[0] == 'w' || letter[0] == 'W') period = PERIOD_WEEK;
+                else if (letter[0] == 'm' || letter[0] == 'M') period = PERIOD_MONTH;
+                else {
+                    printf("[ERROR] Invalid period. Enter d, w or m.\n");
+                    break;
+                }
+                if (!store.rollups.enabled && !store_enable_rollups(&store)) {
+                    printf("[ERROR] Out of memory - cannot build the period rollups.\n");
+                    break;
+                }
+                display_rollups(&store, period, INT_MIN, INT_MAX);
+                break;
+            }
+
+            default:
+                printf("[ERROR] Invalid choice. Please try again.\n");
+        }
+
+        printf("\nPress Enter to continue...");
+        getchar();
+    }
+
+    analysis_free(&analysis);
+    store_free(&store);
+    return 0;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    // Keep every allocation pointer-aligned
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    ArenaBlock *block = arena->head;
+    if (!block || block->capacity - block->used < size) {
+        // Small stores stay small; large ones soon get full-size blocks
+        size_t capacity = block ? block->capacity * 2 : ARENA_FIRST_BLOCK;
+        if (capacity > ARENA_BLOCK_SIZE) capacity = ARENA_BLOCK_SIZE;
+        if (capacity < size) capacity = size;
+        block = malloc(sizeof(ArenaBlock) + capacity);
+        if (!block) {
+            return NULL;
+        }
+        block->next = arena->head;
+        block->used = 0;
+        block->capacity = capacity;
+        arena->head = block;
+        arena->total_bytes += capacity;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->total_bytes = 0;
+}
+
+// Release everything but one block, which is kept for the next load
+void arena_reset(Arena *arena) {
+    ArenaBlock *keep = arena->head;
+    if (!keep) {
+        return;
+    }
+    arena->head = keep->next;
+    arena_free(arena);
+    keep->next = NULL;
+    keep->used = 0;
+    arena->head = keep;
+    arena->total_bytes = keep->capacity;
+}
+
+void store_init(RecordStore *store) {
+    store->arena.head = NULL;
+    store->arena.total_bytes = 0;
+    store->chunks = NULL;
+    store->chunk_count = 0;
+    store->chunk_capacity = 0;
+    store->count = 0;
+    store->backing.data = NULL;
+    store->backing.size = 0;
+    store->backing.mapped = 0;
+    memset(&store->prefix, 0, sizeof(store->prefix));
+    memset(&store->detectors, 0, sizeof(store->detectors));
+    memset(&store->rollups, 0, sizeof(store->rollups));
+    store->version = 0;
+    store->rewritten = 0;
+}
+
+void store_clear(RecordStore *store) {
+    arena_reset(&store->arena);
+    if (store->backing.data) {
+        unmap_file(&store->backing);
+    }
+    store->chunk_count = 0;
+    store->count = 0;
+    store->prefix.count = 0;
+    // Detectors go off with the records, so a load stays a load (O(1) for
+    // .shm); the next analysis switches them on and runs them
+    store->detectors.enabled = 0;
+    store->detectors.count = 0;
+    store->detectors.event_count = 0;
+    store->rollups.count = 0;
+    for (int p = 0; p < PERIOD_COUNT; p++) {
+        store->rollups.levels[p].count = 0;
+    }
+    store->rewritten = ++store->version;
+}
+
+void store_free(RecordStore *store) {
+    store_clear(store);
+    arena_free(&store->arena);
+    free(store->chunks);
+    store->chunks = NULL;
+    store->chunk_capacity = 0;
+    free(store->prefix.entries);
+    memset(&store->prefix, 0, sizeof(store->prefix));
+    free(store->detectors.events);
+    memset(&store->detectors, 0, sizeof(store->detectors));
+    for (int p = 0; p < PERIOD_COUNT; p++) {
+        free(store->rollups.levels[p].buckets);
+    }
+    memset(&store->rollups, 0, sizeof(store->rollups));
+}
+
+int store_reserve_chunks(RecordStore *store, int chunk_count) {
+    if (chunk_count <= store->chunk_capacity) {
+        return 1;
+    }
+    int capacity = store->chunk_capacity ? store->chunk_capacity : 16;
+    while (capacity < chunk_count) capacity *= 2;
+
+    RecordChunk *chunks = realloc(store->chunks, (size_t)capacity * sizeof(RecordChunk));
+    if (!chunks) {
+        return 0;
+    }
+    store->chunks = chunks;
+    store->chunk_capacity = capacity;
+    return 1;
+}
+
+// Carve one chunk's columns out of a single arena allocation
+int chunk_alloc(Arena *arena, RecordChunk *chunk) {
+    size_t column_bytes = RECORD_CHUNK_SIZE * sizeof(int);
+    size_t bytes = (VITAL_COUNT + 1) * column_bytes;
+
+    unsigned char *base = arena_alloc(arena, bytes + SIMD_ALIGNMENT);
+    if (!base) {
+        return 0;
+    }
+    base += (SIMD_ALIGNMENT - (uintptr_t)base % SIMD_ALIGNMENT) % SIMD_ALIGNMENT;
+
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        chunk->vitals[v] = base + v * column_bytes;
+    }
+    chunk->day = (int *)(base + VITAL_COUNT * column_bytes);
+    chunk->owned = 1;
+    return 1;
+}
+
+// Return the chunk that holds slot store->count, creating it or making a
+// private copy of a read-only (mapped) chunk as needed
+RecordChunk *store_tail_chunk(RecordStore *store) {
+    int index = store->count >> RECORD_CHUNK_SHIFT;
+
+    if (index == store->chunk_count) {
+        // Only the chunk table grows; records themselves are never moved
+        if (!store_reserve_chunks(store, store->chunk_count + 1) ||
+            !chunk_alloc(&store->arena, &store->chunks[index])) {
+            return NULL;
+        }
+        store->chunk_count++;
+    } else if (!store->chunks[index].owned) {
+        RecordChunk copy;
+        int used = store->count & RECORD_CHUNK_MASK;
+        if (!chunk_alloc(&store->arena, &copy)) {
+            return NULL;
+        }
+        memcpy(copy.day, store->chunks[index].day, (size_t)used * sizeof(int));
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            memcpy(copy.vitals[v], store->chunks[index].vitals[v], (size_t)used * sizeof(int));
+        }
+        store->chunks[index] = copy;
+    }
+    return &store->chunks[index];
+}
+
+int store_append(RecordStore *store, const HealthRecord *record) {
+    RecordChunk *chunk = store_tail_chunk(store);
+    if (!chunk) {
+        return 0;
+    }
+
+    int i = store->count & RECORD_CHUNK_MASK;
+    chunk->day[i] = record->day;
+    ((int *)chunk->vitals[VITAL_HEART_RATE])[i] = record->heart_rate;
+    ((int *)chunk->vitals[VITAL_SYSTOLIC])[i] = record->systolic_bp;
+    ((int *)chunk->vitals[VITAL_DIASTOLIC])[i] = record->diastolic_bp;
+    ((int *)chunk->vitals[VITAL_BLOOD_SUGAR])[i] = record->blood_sugar;
+    ((float *)chunk->vitals[VITAL_TEMPERATURE])[i] = record->temperature;
+    ((int *)chunk->vitals[VITAL_OXYGEN])[i] = record->oxygen_level;
+    ((int *)chunk->vitals[VITAL_STEPS])[i] = record->steps;
+    store->count++;
+    if (!store_update_indexes(store)) {
+        // Forget the record everywhere: the prefix index drops its last
+        // entry, the others are rebuilt from scratch on their next update
+        store->count--;
+        if (store->prefix.count > store->count) store->prefix.count = store->count;
+        if (store->detectors.count > store->count) store->detectors.count = 0;
+        if (store->rollups.count > store->count) store->rollups.count = 0;
+        return 0;
+    }
+    store->version++;
+    return 1;
+}
+
+void store_get(const RecordStore *store, int index, HealthRecord *record) {
+    const RecordChunk *chunk = &store->chunks[index >> RECORD_CHUNK_SHIFT];
+    int i = index & RECORD_CHUNK_MASK;
+
+    record->day = chunk->day[i];
+    record->heart_rate = ((const int *)chunk->vitals[VITAL_HEART_RATE])[i];
+    record->systolic_bp = ((const int *)chunk->vitals[VITAL_SYSTOLIC])[i];
+    record->diastolic_bp = ((const int *)chunk->vitals[VITAL_DIASTOLIC])[i];
+    record->blood_sugar = ((const int *)chunk->vitals[VITAL_BLOOD_SUGAR])[i];
+    record->temperature = ((const float *)chunk->vitals[VITAL_TEMPERATURE])[i];
+    record->oxygen_level = ((const int *)chunk->vitals[VITAL_OXYGEN])[i];
+    record->steps = ((const int *)chunk->vitals[VITAL_STEPS])[i];
+}
+
+// Number of valid rows in chunk c
+int store_chunk_rows(const RecordStore *store, int c) {
+    int remaining = store->count - c * RECORD_CHUNK_SIZE;
+    return (remaining < RECORD_CHUNK_SIZE) ? remaining : RECORD_CHUNK_SIZE;
+}
+
+// Append every record of src to dst, copying column blocks
+int store_append_all(RecordStore *dst, const RecordStore *src) {
+    int copied = 0;
+    while (copied < src->count) {
+        RecordChunk *chunk = store_tail_chunk(dst);
+        if (!chunk) {
+            return 0;
+        }
+
+        int offset = dst->count & RECORD_CHUNK_MASK;
+        int src_offset = copied & RECORD_CHUNK_MASK;
+        int n = src->count - copied;
+        if (n > RECORD_CHUNK_SIZE - offset) n = RECORD_CHUNK_SIZE - offset;
+        if (n > RECORD_CHUNK_SIZE - src_offset) n = RECORD_CHUNK_SIZE - src_offset;
+
+        const RecordChunk *from = &src->chunks[copied >> RECORD_CHUNK_SHIFT];
+        memcpy(chunk->day + offset, from->day + src_offset, (size_t)n * sizeof(int));
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            memcpy((int *)chunk->vitals[v] + offset,
+                   (const int *)from->vitals[v] + src_offset, (size_t)n * sizeof(int));
+        }
+        dst->count += n;
+        dst->version++;
+        copied += n;
+    }
+    return store_update_indexes(dst);
+}
+
+// Adopt a mapped .shm dataset: chunks point straight into its columns, so
+// no record is copied. Takes ownership of the mapping.
+int store_attach_shm(RecordStore *store, ShmDataset *dataset) {
+    store_clear(store);
+
+    int chunk_count = (dataset->count + RECORD_CHUNK_SIZE - 1) >> RECORD_CHUNK_SHIFT;
+    if (!store_reserve_chunks(store, chunk_count)) {
+        shm_close_dataset(dataset);
+        return 0;
+    }
+
+    for (int c = 0; c < chunk_count; c++) {
+        size_t first = (size_t)c * RECORD_CHUNK_SIZE;
+        RecordChunk *chunk = &store->chunks[c];
+        chunk->day = (int *)dataset->day + first;
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            chunk->vitals[v] = (int *)dataset->vitals[v] + first;
+        }
+        chunk->owned = 0;
+    }
+
+    store->chunk_count = chunk_count;
+    store->count = dataset->count;
+    store->version++;
+    store->backing = dataset->file;
+    dataset->file.data = NULL;
+    dataset->count = 0;
+    return store_update_indexes(store);
+}
+
+int store_day(const RecordStore *store, int index) {
+    return store->chunks[index >> RECORD_CHUNK_SHIFT].day[index & RECORD_CHUNK_MASK];
+}
+
+// Sort key for store_sort_by_day; the record index keeps the sort stable
+typedef struct {
+    int day;
+    int index;
+} DayKey;
+
+static int compare_day_keys(const void *a, const void *b) {
+    const DayKey *x = a, *y = b;
+    if (x->day != y->day) return (x->day < y->day) ? -1 : 1;
+    return (x->index < y->index) ? -1 : (x->index > y->index);
+}
+
+// Put the records in date order, keeping file order within a day. The
+// loaders call this, so a date range is always one run of records.
+// Already-sorted stores (the usual case) cost one pass over the day column.
+// Returns 0 if memory ran out; the store is then left as it was.
+int store_sort_by_day(RecordStore *store) {
+    int count = store->count;
+    int sorted = 1;
+    for (int c = 0; sorted && c < store->chunk_count; c++) {
+        const int *day = store->chunks[c].day;
+        int n = store_chunk_rows(store, c);
+        if (c > 0 && day[0] < store->chunks[c - 1].day[RECORD_CHUNK_SIZE - 1]) sorted = 0;
+        for (int i = 1; sorted && i < n; i++) {
+            if (day[i] < day[i - 1]) sorted = 0;
+        }
+    }
+    if (sorted) {
+        return 1;
+    }
+
+    DayKey *keys = malloc((size_t)count * sizeof(DayKey));
+    if (!keys) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        keys[i].day = store_day(store, i);
+        keys[i].index = i;
+    }
+    qsort(keys, (size_t)count, sizeof(DayKey), compare_day_keys);
+
+    RecordStore ordered;
+    store_init(&ordered);
+    ordered.prefix.enabled = store->prefix.enabled;
+    ordered.detectors.enabled = store->detectors.enabled;
+    ordered.rollups.enabled = store->rollups.enabled;
+    int ok = store_reserve_chunks(&ordered, store->chunk_count);
+    for (int i = 0; ok && i < count; i++) {
+        HealthRecord record;
+        store_get(store, keys[i].index, &record);
+        ok = store_append(&ordered, &record);
+    }
+    free(keys);
+
+    if (!ok) {
+        store_free(&ordered);
+        return 0;
+    }
+    // Every record may have moved, so this counts as a rewrite
+    ordered.version = store->version + 1;
+    ordered.rewritten = ordered.version;
+    store_free(store);
+    *store = ordered;
+    return 1;
+}
+
+// First record at or after day (strict = 0), or after it (strict = 1)
+static int day_bound(const RecordStore *store, int day, int strict) {
+    int low = 0, high = store->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        int value = store_day(store, mid);
+        if (value < day || (strict && value == day)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Records dated from_day..to_day (inclusive) are [*first, *last).
+// Two binary searches over the sorted day column.
+void store_find_days(const RecordStore *store, int from_day, int to_day, int *first, int *last) {
+    *first = day_bound(store, from_day, 0);
+    *last = day_bound(store, to_day, 1);
+    if (*last < *first) *last = *first;
+}
+
+// Add record in date order, after the records of its day. One dated before
+// the last record rebuilds the store around it aside and swaps it in, so
+// if memory runs out (returns 0) the store is left as it was.
+int store_insert(RecordStore *store, const HealthRecord *record) {
+    if (store->count == 0 || record->day >= store_day(store, store->count - 1)) {
+        return store_append(store, record);
+    }
+    int at = day_bound(store, record->day, 1);
+
+    RecordStore ordered;
+    store_init(&ordered);
+    ordered.prefix.enabled = store->prefix.enabled;
+    ordered.detectors.enabled = store->detectors.enabled;
+    ordered.rollups.enabled = store->rollups.enabled;
+    int ok = store_reserve_chunks(&ordered, (store->count >> RECORD_CHUNK_SHIFT) + 1);
+    for (int i = 0; ok && i <= store->count; i++) {
+        if (i == at) ok = store_append(&ordered, record);
+        if (ok && i < store->count) {
+            HealthRecord next;
+            store_get(store, i, &next);
+            ok = store_append(&ordered, &next);
+        }
+    }
+    if (!ok) {
+        store_free(&ordered);
+        return 0;
+    }
+    // Records after it moved, so this counts as a rewrite
+    ordered.version = store->version + 1;
+    ordered.rewritten = ordered.version;
+    store_free(store);
+    *store = ordered;
+    return 1;
+}
+
+// Rows of chunk c that fall in [first, last); *offset is the first of them
+int store_chunk_span(const RecordStore *store, int c, int first, int last, int *offset) {
+    int begin = c << RECORD_CHUNK_SHIFT;
+    int end = begin + store_chunk_rows(store, c);
+    if (begin < first) begin = first;
+    if (end > last) end = last;
+    *offset = begin & RECORD_CHUNK_MASK;
+    return (end > begin) ? end - begin : 0;
+}
+
+// Switch the prefix index on and build it over the records already stored.
+// From then on every append extends it, so loads build it in their one pass.
+int store_enable_prefix(RecordStore *store) {
+    store->prefix.enabled = 1;
+    if (!store_update_prefix(store)) {
+        free(store->prefix.entries);
+        memset(&store->prefix, 0, sizeof(store->prefix));
+        return 0;
+    }
+    return 1;
+}
+
+// Extend the prefix index over the records appended since its last update;
+// O(1) per record. Returns 0 if memory ran out.
+int store_update_prefix(RecordStore *store) {
+    PrefixIndex *prefix = &store->prefix;
+    if (!prefix->enabled || prefix->count == store->count) {
+        return 1;
+    }
+
+    if (store->count >= prefix->capacity) {
+        int capacity = prefix->capacity ? prefix->capacity : 1024;
+        while (capacity <= store->count) capacity *= 2;
+        PrefixEntry *entries = realloc(prefix->entries, (size_t)capacity * sizeof(PrefixEntry));
+        if (!entries) {
+            return 0;
+        }
+        prefix->entries = entries;
+        prefix->capacity = capacity;
+    }
+
+    if (prefix->count == 0) {
+        const RecordChunk *chunk = &store->chunks[0];
+        memset(&prefix->entries[0], 0, sizeof(PrefixEntry));
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            prefix->shift[v] = (v == VITAL_TEMPERATURE) ? ((const float *)chunk->vitals[v])[0]
+                                                       : ((const int *)chunk->vitals[v])[0];
+        }
+    }
+
+    for (int i = prefix->count; i < store->count; i++) {
+        const RecordChunk *chunk = &store->chunks[i >> RECORD_CHUNK_SHIFT];
+        const PrefixEntry *from = &prefix->entries[i];
+        PrefixEntry *to = &prefix->entries[i + 1];
+        int k = i & RECORD_CHUNK_MASK;
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            double value = (v == VITAL_TEMPERATURE) ? ((const float *)chunk->vitals[v])[k]
+                                                   : ((const int *)chunk->vitals[v])[k];
+            value -= prefix->shift[v];
+            to->sum[v] = from->sum[v] + value;
+            to->sum_sq[v] = from->sum_sq[v] + value * value;
+        }
+    }
+    prefix->count = store->count;
+    return 1;
+}
+
+// Memory held by the prefix index
+size_t store_prefix_bytes(const RecordStore *store) {
+    return (size_t)store->prefix.capacity * sizeof(PrefixEntry);
+}
+
+// Mean and variance (same definition as summary_stddev) of one vital over
+// records [first, last), in O(1). Returns 0 if the prefix index is off or
+// the range is empty.
+int store_range_moments(const RecordStore *store, int first, int last, Vital vital,
+                        double *mean, double *variance) {
+    const PrefixIndex *prefix = &store->prefix;
+    if (!prefix->enabled || first >= last || last > prefix->count) {
+        return 0;
+    }
+    double n = last - first;
+    double sum = prefix->entries[last].sum[vital] - prefix->entries[first].sum[vital];
+    double sum_sq = prefix->entries[last].sum_sq[vital] - prefix->entries[first].sum_sq[vital];
+    double shifted_mean = sum / n;
+    double spread = sum_sq / n - shifted_mean * shifted_mean;
+
+    *mean = prefix->shift[vital] + shifted_mean;
+    *variance = (spread > 0) ? spread : 0.0;
+    return 1;
+}
+
+// Switch the detectors on and run them over the records already stored.
+// From then on every append updates them, until store_clear(). Returns 0
+// (detectors off) if memory ran out.
+int store_enable_detectors(RecordStore *store) {
+    if (store->detectors.enabled) {
+        return 1; // every append has kept them up to date
+    }
+    // The pass over the stored records is analysis work; --profile counts it there
+    double started = profile_start();
+    store->detectors.enabled = 1;
+    int ok = store_update_detectors(store);
+    profile_stop(STAGE_ANALYSIS, started);
+    if (!ok) {
+        free(store->detectors.events);
+        memset(&store->detectors, 0, sizeof(store->detectors));
+        return 0;
+    }
+    return 1;
+}
+
+static int rule_matches(const Rule *rule, double value) {
+    switch (rule->op) {
+        case RULE_ABOVE: return value > rule->threshold;
+        case RULE_AT_LEAST: return value >= rule->threshold;
+        case RULE_BELOW: return value < rule->threshold;
+        default: return value <= rule->threshold;
+    }
+}
+
+// Most severe record rule of the active table that flags value; 0 if none
+static int reading_severity(Vital vital, double value) {
+    int severity = 0;
+    for (int k = 0; k < active_rules.record_rule_count[vital]; k++) {
+        const Rule *rule = &active_rules.rules[active_rules.record_rules[vital][k]];
+        if (rule->severity > severity && rule_matches(rule, value)) {
+            severity = rule->severity;
+        }
+    }
+    return severity;
+}
+
+// Per vital: the smallest step of a reading, which floors the spread of
+// the recent readings, and the smallest distance from their mean that
+// makes a sudden change, so a very steady vital does not alarm on an
+// ordinary reading
+static const double detector_resolution[VITAL_COUNT] = { 1, 1, 1, 1, 0.1, 1, 1 };
+static const double detector_min_gap[VITAL_COUNT] = { 25, 25, 20, 50, 2.0, 4, 5000 };
+
+// Feed one reading to a vital's detectors; O(1). Writes the alarms raised
+// (at most one per detector) to events and returns how many there are.
+// An alarm on a reading no record rule flags is at most Medium: the
+// detectors say the reading is unusual for the patient, not that it is
+// dangerous.
+static int detector_step(VitalDetector *d, Vital vital, double x, DetectorEvent *events) {
+    int raised = 0;
+    double sigma = sqrt(d->variance);
+    double resolution = detector_resolution[vital];
+
+    // Quiet until a full window of readings has been seen
+    if (d->seen >= ZSCORE_WINDOW && sigma > 0) {
+        // Rolling z-score: how far x is from the recent readings
+        double mean = d->recent_sum / ZSCORE_WINDOW;
+        double spread = d->recent_sum_sq / ZSCORE_WINDOW - mean * mean;
+        if (spread < resolution * resolution) spread = resolution * resolution;
+        double gap = x - mean;
+        if (gap * gap >= ZSCORE_LIMIT * ZSCORE_LIMIT * spread && fabs(gap) >= detector_min_gap[vital]) {
+            events[raised].detector = DETECTOR_ZSCORE;
+            events[raised].score = (float)(gap / sqrt(spread));
+            raised++;
+        }
+
+        // EWMA and CUSUM look for shifts, so a single spike only counts
+        // DETECT_CLIP standard deviations
+        double clipped = x;
+        if (clipped > d->baseline + DETECT_CLIP * sigma) clipped = d->baseline + DETECT_CLIP * sigma;
+        if (clipped < d->baseline - DETECT_CLIP * sigma) clipped = d->baseline - DETECT_CLIP * sigma;
+
+        double ewma_sigma = sigma * sqrt(EWMA_LAMBDA / (2.0 - EWMA_LAMBDA));
+        d->ewma += EWMA_LAMBDA * (clipped - d->ewma);
+        double distance = (d->ewma - d->baseline) / ewma_sigma;
+        int out = fabs(distance) > EWMA_LIMIT;
+        if (out && !d->ewma_out) {
+            events[raised].detector = DETECTOR_EWMA;
+            events[raised].score = (float)distance;
+            raised++;
+        }
+        d->ewma_out = out;
+
+        d->cusum_high += clipped - d->baseline - CUSUM_SLACK * sigma;
+        d->cusum_low += d->baseline - clipped - CUSUM_SLACK * sigma;
+        if (d->cusum_high < 0) d->cusum_high = 0;
+        if (d->cusum_low < 0) d->cusum_low = 0;
+        if (d->cusum_high > CUSUM_LIMIT * sigma || d->cusum_low > CUSUM_LIMIT * sigma) {
+            events[raised].detector = DETECTOR_CUSUM;
+            events[raised].score = (float)((d->cusum_high > d->cusum_low ? d->cusum_high : -d->cusum_low) / sigma);
+            raised++;
+            d->cusum_high = 0;
+            d->cusum_low = 0;
+        }
+
+        // Sudden changes are High (Critical from ZSCORE_CRITICAL) and shifts
+        // Medium only on readings a record rule flags; otherwise one step less
+        int flagged = raised > 0 && reading_severity(vital, x) > 0;
+        for (int e = 0; e < raised; e++) {
+            if (events[e].detector == DETECTOR_ZSCORE) {
+                events[e].severity = !flagged ? 2 : (fabsf(events[e].score) >= ZSCORE_CRITICAL) ? 4 : 3;
+            } else {
+                events[e].severity = flagged ? 2 : 1;
+            }
+        }
+        x = clipped;
+    } else if (d->seen == 0) {
+        d->baseline = x;
+        d->ewma = x;
+    } else {
+        d->ewma += EWMA_LAMBDA * (x - d->ewma);
+    }
+
+    // Baseline: the plain running mean and variance at first, then an
+    // exponentially weighted one that follows slow drift
+    d->seen++;
+    double weight = (d->seen * DETECT_BASELINE < 1.0) ? 1.0 / (double)d->seen : DETECT_BASELINE;
+    double delta = x - d->baseline;
+    d->baseline += weight * delta;
+    d->variance = (1.0 - weight) * (d->variance + weight * delta * delta);
+    return raised;
+}
+
+// Remember a raw reading in the recent-readings ring; the sums are
+// recomputed once per lap so rounding never builds up
+static void detector_remember(VitalDetector *d, double x) {
+    double old = d->recent[d->recent_next];
+    d->recent[d->recent_next] = x;
+    if (++d->recent_next == ZSCORE_WINDOW) {
+        d->recent_next = 0;
+        d->recent_sum = 0;
+        d->recent_sum_sq = 0;
+        for (int k = 0; k < ZSCORE_WINDOW; k++) {
+            d->recent_sum += d->recent[k];
+            d->recent_sum_sq += d->recent[k] * d->recent[k];
+        }
+    } else {
+        d->recent_sum += x - old;
+        d->recent_sum_sq += x * x - old * old;
+    }
+}
+
+// Run every vital's detectors on record i; writes the alarms raised to
+// events (room for DETECTOR_COUNT * VITAL_COUNT) and returns how many
+static int detector_record(VitalDetector *vitals, const RecordStore *store, int i, DetectorEvent *events) {
+    const RecordChunk *chunk = &store->chunks[i >> RECORD_CHUNK_SHIFT];
+    int k = i & RECORD_CHUNK_MASK;
+    int count = 0;
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        double value = (v == VITAL_TEMPERATURE) ? ((const float *)chunk->vitals[v])[k]
+                                               : ((const int *)chunk->vitals[v])[k];
+        int raised = detector_step(&vitals[v], (Vital)v, value, &events[count]);
+        for (int e = count; e < count + raised; e++) {
+            events[e].record = i;
+            events[e].vital = (uint8_t)v;
+            events[e].padding = 0;
+            events[e].value = (float)value;
+        }
+        count += raised;
+        detector_remember(&vitals[v], value);
+    }
+    return count;
+}
+
+// Count hits alarms of event's detector and vital; event stands for the
+// strongest of them (highest severity, then largest |score|)
+static void detector_tally_event(DetectorTally *tally, const DetectorEvent *event, int hits) {
+    DetectorEvent *best = &tally->strongest[event->detector][event->vital];
+    int *seen = &tally->hits[event->detector][event->vital];
+    if (*seen == 0 || event->severity > best->severity ||
+        (event->severity == best->severity && fabsf(event->score) >= fabsf(best->score))) {
+        *best = *event;
+    }
+    *seen += hits;
+}
+
+// Run the detectors over the records appended since their last update;
+// O(1) per record. Returns 0 if memory ran out.
+int store_update_detectors(RecordStore *store) {
+    DetectorSet *set = &store->detectors;
+    if (!set->enabled || set->count == store->count) {
+        return 1;
+    }
+    if (set->count == 0) {
+        memset(set->vitals, 0, sizeof(set->vitals));
+        memset(&set->total, 0, sizeof(set->total));
+        set->event_count = 0;
+    }
+
+    for (int i = set->count; i < store->count; i++) {
+        // Until the ring is full size it must not wrap: room for every
+        // alarm one record can raise
+        if (set->event_capacity < DETECTOR_RING &&
+            set->event_count + DETECTOR_COUNT * VITAL_COUNT > set->event_capacity) {
+            int capacity = set->event_capacity ? set->event_capacity * 2 : 256;
+            if (capacity > DETECTOR_RING) capacity = DETECTOR_RING;
+            DetectorEvent *events = realloc(set->events, (size_t)capacity * sizeof(DetectorEvent));
+            if (!events) {
+                set->count = i;
+                return 0;
+            }
+            set->events = events;
+            set->event_capacity = capacity;
+        }
+
+        DetectorEvent raised[DETECTOR_COUNT * VITAL_COUNT];
+        int count = detector_record(set->vitals, store, i, raised);
+        for (int e = 0; e < count; e++) {
+            detector_tally_event(&set->total, &raised[e], 1);
+            set->events[set->event_count++ % set->event_capacity] = raised[e];
+        }
+    }
+    set->count = store->count;
+    return 1;
+}
+
+// Alarm n of the store, n from event_count minus the alarms the ring holds
+static const DetectorEvent *detector_event(const DetectorSet *set, long long n) {
+    return &set->events[n % set->event_capacity];
+}
+
+// Switch the rollups on and build them over the records already stored.
+// From then on every append updates them, so loads build them in their one pass.
+int store_enable_rollups(RecordStore *store) {
+    store->rollups.enabled = 1;
+    if (!store_update_rollups(store)) {
+        for (int p = 0; p < PERIOD_COUNT; p++) {
+            free(store->rollups.levels[p].buckets);
+        }
+        memset(&store->rollups, 0, sizeof(store->rollups));
+        return 0;
+    }
+    return 1;
+}
+
+// Add the records appended since the last update to the last bucket of
+// each level, opening a bucket when a record starts a new period; O(1) per
+// record. Returns 0 if memory ran out.
+int store_update_rollups(RecordStore *store) {
+    RollupSet *set = &store->rollups;
+    if (!set->enabled || set->count == store->count) {
+        return 1;
+    }
+    if (set->count == 0) {
+        for (int p = 0; p < PERIOD_COUNT; p++) {
+            set->levels[p].count = 0;
+        }
+    }
+
+    for (int i = set->count; i < store->count; i++) {
+        const RecordChunk *chunk = &store->chunks[i >> RECORD_CHUNK_SHIFT];
+        int k = i & RECORD_CHUNK_MASK;
+        int day = chunk->day[k];
+
+        // Make room in every level first, so a failure leaves them all as they were
+        for (int p = 0; p < PERIOD_COUNT; p++) {
+            RollupLevel *level = &set->levels[p];
+            if (level->count == level->capacity) {
+                int capacity = level->capacity ? level->capacity * 2 : 64;
+                RollupBucket *buckets = realloc(level->buckets, (size_t)capacity * sizeof(RollupBucket));
+                if (!buckets) {
+                    set->count = i;
+                    return 0;
+                }
+                level->buckets = buckets;
+                level->capacity = capacity;
+            }
+        }
+
+        float values[VITAL_COUNT];
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            values[v] = (v == VITAL_TEMPERATURE) ? ((const float *)chunk->vitals[v])[k]
+                                                : (float)((const int *)chunk->vitals[v])[k];
+        }
+
+        for (int p = 0; p < PERIOD_COUNT; p++) {
+            RollupLevel *level = &set->levels[p];
+            RollupBucket *bucket = level->count ? &level->buckets[level->count - 1] : NULL;
+            if (!bucket || day < bucket->start_day || day >= bucket->end_day) {
+                bucket = &level->buckets[level->count++];
+                period_bounds((Period)p, day, &bucket->start_day, &bucket->end_day);
+                bucket->first = i;
+                bucket->count = 0;
+                for (int v = 0; v < VITAL_COUNT; v++) {
+                    bucket->min[v] = values[v];
+                    bucket->max[v] = values[v];
+                    bucket->sum[v] = 0;
+                }
+            }
+            bucket->count++;
+            for (int v = 0; v < VITAL_COUNT; v++) {
+                if (values[v] < bucket->min[v]) bucket->min[v] = values[v];
+                if (values[v] > bucket->max[v]) bucket->max[v] = values[v];
+                bucket->sum[v] += values[v];
+            }
+        }
+    }
+    set->count = store->count;
+    return 1;
+}
+
+// Bring every enabled index up to date with the store. Returns 0 if memory
+// ran out.
+int store_update_indexes(RecordStore *store) {
+    return store_update_prefix(store) && store_update_detectors(store) &&
+           store_update_rollups(store);
+}
+
+// Memory held by the rollups
+size_t store_rollup_bytes(const RecordStore *store) {
+    size_t bytes = 0;
+    for (int p = 0; p < PERIOD_COUNT; p++) {
+        bytes += (size_t)store->rollups.levels[p].capacity * sizeof(RollupBucket);
+    }
+    return bytes;
+}
+
+// Memory held by the store: arena blocks, chunk table, indexes, detector
+// ring and any mapped .shm file
+size_t store_memory(const RecordStore *store) {
+    return store->arena.total_bytes + (size_t)store->chunk_capacity * sizeof(RecordChunk) +
+           store_prefix_bytes(store) + store_rollup_bytes(store) +
+           (size_t)store->detectors.event_capacity * sizeof(DetectorEvent) + store->backing.size;
+}
+
+// Calendar period [*start, *end) that holds day
+void period_bounds(Period period, int day, int *start, int *end) {
+    if (period == PERIOD_DAY) {
+        *start = day;
+        *end = day + 1;
+    } else if (period == PERIOD_WEEK) {
+        // 1970-01-01 was a Thursday, three days after a Monday
+        int weekday = ((day + 3) % 7 + 7) % 7;
+        *start = day - weekday;
+        *end = *start + 7;
+    } else {
+        int year, month, mday;
+        civil_from_days(day, &year, &month, &mday);
+        *start = day - (mday - 1);
+        *end = (month == 12) ? days_from_civil(year + 1, 1, 1) : days_from_civil(year, month + 1, 1);
+    }
+}
+
+// Buckets of one level with records dated from_day..to_day are
+// [*first, *last); periods that straddle either end are included whole
+void store_find_periods(const RecordStore *store, Period period, int from_day, int to_day,
+                        int *first, int *last) {
+    const RollupLevel *level = &store->rollups.levels[period];
+    int low = 0, high = level->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (level->buckets[mid].end_day <= from_day) low = mid + 1;
+        else high = mid;
+    }
+    *first = low;
+    high = level->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (level->buckets[mid].start_day <= to_day) low = mid + 1;
+        else high = mid;
+    }
+    *last = low;
+}
+
+const char *vital_name(Vital vital) {
+    static const char *names[VITAL_COUNT] = {
+        "Heart Rate", "Systolic BP", "Diastolic BP", "Blood Sugar",
+        "Temperature", "Oxygen Level", "Steps"
+    };
+    return names[vital];
+}
+
+void summary_init(ColumnSummary *summary) {
+    summary->count = 0;
+    summary->sum = 0;
+    summary->sum_sq = 0;
+    summary->min = INFINITY;
+    summary->max = -INFINITY;
+}
+
+// Fold one kernel block result into a running summary
+void summary_add_block(ColumnSummary *summary, int n, double sum, double sum_sq, double min, double max) {
+    if (n <= 0) {
+        return;
+    }
+    summary->count += n;
+    summary->sum += sum;
+    summary->sum_sq += sum_sq;
+    if (min < summary->min) summary->min = min;
+    if (max > summary->max) summary->max = max;
+}
+
+double summary_mean(const ColumnSummary *summary) {
+    return summary->count ? summary->sum / summary->count : 0.0;
+}
+
+// Population standard deviation
+double summary_stddev(const ColumnSummary *summary) {
+    if (summary->count == 0) {
+        return 0.0;
+    }
+    double mean = summary->sum / summary->count;
+    double variance = summary->sum_sq / summary->count - mean * mean;
+    return (variance > 0) ? sqrt(variance) : 0.0;
+}
+
+// Column kernels: sum, sum of squares, min and max in one pass. Sums are
+// kept in double, which is exact for integer vitals up to 2^53.
+void summarize_ints_scalar(const int *values, int n, ColumnSummary *summary) {
+    double sum = 0, sum_sq = 0;
+    int lo = INT_MAX, hi = INT_MIN;
+    for (int i = 0; i < n; i++) {
+        double x = values[i];
+        sum += x;
+        sum_sq += x * x;
+        if (values[i] < lo) lo = values[i];
+        if (values[i] > hi) hi = values[i];
+    }
+    summary_add_block(summary, n, sum, sum_sq, lo, hi);
+}
+
+void summarize_floats_scalar(const float *values, int n, ColumnSummary *summary) {
+    double sum = 0, sum_sq = 0;
+    float lo = INFINITY, hi = -INFINITY;
+    for (int i = 0; i < n; i++) {
+        double x = values[i];
+        sum += x;
+        sum_sq += x * x;
+        if (values[i] < lo) lo = values[i];
+        if (values[i] > hi) hi = values[i];
+    }
+    summary_add_block(summary, n, sum, sum_sq, lo, hi);
+}
+
+#ifdef HM_X86_SIMD
+void summarize_ints_sse2(const int *values, int n, ColumnSummary *summary) {
+    __m128i lo = _mm_set1_epi32(INT_MAX), hi = _mm_set1_epi32(INT_MIN);
+    __m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+    __m128d sq0 = _mm_setzero_pd(), sq1 = _mm_setzero_pd();
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(values + i));
+        __m128i lt = _mm_cmplt_epi32(v, lo);
+        __m128i gt = _mm_cmpgt_epi32(v, hi);
+        lo = _mm_or_si128(_mm_and_si128(lt, v), _mm_andnot_si128(lt, lo));
+        hi = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, hi));
+
+        __m128d a = _mm_cvtepi32_pd(v);
+        __m128d b = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum0 = _mm_add_pd(sum0, a);
+        sum1 = _mm_add_pd(sum1, b);
+        sq0 = _mm_add_pd(sq0, _mm_mul_pd(a, a));
+        sq1 = _mm_add_pd(sq1, _mm_mul_pd(b, b));
+    }
+
+    int lanes_lo[4], lanes_hi[4];
+    double sums[2], squares[2];
+    _mm_storeu_si128((__m128i *)lanes_lo, lo);
+    _mm_storeu_si128((__m128i *)lanes_hi, hi);
+    _mm_storeu_pd(sums, _mm_add_pd(sum0, sum1));
+    _mm_storeu_pd(squares, _mm_add_pd(sq0, sq1));
+
+    int min = INT_MAX, max = INT_MIN;
+    for (int k = 0; k < 4; k++) {
+        if (lanes_lo[k] < min) min = lanes_lo[k];
+        if (lanes_hi[k] > max) max = lanes_hi[k];
+    }
+    summary_add_block(summary, i, sums[0] + sums[1], squares[0] + squares[1], min, max);
+    summarize_ints_scalar(values + i, n - i, summary);
+}
+
+void summarize_floats_sse2(const float *values, int n, ColumnSummary *summary) {
+    __m128 lo = _mm_set1_ps(INFINITY), hi = _mm_set1_ps(-INFINITY);
+    __m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+    __m128d sq0 = _mm_setzero_pd(), sq1 = _mm_setzero_pd();
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(values + i);
+        lo = _mm_min_ps(lo, v);
+        hi = _mm_max_ps(hi, v);
+
+        __m128d a = _mm_cvtps_pd(v);
+        __m128d b = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+        sum0 = _mm_add_pd(sum0, a);
+        sum1 = _mm_add_pd(sum1, b);
+        sq0 = _mm_add_pd(sq0, _mm_mul_pd(a, a));
+        sq1 = _mm_add_pd(sq1, _mm_mul_pd(b, b));
+    }
+
+    float lanes_lo[4], lanes_hi[4];
+    double sums[2], squares[2];
+    _mm_storeu_ps(lanes_lo, lo);
+    _mm_storeu_ps(lanes_hi, hi);
+    _mm_storeu_pd(sums, _mm_add_pd(sum0, sum1));
+    _mm_storeu_pd(squares, _mm_add_pd(sq0, sq1));
+
+    float min = INFINITY, max = -INFINITY;
+    for (int k = 0; k < 4; k++) {
+        if (lanes_lo[k] < min) min = lanes_lo[k];
+        if (lanes_hi[k] > max) max = lanes_hi[k];
+    }
+    summary_add_block(summary, i, sums[0] + sums[1], squares[0] + squares[1], min, max);
+    summarize_floats_scalar(values + i, n - i, summary);
+}
+
+__attribute__((target("avx2")))
+void summarize_ints_avx2(const int *values, int n, ColumnSummary *summary) {
+    __m256i lo = _mm256_set1_epi32(INT_MAX), hi = _mm256_set1_epi32(INT_MIN);
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d sq0 = _mm256_setzero_pd(), sq1 = _mm256_setzero_pd();
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(values + i));
+        lo = _mm256_min_epi32(lo, v);
+        hi = _mm256_max_epi32(hi, v);
+
+        __m256d a = _mm256_cvtepi32_pd(_mm256_castsi256_si128(v));
+        __m256d b = _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1));
+        sum0 = _mm256_add_pd(sum0, a);
+        sum1 = _mm256_add_pd(sum1, b);
+        sq0 = _mm256_add_pd(sq0, _mm256_mul_pd(a, a));
+        sq1 = _mm256_add_pd(sq1, _mm256_mul_pd(b, b));
+    }
+
+    int lanes_lo[8], lanes_hi[8];
+    double sums[4], squares[4];
+    _mm256_storeu_si256((__m256i *)lanes_lo, lo);
+    _mm256_storeu_si256((__m256i *)lanes_hi, hi);
+    _mm256_storeu_pd(sums, _mm256_add_pd(sum0, sum1));
+    _mm256_storeu_pd(squares, _mm256_add_pd(sq0, sq1));
+
+    int min = INT_MAX, max = INT_MIN;
+    for (int k = 0; k < 8; k++) {
+        if (lanes_lo[k] < min) min = lanes_lo[k];
+        if (lanes_hi[k] > max) max = lanes_hi[k];
+    }
+    summary_add_block(summary, i, (sums[0] + sums[1]) + (sums[2] + sums[3]),
+                      (squares[0] + squares[1]) + (squares[2] + squares[3]), min, max);
+    summarize_ints_scalar(values + i, n - i, summary);
+}
+
+__attribute__((target("avx2")))
+void summarize_floats_avx2(const float *values, int n, ColumnSummary *summary) {
+    __m256 lo = _mm256_set1_ps(INFINITY), hi = _mm256_set1_ps(-INFINITY);
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d sq0 = _mm256_setzero_pd(), sq1 = _mm256_setzero_pd();
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(values + i);
+        lo = _mm256_min_ps(lo, v);
+        hi = _mm256_max_ps(hi, v);
+
+        __m256d a = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+        __m256d b = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+        sum0 = _mm256_add_pd(sum0, a);
+        sum1 = _mm256_add_pd(sum1, b);
+        sq0 = _mm256_add_pd(sq0, _mm256_mul_pd(a, a));
+        sq1 = _mm256_add_pd(sq1, _mm256_mul_pd(b, b));
+    }
+
+    float lanes_lo[8], lanes_hi[8];
+    double sums[4], squares[4];
+    _mm256_storeu_ps(lanes_lo, lo);
+    _mm256_storeu_ps(lanes_hi, hi);
+    _mm256_storeu_pd(sums, _mm256_add_pd(sum0, sum1));
+    _mm256_storeu_pd(squares, _mm256_add_pd(sq0, sq1));
+
+    float min = INFINITY, max = -INFINITY;
+    for (int k = 0; k < 8; k++) {
+        if (lanes_lo[k] < min) min = lanes_lo[k];
+        if (lanes_hi[k] > max) max = lanes_hi[k];
+    }
+    summary_add_block(summary, i, (sums[0] + sums[1]) + (sums[2] + sums[3]),
+                      (squares[0] + squares[1]) + (squares[2] + squares[3]), min, max);
+    summarize_floats_scalar(values + i, n - i, summary);
+}
+#endif
+
+// Summarize n values of one vital column, using the widest SIMD the CPU has
+void summarize_column(const void *column, Vital vital, int n, ColumnSummary *summary) {
+    int is_float = (vital == VITAL_TEMPERATURE);
+#ifdef HM_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        if (is_float) summarize_floats_avx2(column, n, summary);
+        else summarize_ints_avx2(column, n, summary);
+        return;
+    }
+    if (is_float) summarize_floats_sse2(column, n, summary);
+    else summarize_ints_sse2(column, n, summary);
+#else
+    if (is_float) summarize_floats_scalar(column, n, summary);
+    else summarize_ints_scalar(column, n, summary);
+#endif
+}
+
+void sketch_init(QuantileSketch *sketch) {
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        VitalSketch *vital = &sketch->vitals[v];
+        vital->count = 0;
+        vital->min = INFINITY;
+        vital->max = -INFINITY;
+        memset(vital->bins, 0, sizeof(vital->bins));
+    }
+}
+
+// Bin of a (scaled, integer) value; negative values go to bin 0
+static inline int sketch_bin(long long value) {
+    if (value < 2 * SKETCH_HALF) {
+        return (value < 0) ? 0 : (int)value;
+    }
+    if (value >= (1LL << SKETCH_MAX_LOG)) {
+        return SKETCH_BINS - 1;
+    }
+    // The exponent of the exactly converted double is floor(log2(value))
+    double x = (double)value;
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int exponent = (int)(bits >> 52) - 1023;
+    int shift = exponent - (SKETCH_PRECISION - 1);
+    return 2 * SKETCH_HALF + (exponent - SKETCH_PRECISION) * SKETCH_HALF +
+           (int)(value >> shift) - SKETCH_HALF;
+}
+
+// Middle of the values bin k holds, in scaled units
+static double sketch_bin_middle(int k) {
+    if (k < 2 * SKETCH_HALF) {
+        return k;
+    }
+    int j = k - 2 * SKETCH_HALF;
+    int shift = j / SKETCH_HALF + 1;
+    long long low = (long long)(j % SKETCH_HALF + SKETCH_HALF) << shift;
+    return (double)low + ((1LL << shift) - 1) / 2.0;
+}
+
+// Add n values of one vital column to the bins. The column kernels
+// already find the minimum and maximum, so min and max are left to the
+// caller (see calculate_statistics_sketch).
+void sketch_add_column(VitalSketch *sketch, const void *column, Vital vital, int n) {
+    if (vital == VITAL_TEMPERATURE) {
+        const float *values = column;
+        for (int i = 0; i < n; i++) {
+            sketch->bins[sketch_bin((long long)((double)values[i] * 10.0 + 0.5))]++;
+        }
+    } else {
+        const int *values = column;
+        for (int i = 0; i < n; i++) {
+            sketch->bins[sketch_bin(values[i])]++;
+        }
+    }
+    sketch->count += (n > 0) ? n : 0;
+}
+
+// Fold src into dst; the result is the sketch of both inputs together.
+// Bins saturate rather than wrap after 2^32 - 1 values.
+void sketch_merge(QuantileSketch *dst, const QuantileSketch *src) {
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        VitalSketch *to = &dst->vitals[v];
+        const VitalSketch *from = &src->vitals[v];
+        if (from->count == 0) {
+            continue;
+        }
+        for (int k = 0; k < SKETCH_BINS; k++) {
+            uint32_t sum = to->bins[k] + from->bins[k];
+            to->bins[k] = (sum < to->bins[k]) ? UINT32_MAX : sum;
+        }
+        to->count += from->count;
+        if (from->min < to->min) to->min = from->min;
+        if (from->max > to->max) to->max = from->max;
+    }
+}
+
+// Estimate of the q-quantile (0 <= q <= 1): the middle of the bin that
+// holds the value of that rank, kept within [min, max]. NAN if empty.
+double sketch_quantile(const VitalSketch *sketch, Vital vital, double q) {
+    if (sketch->count == 0) {
+        return NAN;
+    }
+    double rank = q * (double)(sketch->count - 1);
+    double seen = 0;
+    int k = 0;
+    for (; k < SKETCH_BINS - 1; k++) {
+        seen += sketch->bins[k];
+        if (seen > rank) break;
+    }
+
+    double estimate;
+    if (k == 0) {
+        estimate = sketch->min;
+    } else if (k == SKETCH_BINS - 1) {
+        estimate = sketch->max;
+    } else {
+        estimate = sketch_bin_middle(k) / ((vital == VITAL_TEMPERATURE) ? 10.0 : 1.0);
+    }
+    if (estimate < sketch->min) estimate = sketch->min;
+    if (estimate > sketch->max) estimate = sketch->max;
+    return estimate;
+}
+
+void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--threads N] [--wal FILE]\n", program);
+    fprintf(stderr, "       %s --input FILE [--format csv|txt|shm|shz] [--report OUT]\n", program);
+    fprintf(stderr, "          [--report-format txt|csv|json]\n");
+    fprintf(stderr, "          [--threads N] [--fail-on SEVERITY]\n");
+    fprintf(stderr, "          [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--last-days N]\n");
+    fprintf(stderr, "          [--compare YYYY-MM-DD] [--rollup day|week|month] [--patient ID]\n");
+    fprintf(stderr, "       %s --input-dir DIR --report-dir OUT [--format csv|txt|shm|shz]\n", program);
+    fprintf(stderr, "          [--report-format txt|csv|json] [--threads N] [--fail-on SEVERITY]\n");
+    fprintf(stderr, "       %s --generate N --output FILE [--format csv|txt|shm|shz]\n", program);
+    fprintf(stderr, "          [--seed S] [--anomaly-rate R]\n");
+    fprintf(stderr, "       %s --benchmark N [--repeat R] [--threads N] [--seed S]\n", program);
+    fprintf(stderr, "       %s --stream -|FIFO|unix:PATH [--summary-every SECONDS]\n", program);
+    fprintf(stderr, "          [--fail-on SEVERITY]\n");
+    fprintf(stderr, "       %s --serve unix:PATH|tcp:PORT --input-dir DIR [--format csv|txt|shm|shz]\n", program);
+    fprintf(stderr, "          [--threads N]\n");
+    fprintf(stderr, "Any mode also accepts --profile table|json (written to stderr on exit),\n");
+    fprintf(stderr, "--rules FILE (alert rules; see the README for the format) and --window N\n");
+    fprintf(stderr, "(records per trend window, default %d).\n", TREND_WINDOW);
+    fprintf(stderr, "\nWithout --input the interactive menu is started. Manual records are kept\n");
+    fprintf(stderr, "in a crash-safe log: FILE%s for a loaded FILE, else --wal FILE\n", WAL_SUFFIX);
+    fprintf(stderr, "(default %s).\n", WAL_DEFAULT_FILE);
+    fprintf(stderr, "Batch mode runs load, statistics, analysis and export with no prompts;\n");
+    fprintf(stderr, "--from, --to and --last-days restrict it to a date range; --compare adds\n");
+    fprintf(stderr, "before/after means around a date; --rollup adds per-period averages.\n");
+    fprintf(stderr, "Reports are text, CSV or JSON: from --report-format, else the --report\n");
+    fprintf(stderr, "extension (.csv, .json); --report-format csv|json without --report\n");
+    fprintf(stderr, "prints that format. --patient picks one patient of a CSV whose first\n");
+    fprintf(stderr, "column is %s.\n", PATIENT_ID_COLUMN);
+    fprintf(stderr, "With --input-dir every patient file in DIR is analyzed on N threads;\n");
+    fprintf(stderr, "per-patient reports and summary.txt are written to OUT.\n");
+    fprintf(stderr, "--generate writes N seeded synthetic records with injected anomalies;\n");
+    fprintf(stderr, "--benchmark times every stage on N synthetic records.\n");
+    fprintf(stderr, ".shm files are columnar and mapped as they are; .shz files are the same\n");
+    fprintf(stderr, "columns compressed, decoded on load.\n");
+    fprintf(stderr, "--stream reads CSV records from stdin, a FIFO or a Unix socket as they\n");
+    fprintf(stderr, "arrive and prints alerts at once, plus a summary every SECONDS and at the end.\n");
+    fprintf(stderr, "--serve keeps every patient in DIR in memory and answers stats, alerts,\n");
+    fprintf(stderr, "score, trends and date-range queries on a local socket until SIGINT/SIGTERM.\n");
+    fprintf(stderr, "Exit codes: 0 ok, 2 usage error, 3 input not loaded, 4 report not written,\n");
+    fprintf(stderr, "            5 an alert reached the --fail-on severity (1-4)\n");
+}
+
+int parse_options(int argc, char *argv[], BatchOptions *options) {
+    options->input = NULL;
+    options->report = NULL;
+    options->input_dir = NULL;
+    options->report_dir = NULL;
+    options->format = FORMAT_AUTO;
+    options->threads = 0;
+    options->fail_on = 0;
+    options->generate = 0;
+    options->output = NULL;
+    options->benchmark = 0;
+    options->seed = 1;
+    options->anomaly_rate = SYNTH_ANOMALY_RATE;
+    options->repeat = BENCH_REPEATS;
+    options->profile = PROFILE_OFF;
+    options->rules = NULL;
+    options->from_day = INT_MIN;
+    options->to_day = INT_MAX;
+    options->last_days = 0;
+    options->compare_day = INT_MIN;
+    options->window = TREND_WINDOW;
+    options->rollup = -1;
+    options->report_format = REPORT_AUTO;
+    options->wal = NULL;
+    options->stream = NULL;
+    options->summary_every = 0;
+    options->serve = NULL;
+    options->patient = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--input") == 0 && value) {
+            options->input = value;
+        } else if (strcmp(arg, "--report") == 0 && value) {
+            options->report = value;
+        } else if (strcmp(arg, "--input-dir") == 0 && value) {
+            options->input_dir = value;
+        } else if (strcmp(arg, "--report-dir") == 0 && value) {
+            options->report_dir = value;
+        } else if (strcmp(arg, "--threads") == 0 && value) {
+            options->threads = atoi(value);
+        } else if (strcmp(arg, "--fail-on") == 0 && value) {
+            options->fail_on = atoi(value);
+            if (options->fail_on < 1 || options->fail_on > 4) return 0;
+        } else if (strcmp(arg, "--generate") == 0 && value) {
+            options->generate = strtoll(value, NULL, 10);
+            if (options->generate <= 0) return 0;
+        } else if (strcmp(arg, "--output") == 0 && value) {
+            options->output = value;
+        } else if (strcmp(arg, "--benchmark") == 0 && value) {
+            options->benchmark = strtoll(value, NULL, 10);
+            if (options->benchmark <= 0 || options->benchmark > INT_MAX) return 0;
+        } else if (strcmp(arg, "--seed") == 0 && value) {
+            options->seed = strtoull(value, NULL, 10);
+        } else if (strcmp(arg, "--anomaly-rate") == 0 && value) {
+            options->anomaly_rate = strtod(value, NULL);
+            if (!(options->anomaly_rate >= 0 && options->anomaly_rate <= 1)) return 0;
+        } else if (strcmp(arg, "--repeat") == 0 && value) {
+            options->repeat = atoi(value);
+            if (options->repeat < 1) return 0;
+        } else if (strcmp(arg, "--stream") == 0 && value) {
+            options->stream = value;
+        } else if (strcmp(arg, "--summary-every") == 0 && value) {
+            options->summary_every = atoi(value);
+            if (options->summary_every < 1) return 0;
+        } else if (strcmp(arg, "--patient") == 0 && value) {
+            options->patient = value;
+        } else if (strcmp(arg, "--serve") == 0 && value) {
+            options->serve = value;
+        } else if (strcmp(arg, "--wal") == 0 && value) {
+            options->wal = value;
+        } else if (strcmp(arg, "--rules") == 0 && value) {
+            options->rules = value;
+        } else if (strcmp(arg, "--from") == 0 && value) {
+            if (!parse_date(value, value + strlen(value), &options->from_day)) return 0;
+        } else if (strcmp(arg, "--to") == 0 && value) {
+            if (!parse_date(value, value + strlen(value), &options->to_day)) return 0;
+        } else if (strcmp(arg, "--last-days") == 0 && value) {
+            options->last_days = atoi(value);
+            if (options->last_days < 1) return 0;
+        } else if (strcmp(arg, "--window") == 0 && value) {
+            options->window = atoi(value);
+            if (options->window < 3) return 0;
+        } else if (strcmp(arg, "--compare") == 0 && value) {
+            if (!parse_date(value, value + strlen(value), &options->compare_day)) return 0;
+        } else if (strcmp(arg, "--report-format") == 0 && value) {
+            if (strcmp(value, "txt") == 0) options->report_format = REPORT_TEXT;
+            else if (strcmp(value, "csv") == 0) options->report_format = REPORT_CSV;
+            else if (strcmp(value, "json") == 0) options->report_format = REPORT_JSON;
+            else return 0;
+        } else if (strcmp(arg, "--rollup") == 0 && value) {
+            if (strcmp(value, "day") == 0) options->rollup = PERIOD_DAY;
+            else if (strcmp(value, "week") == 0) options->rollup = PERIOD_WEEK;
+            else if (strcmp(value, "month") == 0) options->rollup = PERIOD_MONTH;
+            else return 0;
+        } else if (strcmp(arg, "--profile") == 0 && value) {
+            if (strcmp(value, "table") == 0) options->profile = PROFILE_TABLE;
+            else if (strcmp(value, "json") == 0) options->profile = PROFILE_JSON;
+            else return 0;
+        } else if (strcmp(arg, "--format") == 0 && value) {
+            if (strcmp(value, "csv") == 0) options->format = FORMAT_CSV;
+            else if (strcmp(value, "txt") == 0) options->format = FORMAT_TXT;
+            else if (strcmp(value, "shm") == 0) options->format = FORMAT_SHM;
+            else if (strcmp(value, "shz") == 0) options->format = FORMAT_SHZ;
+            else return 0;
+        } else {
+            return 0;
+        }
+        i++;
+    }
+
+    // The modes are exclusive, and the output options only make sense
+    // with their own mode. --serve takes its patients from --input-dir.
+    int modes = (options->input != NULL) + (options->input_dir != NULL) +
+                (options->generate > 0) + (options->benchmark > 0) + (options->stream != NULL);
+    if (modes > 1) return 0;
+    if (options->summary_every && !options->stream) return 0;
+    if (options->wal && modes > 0) return 0;
+    if (options->report && !options->input) return 0;
+    int ranged = options->from_day != INT_MIN || options->to_day != INT_MAX || options->last_days ||
+                 options->compare_day != INT_MIN || options->rollup >= 0;
+    if (ranged && !options->input) return 0;
+    if (options->patient && (!options->input || (options->format != FORMAT_AUTO && options->format != FORMAT_CSV))) {
+        return 0;
+    }
+    if (options->report_format != REPORT_AUTO && ((!options->input && !options->input_dir) || options->serve)) {
+        return 0;
+    }
+    if (options->from_day > options->to_day) return 0;
+    if (options->serve) {
+        if (!options->input_dir || options->report_dir) return 0;
+    } else if (!options->input_dir != !options->report_dir) {
+        return 0;
+    }
+    if (options->report_dir && strcmp(options->input_dir, options->report_dir) == 0) return 0;
+    if (!options->generate != !options->output) return 0;
+    return modes == 1 || options->format == FORMAT_AUTO;
+}
+
+// Load any supported input; FORMAT_AUTO picks the loader from the extension
+int load_data(const char *filename, InputFormat format, RecordStore *store, int threads) {
+    if (format == FORMAT_AUTO) {
+        if (has_extension(filename, ".txt")) format = FORMAT_TXT;
+        else if (has_extension(filename, ".shm")) format = FORMAT_SHM;
+        else if (has_extension(filename, ".shz")) format = FORMAT_SHZ;
+        else format = FORMAT_CSV;
+    }
+
+    switch (format) {
+        case FORMAT_TXT: {
+            int incomplete = 0;
+            int ok = load_txt_data(filename, store, &incomplete);
+            if (incomplete > 0) {
+                fprintf(stderr, "[WARNING] Skipped %d incomplete or malformed record(s).\n", incomplete);
+            }
+            return ok;
+        }
+        case FORMAT_SHM:
+            return load_shm_data(filename, store);
+        case FORMAT_SHZ:
+            return load_shz_data(filename, store);
+        default:
+            return load_csv_data_parallel(filename, store, threads);
+    }
+}
+
+// Non-interactive pipeline: load -> statistics -> analysis -> report
+int run_batch(const BatchOptions *options) {
+    RecordStore store;
+    AlertLog alerts;
+    HealthStats stats;
+    int status = EXIT_OK;
+
+    store_init(&store);
+    // Enabled before loading so the load builds the index in its single pass
+    if (options->compare_day != INT_MIN) {
+        store_enable_prefix(&store);
+    }
+    if (options->rollup >= 0) {
+        store_enable_rollups(&store);
+    }
+
+    if (options->patient) {
+        if (!load_patient_data(options->input, options->patient, &store)) {
+            fprintf(stderr, "[ERROR] No records of patient '%s' in '%s'.\n", options->patient, options->input);
+            store_free(&store);
+            return EXIT_LOAD_FAILED;
+        }
+    } else if (!load_data(options->input, options->format, &store, options->threads)) {
+        fprintf(stderr, "[ERROR] Failed to load data from '%s'.\n", options->input);
+        if (csv_has_patient_column(options->input)) {
+            fprintf(stderr, "[ERROR] '%s' holds several patients - choose one with --patient ID.\n",
+                    options->input);
+        }
+        store_free(&store);
+        return EXIT_LOAD_FAILED;
+    }
+
+    int from_day = options->from_day, to_day = options->to_day;
+    if (options->last_days > 0) {
+        // Records are in date order, so the newest is the last one
+        if (to_day == INT_MAX) to_day = store_day(&store, store.count - 1);
+        long long start = (long long)to_day - (options->last_days - 1);
+        if (start > from_day) from_day = (int)start;
+    }
+
+    calculate_statistics_range(&store, from_day, to_day, &stats);
+    if (stats.record_count == 0) {
+        fprintf(stderr, "[ERROR] No records of '%s' fall in the requested date range.\n", options->input);
+        store_free(&store);
+        return EXIT_LOAD_FAILED;
+    }
+    if (!store_enable_detectors(&store)) {
+        fprintf(stderr, "[WARNING] Out of memory - analyzing without the anomaly detectors.\n");
+    }
+    analyze_health_range(&store, from_day, to_day, stats, &alerts);
+
+    if (options->report) {
+        if (!export_report(stats, &alerts, &store, options->report_format, options->report)) {
+            status = EXIT_EXPORT_FAILED;
+        }
+    } else if (options->report_format == REPORT_CSV || options->report_format == REPORT_JSON) {
+        // Machine-readable report on stdout, for pipelines
+        char storage[OUTPUT_STACK_SIZE];
+        OutputBuffer out;
+        output_init(&out, storage, sizeof(storage));
+        render_report_as(&out, options->report_format, stats, &alerts, &store);
+        if (!output_flush(&out, stdout)) status = EXIT_EXPORT_FAILED;
+        output_free(&out);
+    } else {
+        display_report(stats, &alerts, &store);
+    }
+    if (options->compare_day != INT_MIN) {
+        display_comparison(&store, options->compare_day, from_day, to_day);
+    }
+    if (options->rollup >= 0) {
+        display_rollups(&store, (Period)options->rollup, from_day, to_day);
+    }
+
+    // Every alert counts here, including any the ring had to drop
+    if (status == EXIT_OK && options->fail_on > 0 && alerts.max_severity >= options->fail_on) {
+        status = EXIT_ALERT_THRESHOLD;
+    }
+
+    store_free(&store);
+    return status;
+}
+
+#ifndef _WIN32
+static int compare_patient_names(const void *a, const void *b) {
+    return strcmp(((const PatientJob *)a)->name, ((const PatientJob *)b)->name);
+}
+#endif
+
+// Collect the patient files in dir, sorted by name. Returns the number of
+// jobs (0 if none) or -1 if the directory can't be read.
+int discover_patient_files(const char *dir, InputFormat format, const char *report_dir,
+                           ReportFormat report_format, PatientJob **jobs) {
+    *jobs = NULL;
+#ifndef _WIN32
+    DIR *handle = opendir(dir);
+    if (!handle) {
+        return -1;
+    }
+
+    PatientJob *list = NULL;
+    int count = 0, capacity = 0;
+    struct dirent *entry;
+
+    while ((entry = readdir(handle)) != NULL) {
+        const char *name = entry->d_name;
+        int wanted;
+        switch (format) {
+            case FORMAT_CSV: wanted = has_extension(name, ".csv"); break;
+            case FORMAT_TXT: wanted = has_extension(name, ".txt"); break;
+            case FORMAT_SHM: wanted = has_extension(name, ".shm"); break;
+            case FORMAT_SHZ: wanted = has_extension(name, ".shz"); break;
+            default:
+                wanted = has_extension(name, ".csv") || has_extension(name, ".txt") ||
+                         has_extension(name, ".shm") || has_extension(name, ".shz");
+                break;
+        }
+        if (!wanted || strlen(name) >= MAX_NAME) {
+            continue;
+        }
+
+        if (count == capacity) {
+            int grown_capacity = capacity ? capacity * 2 : 64;
+            PatientJob *grown = realloc(list, (size_t)grown_capacity * sizeof(PatientJob));
+            if (!grown) {
+                break;
+            }
+            list = grown;
+            capacity = grown_capacity;
+        }
+
+        PatientJob *job = &list[count];
+        memset(job, 0, sizeof(*job));
+        strcpy(job->name, name);
+        int in_len = snprintf(job->input, sizeof(job->input), "%s/%s", dir, name);
+        int out_len = snprintf(job->report, sizeof(job->report), "%s/%s.report.%s", report_dir, name,
+                               report_extension(report_format));
+        if (in_len < 0 || in_len >= MAX_PATH_LEN || out_len < 0 || out_len >= MAX_PATH_LEN) {
+            fprintf(stderr, "[WARNING] Skipping '%s': path too long.\n", name);
+            continue;
+        }
+
+        struct stat info;
+        if (stat(job->input, &info) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        job->bytes = (long long)info.st_size;
+        count++;
+    }
+    closedir(handle);
+
+    qsort(list, (size_t)count, sizeof(PatientJob), compare_patient_names);
+    *jobs = list;
+    return count;
+#else
+    (void)format;
+    (void)report_dir;
+    (void)report_format;
+    fprintf(stderr, "[ERROR] Directory batch mode is not supported on this platform ('%s').\n", dir);
+    return -1;
+#endif
+}
+
+// Load, analyze and report one patient using the caller's record store.
+// The patient's quantile sketch is merged into cohort (if not NULL).
+void analyze_patient(PatientJob *job, RecordStore *store, InputFormat format, QuantileSketch *cohort) {
+    AlertLog alerts;
+
+    job->loaded = load_data(job->input, format, store, 1);
+    if (job->loaded) {
+        QuantileSketch *sketch = cohort ? malloc(sizeof(QuantileSketch)) : NULL;
+        calculate_statistics_sketch(store, INT_MIN, INT_MAX, &job->stats, sketch);
+        if (sketch) {
+            sketch_merge(cohort, sketch);
+            free(sketch);
+        }
+        if (!store_enable_detectors(store)) {
+            fprintf(stderr, "[WARNING] Out of memory - '%s' analyzed without the anomaly detectors.\n",
+                    job->input);
+        }
+        analyze_health(store, job->stats, &alerts);
+        job->health_score = calculate_health_score(job->stats);
+        job->alert_count = alerts.emitted;
+        job->max_severity = alerts.max_severity;
+        job->exported = write_report_file(job->stats, &alerts, store, REPORT_AUTO, job->report);
+    }
+
+    // Drop the records but keep an arena block for the next patient
+    store_clear(store);
+}
+
+#ifndef _WIN32
+// A worker's share of the schedule. Slot k holds order[id + k * worker_count],
+// so every worker starts with a mix of large and small files. The owner takes
+// slots from the front (largest first); idle workers steal from the back.
+typedef struct {
+    pthread_mutex_t lock;
+    int head;
+    int tail;
+} JobDeque;
+
+// Schedule entry: a job and its input size
+typedef struct {
+    long long bytes;
+    int job;
+} JobSlot;
+
+typedef struct {
+    PatientJob *jobs;
+    const JobSlot *order; // largest input first
+    JobDeque *deques;
+    int worker_count;
+    int id;
+    InputFormat format;
+    QuantileSketch *cohort; // this worker's patients, merged after the join
+    Profile profile;      // this worker's counters, handed back on exit
+} PatientWorker;
+
+static int deque_take(JobDeque *deque, int from_back) {
+    int slot = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        slot = from_back ? --deque->tail : deque->head++;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return slot;
+}
+
+static void *patient_worker(void *arg) {
+    PatientWorker *worker = arg;
+    RecordStore store; // this thread's record buffer, reused for every patient
+    store_init(&store);
+
+    for (;;) {
+        int owner = worker->id;
+        int slot = deque_take(&worker->deques[owner], 0);
+        // Own queue empty: steal from the others. No work is ever added,
+        // so one full pass that finds nothing means we are done.
+        for (int i = 1; slot < 0 && i < worker->worker_count; i++) {
+            owner = (worker->id + i) % worker->worker_count;
+            slot = deque_take(&worker->deques[owner], 1);
+        }
+        if (slot < 0) {
+            break;
+        }
+        int job = worker->order[owner + slot * worker->worker_count].job;
+        analyze_patient(&worker->jobs[job], &store, worker->format, worker->cohort);
+    }
+
+    store_free(&store);
+    worker->profile = thread_profile;
+    return NULL;
+}
+
+static int compare_job_size(const void *a, const void *b) {
+    long long sa = ((const JobSlot *)a)->bytes, sb = ((const JobSlot *)b)->bytes;
+    return (sa < sb) - (sa > sb);
+}
+#endif
+
+// Analyze every job on a work-stealing pool of threads; the patients'
+// quantile sketches are merged into cohort (if not NULL). Returns the number
+// of workers used.
+int run_patient_pool(PatientJob *jobs, int job_count, InputFormat format, int threads,
+                     QuantileSketch *cohort) {
+    if (threads <= 0) threads = default_thread_count();
+    if (threads > MAX_INGEST_THREADS) threads = MAX_INGEST_THREADS;
+    if (threads > job_count) threads = job_count;
+
+#ifndef _WIN32
+    JobSlot *order = malloc((size_t)job_count * sizeof(JobSlot));
+    // Worker 0 (this thread) merges straight into cohort, the others into
+    // their own sketch so no lock is needed
+    QuantileSketch *partial = (cohort && threads > 1)
+                              ? malloc((size_t)(threads - 1) * sizeof(QuantileSketch)) : NULL;
+    if (threads > 1 && order && (!cohort || partial)) {
+        JobDeque deques[MAX_INGEST_THREADS];
+        PatientWorker workers[MAX_INGEST_THREADS];
+        pthread_t ids[MAX_INGEST_THREADS];
+
+        // Biggest files first so a large one never starts last
+        for (int i = 0; i < job_count; i++) {
+            order[i].bytes = jobs[i].bytes;
+            order[i].job = i;
+        }
+        qsort(order, (size_t)job_count, sizeof(JobSlot), compare_job_size);
+
+        for (int w = 0; w < threads; w++) {
+            pthread_mutex_init(&deques[w].lock, NULL);
+            deques[w].head = 0;
+            deques[w].tail = (job_count - w + threads - 1) / threads;
+            workers[w].jobs = jobs;
+            workers[w].order = order;
+            workers[w].deques = deques;
+            workers[w].worker_count = threads;
+            workers[w].id = w;
+            workers[w].format = format;
+            workers[w].cohort = (w == 0 || !cohort) ? cohort : &partial[w - 1];
+            if (w > 0 && cohort) sketch_init(workers[w].cohort);
+        }
+
+        // The calling thread is worker 0; queues of workers that fail to
+        // start are drained by stealing
+        int started = 1;
+        for (; started < threads; started++) {
+            if (pthread_create(&ids[started], NULL, patient_worker, &workers[started]) != 0) {
+                break;
+            }
+        }
+        patient_worker(&workers[0]);
+        for (int w = 1; w < started; w++) {
+            pthread_join(ids[w], NULL);
+            profile_merge(&workers[w].profile);
+        }
+        // Workers that never started took no jobs, so their sketches are empty
+        for (int w = 1; cohort && w < threads; w++) {
+            sketch_merge(cohort, workers[w].cohort);
+        }
+
+        for (int w = 0; w < threads; w++) {
+            pthread_mutex_destroy(&deques[w].lock);
+        }
+        free(partial);
+        free(order);
+        return started;
+    }
+    free(partial);
+    free(order);
+#endif
+
+    RecordStore store;
+    store_init(&store);
+    for (int i = 0; i < job_count; i++) {
+        analyze_patient(&jobs[i], &store, format, cohort);
+    }
+    store_free(&store);
+    return 1;
+}
+
+// Merged summary: one line per patient plus cohort-wide statistics and,
+// given the merged sketch of every patient, cohort percentiles
+int write_patient_summary(const PatientJob *jobs, int job_count, const QuantileSketch *cohort,
+                          const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return 0;
+    }
+
+    ColumnSummary totals[VITAL_COUNT];
+    int analyzed = 0, severity_counts[5] = {0};
+    long long total_records = 0;
+    char timestamp[32];
+
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        summary_init(&totals[v]);
+    }
+    for (int i = 0; i < job_count; i++) {
+        if (!jobs[i].loaded) continue;
+        analyzed++;
+        total_records += jobs[i].stats.record_count;
+        severity_counts[jobs[i].max_severity]++;
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            const ColumnSummary *s = &jobs[i].stats.vitals[v];
+            summary_add_block(&totals[v], (int)s->count, s->sum, s->sum_sq, s->min, s->max);
+        }
+    }
+
+    format_timestamp(timestamp, sizeof(timestamp));
+    fprintf(file, "============================================================\n");
+    fprintf(file, "        SMART HEALTH MONITOR - MULTI-PATIENT SUMMARY\n");
+    fprintf(file, "============================================================\n");
+    fprintf(file, "Generated: %s\n", timestamp);
+    fprintf(file, "Patients analyzed: %d of %d\n", analyzed, job_count);
+    fprintf(file, "Total records:     %lld\n\n", total_records);
+
+    fprintf(file, "%-30s %8s %6s %7s  %s\n", "PATIENT FILE", "RECORDS", "SCORE", "ALERTS", "WORST");
+    fprintf(file, "------------------------------------------------------------\n");
+    for (int i = 0; i < job_count; i++) {
+        const PatientJob *job = &jobs[i];
+        if (!job->loaded) {
+            fprintf(file, "%-30s FAILED TO LOAD\n", job->name);
+            continue;
+        }
+        fprintf(file, "%-30s %8d %6d %7lld  %s%s\n", job->name, job->stats.record_count,
+                job->health_score, job->alert_count, severity_name(job->max_severity),
+                job->exported ? "" : " (report not written)");
+    }
+    fprintf(file, "\n");
+
+    fprintf(file, "PATIENTS BY WORST ALERT\n");
+    fprintf(file, "------------------------------------------------------------\n");
+    for (int severity = 4; severity >= 0; severity--) {
+        char label[32];
+        snprintf(label, sizeof(label), "%s:", severity_name(severity));
+        fprintf(file, "%-25s%d\n", label, severity_counts[severity]);
+    }
+    fprintf(file, "\n");
+
+    if (analyzed > 0) {
+        fprintf(file, "COHORT STATISTICS (Mean / Min / Max / Std Dev)\n");
+        fprintf(file, "------------------------------------------------------------\n");
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            int decimals = (v == VITAL_TEMPERATURE) ? 1 : 0;
+            char label[32];
+            snprintf(label, sizeof(label), "%s:", vital_name((Vital)v));
+            fprintf(file, "%-25s%.1f / %.*f / %.*f / %.1f\n", label, summary_mean(&totals[v]),
+                    decimals, totals[v].min, decimals, totals[v].max, summary_stddev(&totals[v]));
+        }
+    }
+    if (analyzed > 0 && cohort) {
+        fprintf(file, "\nCOHORT PERCENTILES (P50 / P90 / P99)\n");
+        fprintf(file, "------------------------------------------------------------\n");
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            int decimals = (v == VITAL_TEMPERATURE) ? 1 : 0;
+            double q[QUANTILE_COUNT];
+            char label[32];
+            for (int k = 0; k < QUANTILE_COUNT; k++) {
+                q[k] = sketch_quantile(&cohort->vitals[v], (Vital)v, quantile_levels[k]);
+            }
+            snprintf(label, sizeof(label), "%s:", vital_name((Vital)v));
+            fprintf(file, "%-25s%.*f / %.*f / %.*f\n", label, decimals, q[QUANTILE_P50],
+                    decimals, q[QUANTILE_P90], decimals, q[QUANTILE_P99]);
+        }
+    }
+    fprintf(file, "============================================================\n");
+
+    return fclose(file) == 0;
+}
+
+// Multi-patient pipeline: discover files, analyze them in parallel, then
+// write the merged summary
+int run_patient_batch(const BatchOptions *options) {
+    PatientJob *jobs;
+    char summary_path[MAX_PATH_LEN];
+    int status = EXIT_OK;
+
+    int job_count = discover_patient_files(options->input_dir, options->format, options->report_dir,
+                                           options->report_format, &jobs);
+    if (job_count < 0) {
+        fprintf(stderr, "[ERROR] Cannot read directory '%s'.\n", options->input_dir);
+        return EXIT_LOAD_FAILED;
+    }
+    if (job_count == 0) {
+        fprintf(stderr, "[ERROR] No patient files found in '%s'.\n", options->input_dir);
+        free(jobs);
+        return EXIT_LOAD_FAILED;
+    }
+
+#ifndef _WIN32
+    mkdir(options->report_dir, 0755); // an existing directory is fine
+#endif
+
+    // Percentiles across all patients; left out of the summary if there is no memory
+    QuantileSketch *cohort = malloc(sizeof(QuantileSketch));
+    if (cohort) sketch_init(cohort);
+    int workers = run_patient_pool(jobs, job_count, options->format, options->threads, cohort);
+
+    int failed = 0, unwritten = 0, flagged = 0;
+    for (int i = 0; i < job_count; i++) {
+        if (!jobs[i].loaded) {
+            fprintf(stderr, "[ERROR] Failed to load data from '%s'.\n", jobs[i].input);
+            failed++;
+        } else if (!jobs[i].exported) {
+            fprintf(stderr, "[ERROR] Failed to write report '%s'.\n", jobs[i].report);
+            unwritten++;
+        } else if (options->fail_on > 0 && jobs[i].max_severity >= options->fail_on) {
+            flagged++;
+        }
+    }
+
+    snprintf(summary_path, sizeof(summary_path), "%s/summary.txt", options->report_dir);
+    if (!write_patient_summary(jobs, job_count, cohort, summary_path)) {
+        fprintf(stderr, "[ERROR] Failed to write summary '%s'.\n", summary_path);
+        unwritten++;
+    }
+
+    printf("[SUCCESS] Analyzed %d of %d patient file(s) on %d thread(s); summary in '%s'\n",
+           job_count - failed, job_count, workers, summary_path);
+
+    if (failed > 0) status = EXIT_LOAD_FAILED;
+    else if (unwritten > 0) status = EXIT_EXPORT_FAILED;
+    else if (flagged > 0) status = EXIT_ALERT_THRESHOLD;
+
+    free(cohort);
+    free(jobs);
+    return status;
+}
+
+void print_line(char c, int length) {
+    char line[256];
+    if (length > (int)sizeof(line) - 1) length = (int)sizeof(line) - 1;
+    memset(line, c, (size_t)length);
+    line[length] = '\n';
+    fwrite(line, 1, (size_t)length + 1, stdout);
+}
+
+void output_init(OutputBuffer *out, char *storage, size_t capacity) {
+    out->data = storage;
+    out->length = 0;
+    out->capacity = capacity;
+    out->owned = 0;
+    out->failed = 0;
+    if (capacity > 0) storage[0] = '\0';
+}
+
+void output_free(OutputBuffer *out) {
+    if (out->owned) {
+        free(out->data);
+    }
+    out->data = NULL;
+    out->length = out->capacity = 0;
+    out->owned = 0;
+}
+
+// Make room for extra more bytes plus the terminator
+static int output_reserve(OutputBuffer *out, size_t extra) {
+    if (out->failed) {
+        return 0;
+    }
+    if (out->length + extra + 1 <= out->capacity) {
+        return 1;
+    }
+    size_t capacity = out->capacity ? out->capacity * 2 : 4096;
+    while (capacity < out->length + extra + 1) capacity *= 2;
+
+    char *data = out->owned ? realloc(out->data, capacity) : malloc(capacity);
+    if (!data) {
+        out->failed = 1;
+        return 0;
+    }
+    if (!out->owned && out->length > 0) {
+        memcpy(data, out->data, out->length + 1);
+    }
+    out->data = data;
+    out->capacity = capacity;
+    out->owned = 1;
+    return 1;
+}
+
+void output_printf(OutputBuffer *out, const char *format, ...) {
+    va_list args;
+    if (out->failed) {
+        return;
+    }
+    va_start(args, format);
+    int n = vsnprintf(out->data + out->length, out->capacity - out->length, format, args);
+    va_end(args);
+    if (n < 0) {
+        out->failed = 1;
+        return;
+    }
+    if ((size_t)n >= out->capacity - out->length) {
+        // Did not fit: grow and format again
+        if (!output_reserve(out, (size_t)n)) {
+            return;
+        }
+        va_start(args, format);
+        vsnprintf(out->data + out->length, out->capacity - out->length, format, args);
+        va_end(args);
+    }
+    out->length += (size_t)n;
+}
+
+void output_line(OutputBuffer *out, char c, int length) {
+    if (!output_reserve(out, (size_t)length + 1)) {
+        return;
+    }
+    memset(out->data + out->length, c, (size_t)length);
+    out->length += (size_t)length;
+    out->data[out->length++] = '\n';
+    out->data[out->length] = '\0';
+}
+
+// length bytes of data as they are
+void output_append(OutputBuffer *out, const char *data, size_t length) {
+    if (!output_reserve(out, length)) {
+        return;
+    }
+    memcpy(out->data + out->length, data, length);
+    out->length += length;
+    out->data[out->length] = '\0';
+}
+
+// text as one CSV field, quoted when it holds a separator, quote or newline.
+// Text between quotes is copied in one piece, each quote doubled.
+void output_csv_field(OutputBuffer *out, const char *text) {
+    if (!strpbrk(text, ",\"\r\n")) {
+        output_append(out, text, strlen(text));
+        return;
+    }
+    output_append(out, "\"", 1);
+    for (const char *p = text;;) {
+        const char *quote = strchr(p, '"');
+        size_t run = quote ? (size_t)(quote - p) + 1 : strlen(p);
+        output_append(out, p, run);
+        if (!quote) break;
+        output_append(out, "\"", 1);
+        p = quote + 1;
+    }
+    output_append(out, "\"", 1);
+}
+
+// text as a quoted JSON string; runs of plain characters are copied in one
+// piece and only the escapes are formatted
+void output_json_string(OutputBuffer *out, const char *text) {
+    output_append(out, "\"", 1);
+    const unsigned char *p = (const unsigned char *)text;
+    while (*p) {
+        const unsigned char *run = p;
+        while (*p >= 0x20 && *p != '"' && *p != '\\') p++;
+        output_append(out, (const char *)run, (size_t)(p - run));
+        if (!*p) break;
+        if (*p == '"' || *p == '\\') output_printf(out, "\\%c", *p);
+        else if (*p == '\n') output_append(out, "\\n", 2);
+        else output_printf(out, "\\u%04x", *p);
+        p++;
+    }
+    output_append(out, "\"", 1);
+}
+
+#ifndef _WIN32
+// write() all of data, resuming after interrupts and short writes
+static int write_all(int fd, const void *data, size_t size) {
+    const char *p = data;
+    for (size_t done = 0; done < size;) {
+        ssize_t n = write(fd, p + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return 0;
+        }
+        done += (size_t)n;
+    }
+    return 1;
+}
+#endif
+
+// Write the text to file in one call and empty the buffer. Returns 0 if the
+// text is incomplete or could not be written.
+int output_flush(OutputBuffer *out, FILE *file) {
+    int ok = !out->failed;
+    fflush(file); // anything printed before comes first
+#ifndef _WIN32
+    ok = write_all(fileno(file), out->data, out->length) && ok;
+#else
+    ok = ok && fwrite(out->data, 1, out->length, file) == out->length && fflush(file) == 0;
+#endif
+    out->length = 0;
+    out->failed = 0;
+    if (out->capacity > 0) out->data[0] = '\0';
+    return ok;
+}
+
+// Replace filename with the text, written in one call
+int output_save(OutputBuffer *out, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return 0;
+    }
+    int ok = output_flush(out, file);
+    return (fclose(file) == 0) && ok;
+}
+
+void print_banner() {
+    printf("\n");
+    print_line('=', 60);
+    printf("                                                            \n");
+    printf("                   SMART HEALTH MONITOR                     \n");
+    printf("                                                            \n");
+    printf("          Your Personal Health Analytics System            \n");
+    printf("                                                            \n");
+    print_line('=', 60);
+    printf("\n");
+}
+
+void print_menu() {
+    printf("\n");
+    print_line('-', 45);
+    printf("               MAIN MENU                     \n");
+    print_line('-', 45);
+    printf(" 1. Load CSV Health Data                    \n");
+    printf(" 2. Load TXT Health Data                    \n");
+    printf(" 3. Analyze Health & Get Report             \n");
+    printf(" 4. View Health Trends                      \n");
+    printf(" 5. Get Personalized Advice                 \n");
+    printf(" 6. Add Manual Health Record                \n");
+    printf(" 7. Export Report                           \n");
+    printf(" 8. Generate Sample Data File               \n");
+    printf(" 9. Exit                                    \n");
+    printf("10. Load Binary (.shm/.shz) Health Data     \n");
+    printf("11. Convert CSV/TXT to Binary (.shm/.shz)   \n");
+    printf("12. Compare Before/After a Date             \n");
+    printf("13. Period Summary (Daily/Weekly/Monthly)   \n");
+    print_line('-', 45);
+}
+
+int load_csv_data(const char *filename, RecordStore *store) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return 0;
+    }
+
+    char line[MAX_LINE];
+    double started = profile_start();
+    long long rows = 0, rejected = 0, bytes = 0;
+    store_clear(store);
+
+    // Skip header line
+    if (!fgets(line, sizeof(line), file)) {
+        fclose(file);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        bytes += (long long)strlen(line);
+        // Remove trailing newline/carriage return
+        line[strcspn(line, "\r\n")] = 0;
+
+        // Skip empty lines
+        if (strlen(line) < 5) continue;
+
+        // Initialize record with safe defaults
+        HealthRecord record = {0};
+        char date[DATE_LEN];
+
+        int items = sscanf(line, "%19[^,],%d,%d,%d,%d,%f,%d,%d",
+               date,
+               &record.heart_rate,
+               &record.systolic_bp,
+               &record.diastolic_bp,
+               &record.blood_sugar,
+               &record.temperature,
+               &record.oxygen_level,
+               &record.steps);
+        if (items >= 1 && !parse_date(date, date + strlen(date), &record.day)) {
+            items = 0;
+        }
+
+        // Only store if we successfully read at least 5 fields
+        rows++;
+        if (items < 5) {
+            rejected++;
+        } else if (!store_append(store, &record)) {
+            break;
+        }
+    }
+
+    fclose(file);
+    if (!store_sort_by_day(store)) store_clear(store);
+    profile_rows(rows, rejected, bytes);
+    profile_stop(STAGE_CSV_LOAD, started);
+    return (store->count > 0);
+}
+
+int map_file(const char *filename, MappedFile *file) {
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            posix_madvise(data, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+            close(fd);
+            file->data = data;
+            file->size = (size_t)info.st_size;
+            file->mapped = 1;
+            return 1;
+        }
+    }
+    close(fd);
+#endif
+
+    // Fallback: read the whole file into one heap buffer
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return 0;
+    }
+
+    size_t capacity = 1 << 16, size = 0;
+    char *data = malloc(capacity);
+    while (data) {
+        size += fread(data + size, 1, capacity - size, fp);
+        if (size < capacity) {
+            break;
+        }
+        char *grown = realloc(data, capacity * 2);
+        if (!grown) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = grown;
+        capacity *= 2;
+    }
+    fclose(fp);
+
+    if (!data) {
+        return 0;
+    }
+    file->data = data;
+    file->size = size;
+    return 1;
+}
+
+void unmap_file(MappedFile *file) {
+#ifndef _WIN32
+    if (file->mapped) {
+        munmap((void *)file->data, file->size);
+    } else
+#endif
+    {
+        free((void *)file->data);
+    }
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+}
+
+// Same rules as sscanf's %d: optional leading whitespace and sign, then digits
+int parse_int_field(const char **cursor, const char *end, int *value) {
+    const char *p = *cursor;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\v' || *p == '\f')) p++;
+
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    const char *digits = p;
+    unsigned int result = 0;
+    while (p < end && (unsigned)(*p - '0') <= 9) {
+        result = result * 10 + (unsigned)(*p - '0');
+        p++;
+    }
+    if (p == digits) {
+        return 0;
+    }
+
+    *value = negative ? (int)(0u - result) : (int)result;
+    *cursor = p;
+    return 1;
+}
+
+// Same result as sscanf's %f. Plain decimals with at most 7 significant digits
+// and 10 fraction digits are exact as one double division rounded to float;
+// anything else (exponents, inf/nan, long mantissas) goes through strtof.
+int parse_float_field(const char **cursor, const char *end, float *value) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+    };
+    const char *start = *cursor;
+    const char *p = start;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\v' || *p == '\f')) p++;
+
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    unsigned int mantissa = 0;
+    int digits = 0, frac_digits = 0;
+    while (p < end && (unsigned)(*p - '0') <= 9) {
+        if (mantissa < (1u << 24)) mantissa = mantissa * 10 + (unsigned)(*p - '0');
+        p++;
+        digits++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && (unsigned)(*p - '0') <= 9) {
+            if (mantissa < (1u << 24)) mantissa = mantissa * 10 + (unsigned)(*p - '0');
+            p++;
+            digits++;
+            frac_digits++;
+        }
+    }
+
+    int simple = digits > 0 && mantissa < (1u << 24) && frac_digits <= 10 &&
+                 !(p < end && (*p == 'e' || *p == 'E' || *p == 'x' || *p == 'X'));
+    if (simple) {
+        float result = (float)((double)mantissa / pow10[frac_digits]);
+        *value = negative ? -result : result;
+        *cursor = p;
+        return 1;
+    }
+
+    // Slow path on a bounded, NUL-terminated copy of the field
+    char buffer[64];
+    size_t length = 0;
+    while (start + length < end && start[length] != ',' && length < sizeof(buffer) - 1) {
+        buffer[length] = start[length];
+        length++;
+    }
+    buffer[length] = 0;
+
+    char *stop;
+    float result = strtof(buffer, &stop);
+    if (stop == buffer) {
+        return 0;
+    }
+    *value = result;
+    *cursor = start + (stop - buffer);
+    return 1;
+}
+
+// Parse one CSV line (without its line terminator) exactly like
+// sscanf(line, "%19[^,],%d,%d,%d,%d,%f,%d,%d", ...) followed by parse_date()
+// on the first field. Returns fields matched; 0 if the date is not valid.
+int parse_csv_row(const char *line, const char *end, HealthRecord *record) {
+    const char *p = line;
+    while (p < end && *p != ',') p++;
+
+    if (!parse_date(line, p, &record->day)) {
+        return 0;
+    }
+
+    int *int_fields[] = {
+        &record->heart_rate, &record->systolic_bp, &record->diastolic_bp,
+        &record->blood_sugar
+    };
+    int items = 1;
+    for (int i = 0; i < 4; i++) {
+        if (p >= end || *p != ',') return items;
+        p++;
+        if (!parse_int_field(&p, end, int_fields[i])) return items;
+        items++;
+    }
+
+    if (p >= end || *p != ',') return items;
+    p++;
+    if (!parse_float_field(&p, end, &record->temperature)) return items;
+    items++;
+
+    if (p >= end || *p != ',') return items;
+    p++;
+    if (!parse_int_field(&p, end, &record->oxygen_level)) return items;
+    items++;
+
+    if (p >= end || *p != ',') return items;
+    p++;
+    if (!parse_int_field(&p, end, &record->steps)) return items;
+    return items + 1;
+}
+
+// Zero-copy CSV loader: scans the mapped file in place, no fgets/sscanf.
+// Produces the same records as load_csv_data().
+int load_csv_data_mapped(const char *filename, RecordStore *store) {
+    MappedFile file;
+    double started = profile_start();
+    long long rejected = 0;
+    if (!map_file(filename, &file)) {
+        return 0;
+    }
+
+    store_clear(store);
+
+    const char *p = file.data;
+    const char *end = file.data + file.size;
+
+    // Skip header line
+    if (p == end) {
+        unmap_file(&file);
+        return 0;
+    }
+    const char *newline = memchr(p, '\n', (size_t)(end - p));
+    p = newline ? newline + 1 : end;
+
+    // Out of memory: a partial load is no load
+    if (!parse_csv_range(p, end, store, &rejected) || !store_sort_by_day(store)) store_clear(store);
+    profile_rows(store->count + rejected, rejected, (long long)file.size);
+    unmap_file(&file);
+    profile_stop(STAGE_CSV_LOAD, started);
+    return (store->count > 0);
+}
+
+// Parse whole lines in [p, end); *rejected counts non-empty lines that
+// didn't parse. Returns 0 if memory ran out.
+int parse_csv_range(const char *p, const char *end, RecordStore *store, long long *rejected) {
+    long long bad = 0;
+    int ok = 1;
+
+    while (p < end) {
+        const char *newline = memchr(p, '\n', (size_t)(end - p));
+        const char *line_end = newline ? newline : end;
+        const char *next = newline ? newline + 1 : end;
+
+        // Line content stops at the first carriage return
+        const char *cr = memchr(p, '\r', (size_t)(line_end - p));
+        if (cr) line_end = cr;
+
+        // Skip empty lines
+        if (line_end - p >= 5) {
+            HealthRecord record = {0};
+            if (parse_csv_row(p, line_end, &record) < 5) {
+                bad++;
+            } else if (!store_append(store, &record)) {
+                ok = 0;
+                break;
+            }
+        }
+        p = next;
+    }
+
+    *rejected += bad;
+    return ok;
+}
+
+int default_thread_count() {
+#ifndef _WIN32
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0) {
+        return (cpus > MAX_INGEST_THREADS) ? MAX_INGEST_THREADS : (int)cpus;
+    }
+#endif
+    return 1;
+}
+
+#ifndef _WIN32
+// One worker's share of a parallel CSV load
+typedef struct {
+    const char *begin;
+    const char *end;
+    RecordStore store;
+    long long rejected;
+    int ok;
+} CsvIngestTask;
+
+static void *csv_ingest_worker(void *arg) {
+    CsvIngestTask *task = arg;
+    task->ok = parse_csv_range(task->begin, task->end, &task->store, &task->rejected);
+    return NULL;
+}
+#endif
+
+// Parallel CSV loader: splits the body into newline-aligned byte ranges,
+// parses each on its own thread into a private store, then concatenates
+// the stores in file order. Same records as load_csv_data().
+int load_csv_data_parallel(const char *filename, RecordStore *store, int threads) {
+    MappedFile file;
+    double started = profile_start();
+    long long rejected = 0;
+    if (!map_file(filename, &file)) {
+        return 0;
+    }
+
+    store_clear(store);
+
+    const char *p = file.data;
+    const char *end = file.data + file.size;
+
+    // Skip header line
+    if (p == end) {
+        unmap_file(&file);
+        return 0;
+    }
+    const char *newline = memchr(p, '\n', (size_t)(end - p));
+    p = newline ? newline + 1 : end;
+
+    if (threads <= 0) threads = default_thread_count();
+    if (threads > MAX_INGEST_THREADS) threads = MAX_INGEST_THREADS;
+    size_t body = (size_t)(end - p);
+    if ((size_t)threads > body / MIN_BYTES_PER_THREAD) {
+        threads = (int)(body / MIN_BYTES_PER_THREAD);
+    }
+
+#ifndef _WIN32
+    if (threads > 1) {
+        CsvIngestTask tasks[MAX_INGEST_THREADS];
+        pthread_t ids[MAX_INGEST_THREADS];
+
+        // Range boundaries always sit just after a newline
+        const char *begin = p;
+        for (int t = 0; t < threads; t++) {
+            const char *split = end;
+            if (t < threads - 1) {
+                split = p + body / threads * (t + 1);
+                if (split < begin) split = begin;
+                const char *nl = memchr(split, '\n', (size_t)(end - split));
+                split = nl ? nl + 1 : end;
+            }
+            tasks[t].begin = begin;
+            tasks[t].end = split;
+            tasks[t].ok = 0;
+            tasks[t].rejected = 0;
+            store_init(&tasks[t].store);
+            begin = split;
+        }
+
+        int launched = 0;
+        for (; launched < threads; launched++) {
+            if (pthread_create(&ids[launched], NULL, csv_ingest_worker, &tasks[launched]) != 0) {
+                break;
+            }
+        }
+        // Any range we failed to hand to a thread is parsed here
+        for (int t = launched; t < threads; t++) {
+            csv_ingest_worker(&tasks[t]);
+        }
+
+        int ok = 1;
+        for (int t = 0; t < threads; t++) {
+            if (t < launched) {
+                pthread_join(ids[t], NULL);
+            }
+            // Once a worker ran out of memory the load fails as a whole
+            if (ok) {
+                ok = store_append_all(store, &tasks[t].store) && tasks[t].ok;
+            }
+            rejected += tasks[t].rejected;
+            store_free(&tasks[t].store);
+        }
+
+        if (!ok || !store_sort_by_day(store)) store_clear(store);
+        profile_rows(store->count + rejected, rejected, (long long)file.size);
+        unmap_file(&file);
+        profile_stop(STAGE_CSV_LOAD, started);
+        return (store->count > 0);
+    }
+#endif
+
+    // Out of memory: a partial load is no load
+    if (!parse_csv_range(p, end, store, &rejected) || !store_sort_by_day(store)) store_clear(store);
+    profile_rows(store->count + rejected, rejected, (long long)file.size);
+    unmap_file(&file);
+    profile_stop(STAGE_CSV_LOAD, started);
+    return (store->count > 0);
+}
+
+// Identify a line's key from its first characters; *value is set past the colon
+TxtKey match_txt_key(const char *p, const char *end, const char **value) {
+    static const struct { const char *text; size_t length; TxtKey key; } keys[] = {
+        { "Date:", 5, TXT_KEY_DATE },
+        { "Heart Rate:", 11, TXT_KEY_HEART_RATE },
+        { "Blood Pressure:", 15, TXT_KEY_BLOOD_PRESSURE },
+        { "Blood Sugar:", 12, TXT_KEY_BLOOD_SUGAR },
+        { "Temperature:", 12, TXT_KEY_TEMPERATURE },
+        { "Oxygen Level:", 13, TXT_KEY_OXYGEN },
+        { "Steps:", 6, TXT_KEY_STEPS }
+    };
+
+    int candidate;
+    switch (*p) {
+        case 'D': candidate = 0; break;
+        case 'H': candidate = 1; break;
+        case 'B': candidate = (end - p > 6 && p[6] == 'S') ? 3 : 2; break;
+        case 'T': candidate = 4; break;
+        case 'O': candidate = 5; break;
+        case 'S': candidate = 6; break;
+        default: return TXT_KEY_NONE;
+    }
+
+    size_t length = keys[candidate].length;
+    if ((size_t)(end - p) < length || memcmp(p, keys[candidate].text, length) != 0) {
+        return TXT_KEY_NONE;
+    }
+    *value = p + length;
+    return keys[candidate].key;
+}
+
+// Parse the value of one TXT field into record. Returns 0 if it is malformed.
+int parse_txt_value(TxtKey key, const char *p, const char *end, HealthRecord *record) {
+    switch (key) {
+        case TXT_KEY_DATE: {
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+            const char *stop = p;
+            while (stop < end && *stop != ' ' && *stop != '\t') stop++;
+            return parse_date(p, stop, &record->day);
+        }
+        case TXT_KEY_HEART_RATE:
+            return parse_int_field(&p, end, &record->heart_rate);
+        case TXT_KEY_BLOOD_PRESSURE:
+            if (!parse_int_field(&p, end, &record->systolic_bp)) return 0;
+            if (p >= end || *p != '/') return 0;
+            p++;
+            return parse_int_field(&p, end, &record->diastolic_bp);
+        case TXT_KEY_BLOOD_SUGAR:
+            return parse_int_field(&p, end, &record->blood_sugar);
+        case TXT_KEY_TEMPERATURE:
+            return parse_float_field(&p, end, &record->temperature);
+        case TXT_KEY_OXYGEN:
+            return parse_int_field(&p, end, &record->oxygen_level);
+        case TXT_KEY_STEPS:
+            return parse_int_field(&p, end, &record->steps);
+        default:
+            return 0;
+    }
+}
+
+// Streaming single-pass TXT loader. Input is read in TXT_BUFFER_SIZE blocks,
+// so file size is not limited by memory. Each line is dispatched on its key
+// once and its value parsed in place. A record is committed only once all 7
+// fields were read in order; incomplete or malformed blocks are counted in
+// *incomplete (may be NULL).
+int load_txt_data(const char *filename, RecordStore *store, int *incomplete) {
+    double started = profile_start();
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    char *buffer = malloc(TXT_BUFFER_SIZE);
+    if (!buffer) {
+        fclose(file);
+        return 0;
+    }
+
+    store_clear(store);
+
+    HealthRecord current = {0};
+    int fields_read = 0;   // fields of the current record read so far (state 0-7)
+    int in_block = 0;      // a Date: line opened a record that is not committed yet
+    int skip_rest = 0;     // discarding the tail of a line longer than the buffer
+    int dropped = 0;
+    int out_of_memory = 0;
+    size_t filled = 0;
+    long long bytes = 0;
+    int eof = 0;
+
+    while (!out_of_memory && (!eof || filled > 0)) {
+        if (!eof) {
+            size_t got = fread(buffer + filled, 1, TXT_BUFFER_SIZE - filled, file);
+            filled += got;
+            bytes += (long long)got;
+            if (filled < TXT_BUFFER_SIZE) eof = 1;
+        }
+
+        const char *p = buffer;
+        const char *end = buffer + filled;
+
+        while (p < end) {
+            const char *newline = memchr(p, '\n', (size_t)(end - p));
+            if (!newline && !eof && p != buffer) {
+                break; // partial line: refill behind it
+            }
+            const char *line_end = newline ? newline : end;
+            const char *next = newline ? newline + 1 : end;
+
+            if (skip_rest) {
+                skip_rest = (newline == NULL);
+                p = next;
+                continue;
+            }
+            if (!newline && !eof) {
+                skip_rest = 1;
+            }
+
+            // Line content stops at the first carriage return
+            const char *cr = memchr(p, '\r', (size_t)(line_end - p));
+            if (cr) line_end = cr;
+            while (p < line_end && (*p == ' ' || *p == '\t')) p++;
+
+            const char *value = NULL;
+            TxtKey key = (p < line_end) ? match_txt_key(p, line_end, &value) : TXT_KEY_NONE;
+
+            if (key == TXT_KEY_DATE) {
+                if (in_block) {
+                    if (fields_read == 7) {
+                        if (!store_append(store, &current)) {
+                            in_block = 0;
+                            out_of_memory = 1;
+                            break;
+                        }
+                    } else {
+                        dropped++;
+                    }
+                }
+                memset(&current, 0, sizeof(current));
+                in_block = 1;
+                fields_read = parse_txt_value(key, value, line_end, &current) ? 1 : 0;
+            } else if (key != TXT_KEY_NONE && fields_read >= (int)key - 1) {
+                // Fields must arrive in order; a malformed value stalls the record
+                if (parse_txt_value(key, value, line_end, &current)) {
+                    fields_read = (int)key;
+                }
+            }
+            p = next;
+        }
+
+        // Move the unconsumed partial line to the front of the buffer
+        filled = (size_t)(end - p);
+        if (filled > 0 && p != buffer) memmove(buffer, p, filled);
+    }
+
+    // Don't forget the last record
+    if (in_block) {
+        if (fields_read == 7) {
+            if (!store_append(store, &current)) out_of_memory = 1;
+        } else {
+            dropped++;
+        }
+    }
+
+    if (incomplete) *incomplete = dropped;
+    free(buffer);
+    fclose(file);
+    // Out of memory: a partial load is no load
+    if (out_of_memory || !store_sort_by_day(store)) store_clear(store);
+    profile_rows(store->count + dropped, dropped, bytes);
+    profile_stop(STAGE_TXT_LOAD, started);
+    return (store->count > 0);
+}
+
+int has_extension(const char *filename, const char *extension) {
+    size_t length = strlen(filename), ext_length = strlen(extension);
+    if (length < ext_length) {
+        return 0;
+    }
+    const char *tail = filename + length - ext_length;
+    for (size_t i = 0; i < ext_length; i++) {
+        char c = tail[i];
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if (c != extension[i]) return 0;
+    }
+    return 1;
+}
+
+// Open a .shm file as a validated, read-only view. Only the header is
+// inspected, so this is O(1) regardless of the number of records.
+int shm_open_dataset(const char *filename, ShmDataset *dataset) {
+    static const uint32_t widths[SHM_COLUMN_COUNT] = { 4, 4, 4, 4, 4, 4, 4, 4 };
+
+    if (!map_file(filename, &dataset->file)) {
+        return 0;
+    }
+
+    const char *data = dataset->file.data;
+    size_t size = dataset->file.size;
+    const ShmHeader *header = (const ShmHeader *)data;
+
+    int valid = size >= sizeof(ShmHeader) &&
+                memcmp(header->magic, SHM_MAGIC, 4) == 0 &&
+                header->version == SHM_VERSION &&
+                header->byte_order == SHM_BYTE_ORDER &&
+                header->header_size == sizeof(ShmHeader) &&
+                header->record_count <= (uint64_t)INT_MAX;
+
+    for (int c = 0; valid && c < SHM_COLUMN_COUNT; c++) {
+        uint64_t offset = header->column_offset[c];
+        valid = header->column_width[c] == widths[c] &&
+                offset % SHM_ALIGNMENT == 0 &&
+                offset <= size &&
+                header->record_count * widths[c] <= size - offset;
+    }
+
+    if (!valid) {
+        unmap_file(&dataset->file);
+        return 0;
+    }
+
+    dataset->count = (int)header->record_count;
+    dataset->day = (const int *)(data + header->column_offset[0]);
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        dataset->vitals[v] = data + header->column_offset[1 + v];
+    }
+    return 1;
+}
+
+void shm_close_dataset(ShmDataset *dataset) {
+    unmap_file(&dataset->file);
+    dataset->count = 0;
+}
+
+// Load a .shm file: the store adopts the mapping, so this is O(chunks)
+// and copies no records (unless the file is not in date order)
+int load_shm_data(const char *filename, RecordStore *store) {
+    ShmDataset dataset;
+    double started = profile_start();
+    if (!shm_open_dataset(filename, &dataset)) {
+        return 0;
+    }
+    size_t bytes = dataset.file.size;
+    if (!store_attach_shm(store, &dataset)) {
+        return 0;
+    }
+    if (!store_sort_by_day(store)) store_clear(store);
+    profile_rows(store->count, 0, (long long)bytes);
+    profile_stop(STAGE_SHM_LOAD, started);
+    return (store->count > 0);
+}
+
+// Save the store in the binary columnar .shm format
+int export_shm_data(const RecordStore *store, const char *filename) {
+    ShmHeader header;
+    double started = profile_start();
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHM_MAGIC, 4);
+    header.version = SHM_VERSION;
+    header.byte_order = SHM_BYTE_ORDER;
+    header.header_size = sizeof(ShmHeader);
+    header.record_count = (uint64_t)store->count;
+
+    uint64_t offset = (sizeof(ShmHeader) + SHM_ALIGNMENT - 1) / SHM_ALIGNMENT * SHM_ALIGNMENT;
+    for (int c = 0; c < SHM_COLUMN_COUNT; c++) {
+        uint32_t width = 4;
+        header.column_width[c] = width;
+        header.column_offset[c] = offset;
+        offset += ((uint64_t)store->count * width + SHM_ALIGNMENT - 1) / SHM_ALIGNMENT * SHM_ALIGNMENT;
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        return 0;
+    }
+
+    unsigned char padding[SHM_ALIGNMENT] = {0};
+    size_t header_padding = header.column_offset[0] - sizeof(ShmHeader);
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(padding, 1, header_padding, file) == header_padding;
+
+    // Chunk columns are already contiguous, so each one is a single write
+    for (int c = 0; ok && c < SHM_COLUMN_COUNT; c++) {
+        size_t width = header.column_width[c];
+        for (int k = 0; ok && k < store->chunk_count; k++) {
+            const void *column = (c == 0) ? (const void *)store->chunks[k].day
+                                          : store->chunks[k].vitals[c - 1];
+            size_t bytes = (size_t)store_chunk_rows(store, k) * width;
+            ok = fwrite(column, 1, bytes, file) == bytes;
+        }
+        size_t tail = (size_t)(((uint64_t)store->count * width) % SHM_ALIGNMENT);
+        if (ok && tail) {
+            ok = fwrite(padding, 1, SHM_ALIGNMENT - tail, file) == SHM_ALIGNMENT - tail;
+        }
+    }
+
+    if (fclose(file) != 0) ok = 0;
+    if (!ok) remove(filename);
+    profile_stop(STAGE_SHM_EXPORT, started);
+    return ok;
+}
+
+// Convert a CSV or TXT input file (chosen by extension) into a .shm file,
+// or a compressed .shz file if output ends in .shz
+int convert_to_shm(const char *input, const char *output, int threads) {
+    RecordStore store;
+    store_init(&store);
+
+    int loaded;
+    if (has_extension(input, ".txt")) {
+        loaded = load_txt_data(input, &store, NULL);
+    } else {
+        loaded = load_csv_data_parallel(input, &store, threads);
+    }
+
+    int ok = loaded && (has_extension(output, ".shz") ? export_shz_data(&store, output)
+                                                      : export_shm_data(&store, output));
+    if (ok) {
+        printf("[SUCCESS] Converted %d records to '%s'\n", store.count, output);
+    }
+    store_free(&store);
+    return ok;
+}
+
+// Zigzag maps small differences of either sign to small unsigned numbers
+// (0, -1, 1, -2 -> 0, 1, 2, 3). Differences wrap modulo 2^32, so every pair
+// of values round-trips.
+static inline uint32_t zigzag_encode(uint32_t delta) {
+    return (delta << 1) ^ (0u - (delta >> 31));
+}
+
+static inline uint32_t zigzag_decode(uint32_t value) {
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+// Varint: 7 bits per byte, low bits first, the high bit set on all bytes but
+// the last
+static inline unsigned char *varint_put(unsigned char *out, uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+// Returns the byte after the varint, or NULL if it runs past end
+static inline const unsigned char *varint_get(const unsigned char *p, const unsigned char *end,
+                                              uint32_t *value) {
+    if (p < end && *p < 0x80) {
+        *value = *p;
+        return p + 1;
+    }
+    uint32_t result = 0;
+    for (int shift = 0; shift < 7 * SHZ_VARINT_MAX && p < end; shift += 7) {
+        uint32_t byte = *p++;
+        result |= (byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline uint32_t low_bits(uint32_t value, int n) {
+    return (n >= 32) ? value : value & ((1u << n) - 1);
+}
+
+static int leading_zeros(uint32_t x) {
+#ifdef __GNUC__
+    return __builtin_clz(x);
+#else
+    int n = 0;
+    while (!(x & 0x80000000u)) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static int trailing_zeros(uint32_t x) {
+#ifdef __GNUC__
+    return __builtin_ctz(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// Bits written most significant first; whole bytes go out as they fill
+typedef struct {
+    unsigned char *out;
+    uint64_t bits;
+    int count;
+} BitWriter;
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    uint64_t bits;
+    int count;
+} BitReader;
+
+static void bits_put(BitWriter *writer, uint32_t value, int n) {
+    writer->bits = (writer->bits << n) | low_bits(value, n);
+    writer->count += n;
+    while (writer->count >= 8) {
+        writer->count -= 8;
+        *writer->out++ = (unsigned char)(writer->bits >> writer->count);
+    }
+}
+
+static unsigned char *bits_flush(BitWriter *writer) {
+    if (writer->count > 0) {
+        *writer->out++ = (unsigned char)(writer->bits << (8 - writer->count));
+        writer->count = 0;
+    }
+    return writer->out;
+}
+
+static int bits_get(BitReader *reader, int n, uint32_t *value) {
+    while (reader->count < n) {
+        if (reader->p == reader->end) {
+            return 0;
+        }
+        reader->bits = (reader->bits << 8) | *reader->p++;
+        reader->count += 8;
+    }
+    reader->count -= n;
+    *value = low_bits((uint32_t)(reader->bits >> reader->count), n);
+    return 1;
+}
+
+// Day column: delta of deltas, so a run of one record per day (or several
+// on the same day) costs one byte per record
+static unsigned char *day_encode(const int *day, int rows, unsigned char *out) {
+    uint32_t prev = 0, prev_delta = 0;
+    for (int i = 0; i < rows; i++) {
+        uint32_t delta = (uint32_t)day[i] - prev;
+        out = varint_put(out, zigzag_encode(delta - prev_delta));
+        prev = (uint32_t)day[i];
+        if (i > 0) prev_delta = delta;
+    }
+    return out;
+}
+
+static int day_decode(const unsigned char *p, const unsigned char *end, int rows, int *day) {
+    uint32_t prev = 0, prev_delta = 0, value;
+    for (int i = 0; i < rows; i++) {
+        if (!(p = varint_get(p, end, &value))) {
+            return 0;
+        }
+        uint32_t delta = prev_delta + zigzag_decode(value);
+        prev += delta;
+        day[i] = (int)prev;
+        if (i > 0) prev_delta = delta;
+    }
+    return p == end;
+}
+
+// Integer vitals: the change from the previous reading
+static unsigned char *delta_encode(const int *column, int rows, unsigned char *out) {
+    uint32_t prev = 0;
+    for (int i = 0; i < rows; i++) {
+        out = varint_put(out, zigzag_encode((uint32_t)column[i] - prev));
+        prev = (uint32_t)column[i];
+    }
+    return out;
+}
+
+static int delta_decode(const unsigned char *p, const unsigned char *end, int rows, int *column) {
+    uint32_t prev = 0, value;
+    for (int i = 0; i < rows; i++) {
+        if (!(p = varint_get(p, end, &value))) {
+            return 0;
+        }
+        prev += zigzag_decode(value);
+        column[i] = (int)prev;
+    }
+    return p == end;
+}
+
+// Temperature: each float XORed with the one before (Gorilla). A repeated
+// reading is one 0 bit; otherwise 10 and the changed bits, if they fit in
+// the previous window, or 11, 5 bits of leading zeros, 5 bits of length - 1
+// and the changed bits.
+static unsigned char *xor_encode(const float *column, int rows, unsigned char *out) {
+    BitWriter writer = { out, 0, 0 };
+    uint32_t prev = 0;
+    int lead = -1, trail = 0; // window of the last changed bits, -1 = none yet
+
+    for (int i = 0; i < rows; i++) {
+        uint32_t bits;
+        memcpy(&bits, &column[i], sizeof(bits));
+        uint32_t x = bits ^ prev;
+        prev = bits;
+        if (i == 0) {
+            bits_put(&writer, bits, 32);
+        } else if (x == 0) {
+            bits_put(&writer, 0, 1);
+        } else {
+            int l = leading_zeros(x), t = trailing_zeros(x);
+            if (lead >= 0 && l >= lead && t >= trail) {
+                bits_put(&writer, 2, 2);
+                bits_put(&writer, x >> trail, 32 - lead - trail);
+            } else {
+                bits_put(&writer, 3, 2);
+                bits_put(&writer, (uint32_t)l, 5);
+                bits_put(&writer, (uint32_t)(32 - l - t - 1), 5);
+                bits_put(&writer, x >> t, 32 - l - t);
+                lead = l;
+                trail = t;
+            }
+        }
+    }
+    return bits_flush(&writer);
+}
+
+static int xor_decode(const unsigned char *p, const unsigned char *end, int rows, float *column) {
+    BitReader reader = { p, end, 0, 0 };
+    uint32_t prev = 0, flag, value;
+    int lead = -1, trail = 0;
+
+    for (int i = 0; i < rows; i++) {
+        if (i == 0) {
+            if (!bits_get(&reader, 32, &prev)) return 0;
+        } else {
+            if (!bits_get(&reader, 1, &flag)) return 0;
+            if (flag) {
+                if (!bits_get(&reader, 1, &flag)) return 0;
+                if (flag) {
+                    uint32_t l, length;
+                    if (!bits_get(&reader, 5, &l) || !bits_get(&reader, 5, &length)) return 0;
+                    if (l + length + 1 > 32) return 0;
+                    lead = (int)l;
+                    trail = 32 - lead - (int)(length + 1);
+                } else if (lead < 0) {
+                    return 0;
+                }
+                if (!bits_get(&reader, 32 - lead - trail, &value)) return 0;
+                prev ^= value << trail;
+            }
+        }
+        memcpy(&column[i], &prev, sizeof(prev));
+    }
+    // Only the padding of the last byte may be left over
+    return reader.p == end && reader.count < 8;
+}
+
+// Compress rows records of chunk into out (SHZ_BLOCK_BOUND bytes); returns
+// the block size
+size_t shz_encode_block(const RecordChunk *chunk, int rows, unsigned char *out) {
+    unsigned char *p = out + SHM_COLUMN_COUNT * sizeof(uint32_t);
+    for (int c = 0; c < SHM_COLUMN_COUNT; c++) {
+        unsigned char *start = p;
+        if (c == 0) p = day_encode(chunk->day, rows, p);
+        else if (c - 1 == VITAL_TEMPERATURE) p = xor_encode(chunk->vitals[c - 1], rows, p);
+        else p = delta_encode(chunk->vitals[c - 1], rows, p);
+        uint32_t size = (uint32_t)(p - start);
+        memcpy(out + c * sizeof(uint32_t), &size, sizeof(size));
+    }
+    return (size_t)(p - out);
+}
+
+// Decode a block of rows records into the columns of chunk. Returns 0 if
+// the block is malformed; chunk then holds garbage.
+int shz_decode_block(const unsigned char *data, size_t size, int rows, RecordChunk *chunk) {
+    size_t offset = SHM_COLUMN_COUNT * sizeof(uint32_t);
+    if (size < offset) {
+        return 0;
+    }
+    for (int c = 0; c < SHM_COLUMN_COUNT; c++) {
+        uint32_t length;
+        memcpy(&length, data + c * sizeof(uint32_t), sizeof(length));
+        if (length > size - offset) {
+            return 0;
+        }
+        const unsigned char *p = data + offset, *end = p + length;
+        int ok;
+        if (c == 0) ok = day_decode(p, end, rows, chunk->day);
+        else if (c - 1 == VITAL_TEMPERATURE) ok = xor_decode(p, end, rows, chunk->vitals[c - 1]);
+        else ok = delta_decode(p, end, rows, chunk->vitals[c - 1]);
+        if (!ok) {
+            return 0;
+        }
+        offset += length;
+    }
+    return offset == size;
+}
+
+// Load a .shz file. Each block is checked and decoded straight into the
+// columns of a new chunk, so records never pass through a HealthRecord.
+int load_shz_data(const char *filename, RecordStore *store) {
+    MappedFile file;
+    double started = profile_start();
+    if (!map_file(filename, &file)) {
+        return 0;
+    }
+    store_clear(store);
+
+    const unsigned char *data = (const unsigned char *)file.data;
+    const ShzHeader *header = (const ShzHeader *)data;
+    int valid = file.size >= sizeof(ShzHeader) &&
+                memcmp(header->magic, SHZ_MAGIC, 4) == 0 &&
+                header->version == SHZ_VERSION &&
+                header->byte_order == SHM_BYTE_ORDER &&
+                header->header_size == sizeof(ShzHeader) &&
+                header->block_records == RECORD_CHUNK_SIZE &&
+                header->record_count <= (uint64_t)INT_MAX &&
+                header->index_offset >= sizeof(ShzHeader) &&
+                header->index_offset <= file.size &&
+                header->block_count <= (file.size - header->index_offset) / sizeof(ShzBlock);
+
+    // Every block but the last is full, so block b fills chunk b
+    uint64_t loaded = 0;
+    for (uint32_t b = 0; valid && b < header->block_count; b++) {
+        ShzBlock block;
+        memcpy(&block, data + header->index_offset + (uint64_t)b * sizeof(ShzBlock), sizeof(block));
+        uint64_t remaining = header->record_count - loaded;
+        valid = block.rows == (remaining < RECORD_CHUNK_SIZE ? remaining : RECORD_CHUNK_SIZE) &&
+                block.rows > 0 &&
+                block.offset >= sizeof(ShzHeader) &&
+                block.offset <= header->index_offset &&
+                block.size <= header->index_offset - block.offset &&
+                crc32c(data + block.offset, block.size) == block.crc;
+        RecordChunk *chunk = valid ? store_tail_chunk(store) : NULL;
+        valid = chunk && shz_decode_block(data + block.offset, block.size, (int)block.rows, chunk) &&
+                chunk->day[0] == block.first_day && chunk->day[block.rows - 1] == block.last_day;
+        if (valid) {
+            store->count += (int)block.rows;
+            store->version++;
+            loaded += block.rows;
+        }
+    }
+    valid = valid && loaded == header->record_count && store_update_indexes(store);
+
+    size_t bytes = file.size;
+    unmap_file(&file);
+    if (!valid || !store_sort_by_day(store)) {
+        store_clear(store);
+        return 0;
+    }
+    profile_rows(store->count, 0, (long long)bytes);
+    profile_stop(STAGE_SHZ_LOAD, started);
+    return (store->count > 0);
+}
+
+// Save the store in the compressed .shz format, one block per chunk
+int export_shz_data(const RecordStore *store, const char *filename) {
+    ShzHeader header;
+    double started = profile_start();
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHZ_MAGIC, 4);
+    header.version = SHZ_VERSION;
+    header.byte_order = SHM_BYTE_ORDER;
+    header.header_size = sizeof(ShzHeader);
+    header.record_count = (uint64_t)store->count;
+    header.block_count = (uint32_t)store->chunk_count;
+    header.block_records = RECORD_CHUNK_SIZE;
+
+    ShzBlock *index = calloc(store->chunk_count > 0 ? (size_t)store->chunk_count : 1, sizeof(ShzBlock));
+    unsigned char *buffer = malloc(SHZ_BLOCK_BOUND);
+    FILE *file = (index && buffer) ? fopen(filename, "wb") : NULL;
+    if (!file) {
+        free(index);
+        free(buffer);
+        return 0;
+    }
+
+    // The header is written again once the index offset is known
+    uint64_t offset = sizeof(ShzHeader);
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int k = 0; ok && k < store->chunk_count; k++) {
+        const RecordChunk *chunk = &store->chunks[k];
+        int rows = store_chunk_rows(store, k);
+        size_t size = shz_encode_block(chunk, rows, buffer);
+        index[k].offset = offset;
+        index[k].size = (uint32_t)size;
+        index[k].rows = (uint32_t)rows;
+        index[k].first_day = chunk->day[0];
+        index[k].last_day = chunk->day[rows - 1];
+        index[k].crc = crc32c(buffer, size);
+        ok = fwrite(buffer, 1, size, file) == size;
+        offset += size;
+    }
+    header.index_offset = offset;
+    ok = ok && fwrite(index, sizeof(ShzBlock), (size_t)store->chunk_count, file) == (size_t)store->chunk_count;
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+
+    if (fclose(file) != 0) ok = 0;
+    if (!ok) remove(filename);
+    free(index);
+    free(buffer);
+    profile_stop(STAGE_SHZ_EXPORT, started);
+    return ok;
+}
+
+#if defined(HM_X86_SIMD) && defined(__x86_64__)
+// CRC-32C with the SSE4.2 crc32 instruction, eight bytes at a time
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(const unsigned char *p, size_t size) {
+    uint64_t crc = 0xFFFFFFFFu;
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc = _mm_crc32_u64(crc, word);
+    }
+    uint32_t tail = (uint32_t)crc;
+    for (; size > 0; size--) {
+        tail = _mm_crc32_u8(tail, *p++);
+    }
+    return tail ^ 0xFFFFFFFFu;
+}
+#endif
+
+// CRC-32C (Castagnoli), the checksum of .wal frames and .shz blocks
+uint32_t crc32c(const void *data, size_t size) {
+    static uint32_t table[256];
+    static int ready = 0; // built on first use, by the main thread
+    if (!ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+            }
+            table[i] = crc;
+        }
+        ready = 1;
+    }
+
+    const unsigned char *p = data;
+#if defined(HM_X86_SIMD) && defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return crc32c_sse42(p, size);
+    }
+#endif
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void wal_header(WalHeader *header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, WAL_MAGIC, 4);
+    header->version = WAL_VERSION;
+    header->byte_order = SHM_BYTE_ORDER;
+    header->frame_size = sizeof(WalFrame);
+}
+
+// Room for one more record in wal->records
+static int wal_reserve(WriteAheadLog *wal, int count) {
+    if (count <= wal->capacity) {
+        return 1;
+    }
+    int capacity = wal->capacity ? wal->capacity : 64;
+    while (capacity < count) capacity *= 2;
+    HealthRecord *records = realloc(wal->records, (size_t)capacity * sizeof(HealthRecord));
+    if (!records) {
+        return 0;
+    }
+    wal->records = records;
+    wal->capacity = capacity;
+    return 1;
+}
+
+// Open the log at path and replay it into wal->records. A missing file is
+// an empty log, created by the first commit. Frames after the first torn
+// or corrupt one are cut off, so appends continue from the last good one.
+// Returns 0 if path is not a log (it is then left alone and appends fail).
+int wal_open(WriteAheadLog *wal, const char *path) {
+    WalHeader expected;
+    MappedFile file;
+    memset(wal, 0, sizeof(*wal));
+    wal->fd = -1;
+    wal_header(&expected);
+
+    FILE *probe = fopen(path, "rb");
+    long size = 0;
+    if (probe) {
+        fseek(probe, 0, SEEK_END);
+        size = ftell(probe);
+        fclose(probe);
+    }
+
+    // A torn header is only accepted while it still matches ours
+    size_t good = 0;
+    if (size > 0) {
+        if (!map_file(path, &file)) {
+            return 0;
+        }
+        if (file.size < sizeof(WalHeader)) {
+            if (memcmp(file.data, &expected, file.size) != 0) {
+                unmap_file(&file);
+                return 0;
+            }
+        } else {
+            if (memcmp(file.data, &expected, sizeof(WalHeader)) != 0) {
+                unmap_file(&file);
+                return 0;
+            }
+            good = sizeof(WalHeader);
+            size_t frames = (file.size - good) / sizeof(WalFrame);
+            if (frames > INT_MAX || !wal_reserve(wal, (int)frames)) {
+                unmap_file(&file);
+                return 0;
+            }
+            for (size_t i = 0; i < frames; i++) {
+                WalFrame frame;
+                memcpy(&frame, file.data + good, sizeof(frame));
+                if (frame.sequence != wal->sequence ||
+                    frame.checksum != crc32c(&frame, offsetof(WalFrame, checksum))) {
+                    break;
+                }
+                wal->records[wal->count++] = frame.record;
+                wal->sequence++;
+                good += sizeof(WalFrame);
+            }
+        }
+        unmap_file(&file);
+
+#ifndef _WIN32
+        if (good < (size_t)size) {
+            // Cut the damaged tail; nothing past it was ever acknowledged
+            int fd = open(path, O_WRONLY);
+            int ok = fd >= 0 && ftruncate(fd, (off_t)good) == 0 && fsync(fd) == 0;
+            if (fd >= 0) close(fd);
+            if (!ok) {
+                free(wal->records);
+                memset(wal, 0, sizeof(*wal));
+                wal->fd = -1;
+                return 0;
+            }
+        }
+#endif
+    }
+
+    snprintf(wal->path, sizeof(wal->path), "%s", path);
+    wal->committed = (long long)good;
+    return 1;
+}
+
+// Stage a record and commit once the group is full or the oldest staged
+// record has waited WAL_GROUP_SECONDS. The wait is only checked here: there
+// is no timer, so a caller that may stop appending commits the rest itself
+// with wal_commit() (add_manual_record() does after every record) or
+// wal_close(). Returns 0 if a commit failed.
+int wal_append(WriteAheadLog *wal, const HealthRecord *record) {
+    if (!wal_reserve(wal, wal->count + 1)) {
+        return 0;
+    }
+    WalFrame *frame = &wal->pending[wal->pending_count];
+    memset(frame, 0, sizeof(*frame));
+    frame->sequence = wal->sequence++;
+    frame->record = *record;
+    frame->checksum = crc32c(frame, offsetof(WalFrame, checksum));
+    wal->records[wal->count++] = *record;
+
+    double now = monotonic_seconds();
+    if (wal->pending_count++ == 0) {
+        wal->pending_since = now;
+    }
+    if (wal->pending_count == WAL_GROUP_RECORDS || now - wal->pending_since >= WAL_GROUP_SECONDS) {
+        return wal_commit(wal);
+    }
+    return 1;
+}
+
+// Write every staged frame with one write() (the first commit writes the
+// header before them, in a write of its own) and make both durable with one
+// fsync(). On failure the file is cut back to the last commit, so a group
+// is either all there or not there, and its records are dropped.
+int wal_commit(WriteAheadLog *wal) {
+    int ok = 0;
+    if (wal->pending_count == 0) {
+        return 1;
+    }
+
+#ifndef _WIN32
+    int created = 0;
+    if (wal->fd < 0 && wal->path[0]) {
+        wal->fd = open(wal->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        created = wal->fd >= 0 && wal->committed == 0;
+    }
+    if (wal->fd >= 0) {
+        WalHeader header;
+        size_t size = (size_t)wal->pending_count * sizeof(WalFrame);
+        ok = 1;
+        if (wal->committed == 0) {
+            // Header of a new log; synced along with the first group
+            wal_header(&header);
+            ok = write_all(wal->fd, &header, sizeof(header));
+        }
+        ok = ok && write_all(wal->fd, wal->pending, size) && fsync(wal->fd) == 0;
+        if (ok && created) {
+            // A new file also needs its directory entry on disk
+            char dir[MAX_PATH_LEN];
+            snprintf(dir, sizeof(dir), "%s", wal->path);
+            char *slash = strrchr(dir, '/');
+            if (slash) *(slash == dir ? slash + 1 : slash) = '\0';
+            else snprintf(dir, sizeof(dir), ".");
+            int dir_fd = open(dir, O_RDONLY);
+            if (dir_fd >= 0) {
+                fsync(dir_fd);
+                close(dir_fd);
+            }
+        }
+        if (ok) {
+            if (wal->committed == 0) wal->committed = sizeof(WalHeader);
+            wal->committed += (long long)size;
+        } else if (ftruncate(wal->fd, (off_t)wal->committed) != 0) {
+            // Later frames would sit behind a torn one and never replay
+            close(wal->fd);
+            wal->fd = -1;
+            wal->path[0] = '\0';
+        }
+    }
+#endif
+
+    if (ok) {
+        wal->commits++;
+    } else {
+        wal->count -= wal->pending_count;
+        wal->sequence -= (uint32_t)wal->pending_count;
+    }
+    wal->pending_count = 0;
+    return ok;
+}
+
+// Commit what is staged and release the log
+int wal_close(WriteAheadLog *wal) {
+    int ok = wal_commit(wal);
+#ifndef _WIN32
+    if (wal->fd >= 0) close(wal->fd);
+#endif
+    wal->fd = -1;
+    free(wal->records);
+    wal->records = NULL;
+    wal->count = 0;
+    wal->capacity = 0;
+    return ok;
+}
+
+// Add every logged record to the store, in date order
+int wal_restore(const WriteAheadLog *wal, RecordStore *store) {
+    for (int i = 0; i < wal->count; i++) {
+        if (!store_append(store, &wal->records[i])) {
+            return 0;
+        }
+    }
+    return store_sort_by_day(store);
+}
+
+void calculate_statistics(const RecordStore *store, HealthStats *stats) {
+    calculate_statistics_range(store, INT_MIN, INT_MAX, stats);
+}
+
+// Statistics over the records dated from_day..to_day (inclusive)
+void calculate_statistics_range(const RecordStore *store, int from_day, int to_day, HealthStats *stats) {
+    // Without memory for the sketch everything but the percentiles is computed
+    QuantileSketch *sketch = malloc(sizeof(QuantileSketch));
+    calculate_statistics_sketch(store, from_day, to_day, stats, sketch);
+    free(sketch);
+}
+
+// calculate_statistics_range() that also leaves the range's quantile sketch
+// in sketch (if not NULL), for callers that merge sketches
+void calculate_statistics_sketch(const RecordStore *store, int from_day, int to_day, HealthStats *stats,
+                                 QuantileSketch *sketch) {
+    int first, last;
+    double started = profile_start();
+    store_find_days(store, from_day, to_day, &first, &last);
+
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        summary_init(&stats->vitals[v]);
+    }
+    if (sketch) sketch_init(sketch);
+    statistics_add(store, first, last, stats, sketch);
+    statistics_finish(stats, sketch);
+    profile_stop(STAGE_STATISTICS, started);
+}
+
+// Fold records [first, last) into the column summaries of stats and into
+// sketch (if not NULL); one kernel call per column per chunk the range touches
+void statistics_add(const RecordStore *store, int first, int last, HealthStats *stats, QuantileSketch *sketch) {
+    int last_chunk = (last + RECORD_CHUNK_SIZE - 1) >> RECORD_CHUNK_SHIFT;
+    for (int c = first >> RECORD_CHUNK_SHIFT; c < last_chunk; c++) {
+        int offset;
+        int n = store_chunk_span(store, c, first, last, &offset);
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            const int *column = (const int *)store->chunks[c].vitals[v] + offset;
+            summarize_column(column, (Vital)v, n, &stats->vitals[v]);
+            if (sketch) sketch_add_column(&sketch->vitals[v], column, (Vital)v, n);
+        }
+    }
+}
+
+// Averages and percentiles from the column summaries and sketch
+void statistics_finish(HealthStats *stats, QuantileSketch *sketch) {
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        if (sketch) {
+            sketch->vitals[v].min = stats->vitals[v].min;
+            sketch->vitals[v].max = stats->vitals[v].max;
+        }
+        for (int q = 0; q < QUANTILE_COUNT; q++) {
+            stats->quantiles[v][q] = sketch ? sketch_quantile(&sketch->vitals[v], (Vital)v, quantile_levels[q]) : NAN;
+        }
+    }
+
+    stats->record_count = (int)stats->vitals[VITAL_HEART_RATE].count;
+    stats->avg_heart_rate = (float)summary_mean(&stats->vitals[VITAL_HEART_RATE]);
+    stats->avg_systolic = (float)summary_mean(&stats->vitals[VITAL_SYSTOLIC]);
+    stats->avg_diastolic = (float)summary_mean(&stats->vitals[VITAL_DIASTOLIC]);
+    stats->avg_blood_sugar = (float)summary_mean(&stats->vitals[VITAL_BLOOD_SUGAR]);
+    stats->avg_temperature = (float)summary_mean(&stats->vitals[VITAL_TEMPERATURE]);
+    stats->avg_oxygen = (float)summary_mean(&stats->vitals[VITAL_OXYGEN]);
+    stats->total_steps = (long long)stats->vitals[VITAL_STEPS].sum;
+}
+
+void analyze_health(const RecordStore *store, HealthStats stats, AlertLog *alerts) {
+    analyze_health_range(store, INT_MIN, INT_MAX, stats, alerts);
+}
+
+// Analyze the records dated from_day..to_day; stats must cover the same range
+void analyze_health_range(const RecordStore *store, int from_day, int to_day, HealthStats stats,
+                          AlertLog *alerts) {
+    int first, last;
+    double started = profile_start();
+    store_find_days(store, from_day, to_day, &first, &last);
+    alert_log_init(alerts);
+
+    // Threshold rules: dataset averages, then single-record spikes
+    evaluate_rules(&active_rules, store, first, last, &stats, alerts);
+    trend_alerts(store, first, last, alerts);
+
+    // Streaming detectors: their alarms were raised as the records arrived
+    detector_alerts(store, first, last, alerts);
+
+    if (profile_mode) thread_profile.alerts_emitted += alerts->emitted;
+    profile_stop(STAGE_ANALYSIS, started);
+}
+
+// Trend alerts for records [first, last): only the last window matters, so
+// only it is scanned
+void trend_alerts(const RecordStore *store, int first, int last, AlertLog *alerts) {
+    static const Vital watched[] = { VITAL_HEART_RATE, VITAL_SYSTOLIC };
+    TrendReport trends;
+    if (last - first < 3) {
+        return;
+    }
+    int start = (last - first > trend_window) ? last - trend_window : first;
+    unsigned vitals = (1u << VITAL_HEART_RATE) | (1u << VITAL_SYSTOLIC);
+    if (compute_trends(store, start, last, trend_window, vitals, &trends)) {
+        for (int k = 0; k < 2; k++) {
+            Vital v = watched[k];
+            if (trend_direction(&trends, v) > 0) {
+                Alert alert = { ALERT_TREND, 2, (uint8_t)v, 0, last - 1, trends.window,
+                                (float)trends.slope[v] };
+                alert_log_push(alerts, &alert);
+            }
+        }
+    }
+}
+
+// Alert for a detector alarm that stands for count alarms
+void detector_alert(const DetectorEvent *event, int count, Alert *alert) {
+    alert->kind = ALERT_DETECTOR;
+    alert->severity = event->severity;
+    alert->vital = event->vital;
+    alert->rule = event->detector;
+    alert->record = event->record;
+    alert->count = count;
+    alert->value = event->value;
+}
+
+// One alert per detector and vital that raised alarms in records
+// [first, last): the strongest alarm, with how many there were
+void detector_alerts(const RecordStore *store, int first, int last, AlertLog *alerts) {
+    DetectorTally tally;
+    memset(&tally, 0, sizeof(tally));
+    detector_tally_add(store, first, last, &tally);
+    detector_tally_alerts(&tally, alerts);
+}
+
+// Tally the alarms of records [first, last) by running fresh detectors
+// over records [0, last): O(last) time, O(1) memory. For ranges whose
+// alarms have left the ring.
+static void detector_rescan(const RecordStore *store, int first, int last, DetectorTally *tally) {
+    VitalDetector vitals[VITAL_COUNT];
+    memset(vitals, 0, sizeof(vitals));
+    for (int i = 0; i < last; i++) {
+        DetectorEvent events[DETECTOR_COUNT * VITAL_COUNT];
+        int raised = detector_record(vitals, store, i, events);
+        for (int e = 0; i >= first && e < raised; e++) {
+            detector_tally_event(tally, &events[e], 1);
+        }
+    }
+}
+
+// Add the alarms of records [first, last), which must come after any
+// records the tally already covers. The whole store comes from the running
+// tally and a recent range from the ring; an older range than the ring
+// reaches runs the detectors again.
+void detector_tally_add(const RecordStore *store, int first, int last, DetectorTally *tally) {
+    const DetectorSet *set = &store->detectors;
+    if (first == 0 && last >= set->count) {
+        for (int d = 0; d < DETECTOR_COUNT; d++) {
+            for (int v = 0; v < VITAL_COUNT; v++) {
+                if (set->total.hits[d][v] > 0) {
+                    detector_tally_event(tally, &set->total.strongest[d][v], set->total.hits[d][v]);
+                }
+            }
+        }
+        return;
+    }
+
+    long long oldest = set->event_count - set->event_capacity;
+    if (oldest < 0) oldest = 0;
+    // Alarms that left the ring are of records up to the oldest one held
+    if (oldest > 0 && detector_event(set, oldest)->record >= first) {
+        detector_rescan(store, first, last, tally);
+        return;
+    }
+
+    // The ring is in record order, so the range is found by binary search
+    long long low = oldest, high = set->event_count;
+    while (low < high) {
+        long long mid = low + (high - low) / 2;
+        if (detector_event(set, mid)->record < first) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    for (long long n = low; n < set->event_count && detector_event(set, n)->record < last; n++) {
+        detector_tally_event(tally, detector_event(set, n), 1);
+    }
+}
+
+void detector_tally_alerts(const DetectorTally *tally, AlertLog *alerts) {
+    for (int d = 0; d < DETECTOR_COUNT; d++) {
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            if (tally->hits[d][v] > 0) {
+                Alert alert;
+                detector_alert(&tally->strongest[d][v], tally->hits[d][v], &alert);
+                alert_log_push(alerts, &alert);
+            }
+        }
+    }
+}
+
+// Bring the cached analysis up to date with store. An unchanged store costs
+// nothing; appended records are folded in (statistics and record rules scan
+// only them, detector alarms only theirs); a store whose records moved or
+// went away is analyzed from scratch. The detectors are switched on first
+// if a load left them off. Returns 1 if anything was recomputed.
+int analysis_refresh(AnalysisCache *cache, RecordStore *store) {
+    if (cache->count >= 0 && cache->version == store->version) {
+        return 0;
+    }
+    // Alarms of records the cache has already seen are only known now
+    int detected = 0;
+    if (!store->detectors.enabled) {
+        detected = store_enable_detectors(store);
+        if (!detected) printf("[WARNING] Out of memory - analyzing without the anomaly detectors.\n");
+    }
+
+    double started = profile_start();
+    int from = cache->count;
+    if (from < 0 || detected || cache->version < store->rewritten || store->count < from) {
+        from = 0;
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            summary_init(&cache->stats.vitals[v]);
+        }
+        if (cache->sketch) sketch_init(cache->sketch);
+        rule_tally_init(&active_rules, &cache->rules);
+        memset(&cache->detectors, 0, sizeof(cache->detectors));
+    }
+    statistics_add(store, from, store->count, &cache->stats, cache->sketch);
+    statistics_finish(&cache->stats, cache->sketch);
+    profile_stop(STAGE_STATISTICS, started);
+
+    // Average rules and the trend window are cheap and change with any new
+    // record, so they are always re-evaluated
+    started = profile_start();
+    rule_tally_add(&active_rules, store, from, store->count, &cache->rules);
+    detector_tally_add(store, from, store->count, &cache->detectors);
+    alert_log_init(&cache->alerts);
+    rule_alerts(&active_rules, &cache->rules, &cache->stats, &cache->alerts);
+    trend_alerts(store, 0, store->count, &cache->alerts);
+    detector_tally_alerts(&cache->detectors, &cache->alerts);
+    if (profile_mode) thread_profile.alerts_emitted += cache->alerts.emitted;
+    profile_stop(STAGE_ANALYSIS, started);
+
+    cache->count = store->count;
+    cache->version = store->version;
+    return 1;
+}
+
+// An empty cache; without memory for the sketch the percentiles are unknown
+void analysis_init(AnalysisCache *cache) {
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    alert_log_init(&cache->alerts);
+    cache->version = 0;
+    cache->count = -1;
+    cache->sketch = malloc(sizeof(QuantileSketch));
+}
+
+void analysis_free(AnalysisCache *cache) {
+    free(cache->sketch);
+    cache->sketch = NULL;
+    cache->count = -1;
+}
+
+int window_init(SlidingWindow *window, int size) {
+    memset(window, 0, sizeof(*window));
+    window->size = size;
+    window->values = malloc((size_t)size * sizeof(double));
+    window->low = malloc((size_t)size * sizeof(WindowEntry));
+    window->high = malloc((size_t)size * sizeof(WindowEntry));
+    if (!window->values || !window->low || !window->high) {
+        window_free(window);
+        return 0;
+    }
+    return 1;
+}
+
+void window_free(SlidingWindow *window) {
+    free(window->values);
+    free(window->low);
+    free(window->high);
+    window->values = NULL;
+    window->low = NULL;
+    window->high = NULL;
+}
+
+// Add value to a monotonic deque, first dropping the entry that left the
+// window and every entry value makes irrelevant. keep_low = 1 keeps the
+// minimum at the front, 0 the maximum.
+static inline void deque_push(WindowEntry *entries, int size, int *head, int *count,
+                              double value, long long position, int keep_low) {
+    int h = *head, n = *count;
+    if (n > 0 && entries[h].position <= position - size) {
+        if (++h == size) h = 0;
+        n--;
+    }
+    // Ring positions wrap with a compare instead of a division
+    int back = h + n - 1;
+    if (back >= size) back -= size;
+    while (n > 0) {
+        double v = entries[back].value;
+        if (keep_low ? v < value : v > value) break;
+        n--;
+        if (--back < 0) back = size - 1;
+    }
+    if (++back == size) back = 0;
+    entries[back].value = value;
+    entries[back].position = position;
+    *head = h;
+    *count = n + 1;
+}
+
+void window_push(SlidingWindow *window, double value) {
+    int size = window->size;
+    int slot = window->cursor;
+
+    if (window->pushed >= size) {
+        // Drop the oldest value; every other value moves down one place
+        double oldest = window->values[slot];
+        window->sum -= oldest;
+        window->sum_sq -= oldest * oldest;
+        window->weighted -= window->sum;
+        window->weighted += (double)(size - 1) * value;
+    } else {
+        window->weighted += (double)window->pushed * value;
+    }
+    window->sum += value;
+    window->sum_sq += value * value;
+    window->values[slot] = value;
+
+    deque_push(window->low, size, &window->low_head, &window->low_count, value, window->pushed, 1);
+    deque_push(window->high, size, &window->high_head, &window->high_count, value, window->pushed, 0);
+    window->pushed++;
+
+    // Once per lap the ring is in order again: recompute the running sums
+    // exactly so rounding never builds up over a long series
+    if (++window->cursor == size) {
+        window->cursor = 0;
+        double sum = 0, sum_sq = 0, weighted = 0;
+        for (int k = 0; k < size; k++) {
+            double x = window->values[k];
+            sum += x;
+            sum_sq += x * x;
+            weighted += k * x;
+        }
+        window->sum = sum;
+        window->sum_sq = sum_sq;
+        window->weighted = weighted;
+    }
+}
+
+static int window_length(const SlidingWindow *window) {
+    return (window->pushed < window->size) ? (int)window->pushed : window->size;
+}
+
+double window_mean(const SlidingWindow *window) {
+    int n = window_length(window);
+    return n ? window->sum / n : 0.0;
+}
+
+// Least-squares slope per value; *t_value (may be NULL) gets the slope
+// divided by its standard error, the usual test for a real trend
+double window_slope(const SlidingWindow *window, double *t_value) {
+    int n = window_length(window);
+    if (t_value) *t_value = 0.0;
+    if (n < 2) {
+        return 0.0;
+    }
+
+    double sxx = (double)n * ((double)n * n - 1) / 12.0;
+    double sxy = window->weighted - (n - 1) / 2.0 * window->sum;
+    double syy = window->sum_sq - window->sum * window->sum / n;
+    double slope = sxy / sxx;
+
+    if (t_value && n > 2) {
+        double residual = syy - slope * sxy;
+        if (residual > 1e-9 * (syy > 0 ? syy : 1)) {
+            *t_value = slope / sqrt(residual / (n - 2) / sxx);
+        } else if (slope != 0) {
+            *t_value = (slope > 0) ? INFINITY : -INFINITY; // exact straight line
+        }
+    }
+    return slope;
+}
+
+// Push records [from, to) of one vital into a window
+static void window_push_records(SlidingWindow *window, const RecordStore *store, Vital vital,
+                                int from, int to) {
+    int last_chunk = (to + RECORD_CHUNK_SIZE - 1) >> RECORD_CHUNK_SHIFT;
+    for (int c = from >> RECORD_CHUNK_SHIFT; c < last_chunk; c++) {
+        int offset;
+        int rows = store_chunk_span(store, c, from, to, &offset);
+        const void *column = store->chunks[c].vitals[vital];
+        for (int i = offset; i < offset + rows; i++) {
+            window_push(window, (vital == VITAL_TEMPERATURE) ? ((const float *)column)[i]
+                                                             : ((const int *)column)[i]);
+        }
+    }
+}
+
+static void window_reset(SlidingWindow *window) {
+    window->pushed = 0;
+    window->cursor = 0;
+    window->sum = window->sum_sq = window->weighted = 0;
+    window->low_head = window->low_count = 0;
+    window->high_head = window->high_count = 0;
+}
+
+// Slide a window of `window` records over [first, last) for every vital
+// whose bit is set in `vitals`: the moving average at TREND_SAMPLES evenly
+// spaced window ends, and every figure of the last window. Only records
+// inside a sampled window are visited, so the cost is O(samples x window)
+// per vital however long the range is. Returns 0 if the range is empty or
+// memory ran out.
+int compute_trends(const RecordStore *store, int first, int last, int window, unsigned vitals,
+                   TrendReport *report) {
+    int n = last - first;
+    SlidingWindow slider;
+    memset(report, 0, sizeof(*report));
+    if (n <= 0) {
+        return 0;
+    }
+    if (window > n) window = n;
+    if (!window_init(&slider, window)) {
+        return 0;
+    }
+
+    report->window = window;
+    report->records = n;
+    report->last = last;
+    report->vitals = vitals;
+
+    // Window ends (as record indexes) at which the moving average is sampled
+    int windows = n - window + 1;
+    report->sample_count = (windows < TREND_SAMPLES) ? windows : TREND_SAMPLES;
+    for (int s = 0; s < report->sample_count; s++) {
+        long long step = (report->sample_count > 1)
+                         ? (long long)s * (windows - 1) / (report->sample_count - 1) : windows - 1;
+        report->sample_record[s] = first + window - 1 + (int)step;
+    }
+
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        if (!(vitals & (1u << v))) {
+            continue;
+        }
+        // Slide on while sampled windows overlap, restart where they don't
+        int pushed_to = first;
+        window_reset(&slider);
+        for (int s = 0; s < report->sample_count; s++) {
+            int end = report->sample_record[s] + 1;
+            if (pushed_to < end - window) {
+                window_reset(&slider);
+                pushed_to = end - window;
+            }
+            window_push_records(&slider, store, (Vital)v, pushed_to, end);
+            pushed_to = end;
+            report->samples[v][s] = window_mean(&slider);
+        }
+
+        report->mean[v] = window_mean(&slider);
+        report->min[v] = slider.low[slider.low_head].value;
+        report->max[v] = slider.high[slider.high_head].value;
+        report->slope[v] = window_slope(&slider, &report->slope_t[v]);
+    }
+
+    window_free(&slider);
+    return 1;
+}
+
+// +1 rising, -1 falling, 0 steady over the last window: the slope must be
+// significant (TREND_MIN_T) and large enough to matter (TREND_MIN_RISE)
+int trend_direction(const TrendReport *report, Vital vital) {
+    if (!(report->vitals & (1u << vital)) || report->window < 3) {
+        return 0;
+    }
+    double change = report->slope[vital] * (report->window - 1);
+    if (fabs(report->slope_t[vital]) < TREND_MIN_T ||
+        fabs(change) < TREND_MIN_RISE * fabs(report->mean[vital])) {
+        return 0;
+    }
+    return (change > 0) ? 1 : -1;
+}
+
+void alert_log_init(AlertLog *log) {
+    log->start = 0;
+    log->count = 0;
+    log->emitted = 0;
+    log->dropped = 0;
+    log->max_severity = 0;
+    log->categories = 0;
+}
+
+void alert_log_push(AlertLog *log, const Alert *alert) {
+    if (log->count < ALERT_CAPACITY) {
+        log->entries[(log->start + log->count) % ALERT_CAPACITY] = *alert;
+        log->count++;
+    } else {
+        log->entries[log->start] = *alert;
+        log->start = (log->start + 1) % ALERT_CAPACITY;
+        log->dropped++;
+    }
+    log->emitted++;
+    if (alert->severity > log->max_severity) log->max_severity = alert->severity;
+    // A detector alarm says a reading is unusual, not which way it is
+    // unhealthy (a jump in steps is no reason for activity advice), so
+    // only rule and trend alerts choose advice
+    if (alert->kind != ALERT_DETECTOR) log->categories |= vital_category((Vital)alert->vital);
+}
+
+// i-th alert held, oldest first
+const Alert *alert_log_at(const AlertLog *log, int i) {
+    return &log->entries[(log->start + i) % ALERT_CAPACITY];
+}
+
+unsigned vital_category(Vital vital) {
+    switch (vital) {
+        case VITAL_HEART_RATE: return CATEGORY_HEART;
+        case VITAL_SYSTOLIC:
+        case VITAL_DIASTOLIC: return CATEGORY_BLOOD_PRESSURE;
+        case VITAL_BLOOD_SUGAR: return CATEGORY_SUGAR;
+        case VITAL_TEMPERATURE: return CATEGORY_TEMPERATURE;
+        case VITAL_OXYGEN: return CATEGORY_OXYGEN;
+        default: return CATEGORY_ACTIVITY;
+    }
+}
+
+// Built-in rules; same format as a --rules file. The average rules are the
+// original clinical thresholds, the record rules catch single dangerous
+// readings that an average would hide.
+static const char default_rules_text[] =
+    "# scope   vital        op  threshold severity group  message\n"
+    "average heart_rate > 120 4 heart Average heart rate is {value} BPM - Possible tachycardia detected\n"
+    "average heart_rate > 100 3 heart Average heart rate is {value} BPM - Possible tachycardia detected\n"
+    "average heart_rate < 40 4 heart Average heart rate is {value} BPM - Bradycardia detected\n"
+    "average heart_rate < 60 2 heart Average heart rate is {value} BPM - Bradycardia detected\n"
+    "average systolic > 140 4 bp Average BP is {systolic}/{diastolic} mmHg - Hypertension (Stage 2)\n"
+    "average diastolic > 90 4 bp Average BP is {systolic}/{diastolic} mmHg - Hypertension (Stage 2)\n"
+    "average systolic > 130 3 bp Average BP is {systolic}/{diastolic} mmHg - Hypertension (Stage 1)\n"
+    "average diastolic > 80 3 bp Average BP is {systolic}/{diastolic} mmHg - Hypertension (Stage 1)\n"
+    "average systolic < 90 2 bp Average BP is {systolic}/{diastolic} mmHg - Hypotension detected\n"
+    "average diastolic < 60 2 bp Average BP is {systolic}/{diastolic} mmHg - Hypotension detected\n"
+    "average blood_sugar > 200 4 sugar Average blood sugar is {value} mg/dL - Severe hyperglycemia\n"
+    "average blood_sugar > 125 3 sugar Average blood sugar is {value} mg/dL - Diabetes risk detected\n"
+    "average blood_sugar < 70 3 sugar Average blood sugar is {value} mg/dL - Hypoglycemia detected\n"
+    "average temperature > 100.4 3 temp Average temperature is {value} F - Fever detected\n"
+    "average temperature < 95.0 4 temp Average temperature is {value} F - Hypothermia risk\n"
+    "average oxygen < 90 4 oxygen Average oxygen saturation is {value}% - Hypoxemia (Critical)\n"
+    "average oxygen < 95 2 oxygen Average oxygen saturation is {value}% - Low oxygen levels\n"
+    "average steps < 5000 2 steps Average daily steps: {value} - Sedentary lifestyle detected\n"
+    "record heart_rate > 150 4 heart_spike Single heart rate reading of {value} BPM on {date} ({count} above {threshold})\n"
+    "record heart_rate < 40 4 heart_drop Single heart rate reading of {value} BPM on {date} ({count} below {threshold})\n"
+    "record systolic > 180 4 bp_crisis Blood pressure crisis: systolic {value} mmHg on {date} ({count} above {threshold})\n"
+    "record diastolic > 120 4 bp_crisis Blood pressure crisis: diastolic {value} mmHg on {date} ({count} above {threshold})\n"
+    "record blood_sugar > 300 4 sugar_spike Blood sugar reading of {value} mg/dL on {date} ({count} above {threshold})\n"
+    "record blood_sugar < 54 4 sugar_drop Blood sugar reading of {value} mg/dL on {date} ({count} below {threshold})\n"
+    "record temperature >= 103 3 fever_spike High fever of {value} F on {date} ({count} at or above {threshold})\n"
+    "record oxygen < 88 4 oxygen_drop Blood oxygen reading of {value}% on {date} ({count} below {threshold})\n";
+
+// Name used for a vital in rule files
+const char *vital_key(Vital vital) {
+    static const char *keys[VITAL_COUNT] = {
+        "heart_rate", "systolic", "diastolic", "blood_sugar",
+        "temperature", "oxygen", "steps"
+    };
+    return keys[vital];
+}
+
+// The dataset average exactly as the report shows it (steps are a whole
+// number of steps per day)
+double stats_average(const HealthStats *stats, Vital vital) {
+    switch (vital) {
+        case VITAL_HEART_RATE: return stats->avg_heart_rate;
+        case VITAL_SYSTOLIC: return stats->avg_systolic;
+        case VITAL_DIASTOLIC: return stats->avg_diastolic;
+        case VITAL_BLOOD_SUGAR: return stats->avg_blood_sugar;
+        case VITAL_TEMPERATURE: return stats->avg_temperature;
+        case VITAL_OXYGEN: return stats->avg_oxygen;
+        default:
+            return stats->record_count ? (double)(stats->total_steps / stats->record_count) : 0.0;
+    }
+}
+
+// Parse rule lines of the form
+//   <average|record> <vital> <op> <threshold> <severity> <group> <message...>
+// and compile them. Blank lines and lines starting with '#' are ignored.
+int parse_rules(const char *text, const char *source, RuleSet *rules) {
+    memset(rules, 0, sizeof(*rules));
+    int line_number = 0;
+
+    while (*text) {
+        const char *line_end = strchr(text, '\n');
+        if (!line_end) line_end = text + strlen(text);
+        char line[MAX_LINE];
+        size_t length = (size_t)(line_end - text);
+        line_number++;
+
+        if (length >= sizeof(line)) {
+            fprintf(stderr, "[ERROR] %s:%d: line too long\n", source, line_number);
+            return 0;
+        }
+        memcpy(line, text, length);
+        line[length] = '\0';
+        line[strcspn(line, "\r")] = '\0';
+        text = *line_end ? line_end + 1 : line_end;
+
+        char scope[16], vital[24], op[4], group[RULE_GROUP_LEN];
+        double threshold;
+        int severity, message_at = 0;
+        const char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+
+        if (sscanf(p, "%15s %23s %3s %lf %d %23s %n", scope, vital, op, &threshold,
+                   &severity, group, &message_at) < 6 || message_at == 0 || p[message_at] == '\0') {
+            fprintf(stderr, "[ERROR] %s:%d: expected <scope> <vital> <op> <threshold> "
+                    "<severity> <group> <message>\n", source, line_number);
+            return 0;
+        }
+        if (rules->count == MAX_RULES) {
+            fprintf(stderr, "[ERROR] %s:%d: more than %d rules\n", source, line_number, MAX_RULES);
+            return 0;
+        }
+
+        Rule *rule = &rules->rules[rules->count];
+        if (strcmp(scope, "average") == 0) rule->scope = RULE_AVERAGE;
+        else if (strcmp(scope, "record") == 0) rule->scope = RULE_RECORD;
+        else {
+            fprintf(stderr, "[ERROR] %s:%d: scope must be 'average' or 'record'\n", source, line_number);
+            return 0;
+        }
+
+        int v = 0;
+        while (v < VITAL_COUNT && strcmp(vital, vital_key((Vital)v)) != 0) v++;
+        if (v == VITAL_COUNT) {
+            fprintf(stderr, "[ERROR] %s:%d: unknown vital '%s'\n", source, line_number, vital);
+            return 0;
+        }
+        rule->vital = (Vital)v;
+
+        if (strcmp(op, ">") == 0) rule->op = RULE_ABOVE;
+        else if (strcmp(op, ">=") == 0) rule->op = RULE_AT_LEAST;
+        else if (strcmp(op, "<") == 0) rule->op = RULE_BELOW;
+        else if (strcmp(op, "<=") == 0) rule->op = RULE_AT_MOST;
+        else {
+            fprintf(stderr, "[ERROR] %s:%d: unknown operator '%s'\n", source, line_number, op);
+            return 0;
+        }
+
+        if (severity < 1 || severity > 4) {
+            fprintf(stderr, "[ERROR] %s:%d: severity must be 1-4\n", source, line_number);
+            return 0;
+        }
+        rule->threshold = threshold;
+        rule->severity = severity;
+        snprintf(rule->message, sizeof(rule->message), "%s", p + message_at);
+
+        // Integer columns: turn every operator into a strict comparison
+        // against an integer bound, so the column scan is one compare per value
+        double bound;
+        switch (rule->op) {
+            case RULE_ABOVE: rule->above = 1; bound = floor(threshold); break;
+            case RULE_AT_LEAST: rule->above = 1; bound = ceil(threshold) - 1; break;
+            case RULE_BELOW: rule->above = 0; bound = ceil(threshold); break;
+            default: rule->above = 0; bound = floor(threshold) + 1; break;
+        }
+        if (bound < INT_MIN + 1.0) bound = INT_MIN + 1.0;
+        if (bound > INT_MAX - 1.0) bound = INT_MAX - 1.0;
+        rule->bound = (int)bound;
+
+        int g = 0;
+        while (g < rules->group_count && strcmp(rules->groups[g], group) != 0) g++;
+        if (g == rules->group_count) {
+            strcpy(rules->groups[g], group);
+            rules->group_count++;
+        }
+        rule->group = g;
+
+        if (rule->scope == RULE_RECORD) {
+            rules->record_rules[v][rules->record_rule_count[v]++] = rules->count;
+        }
+        rules->count++;
+    }
+    return 1;
+}
+
+// Load a rule file, or the built-in rules when filename is NULL
+int load_rules(const char *filename, RuleSet *rules) {
+    if (!filename) {
+        return parse_rules(default_rules_text, "built-in rules", rules);
+    }
+
+    MappedFile file;
+    if (!map_file(filename, &file)) {
+        fprintf(stderr, "[ERROR] Cannot read rule file '%s'.\n", filename);
+        return 0;
+    }
+    char *text = malloc(file.size + 1);
+    int ok = 0;
+    if (text) {
+        memcpy(text, file.data, file.size);
+        text[file.size] = '\0';
+        ok = parse_rules(text, filename, rules);
+        free(text);
+    }
+    unmap_file(&file);
+    return ok;
+}
+
+// Number of values above (or below) bound, without branches
+static int count_int_hits(const int *values, int n, int bound, int above) {
+    int hits = 0, i = 0;
+#ifdef HM_X86_SIMD
+    // Compare masks are -1 per hit, so subtracting them counts hits per lane
+    __m128i limit = _mm_set1_epi32(bound), acc = _mm_setzero_si128();
+    if (above) {
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(values + i));
+            acc = _mm_sub_epi32(acc, _mm_cmpgt_epi32(v, limit));
+        }
+    } else {
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(values + i));
+            acc = _mm_sub_epi32(acc, _mm_cmplt_epi32(v, limit));
+        }
+    }
+    int lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    hits = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    if (above) {
+        for (; i < n; i++) hits += values[i] > bound;
+    } else {
+        for (; i < n; i++) hits += values[i] < bound;
+    }
+    return hits;
+}
+
+static int count_floats(const float *values, int n, const Rule *rule) {
+    int hits = 0;
+    float t = (float)rule->threshold;
+    // Exact whenever the threshold is a float; otherwise fall back to doubles
+    if ((double)t == rule->threshold) {
+        switch (rule->op) {
+            case RULE_ABOVE: for (int i = 0; i < n; i++) hits += values[i] > t; break;
+            case RULE_AT_LEAST: for (int i = 0; i < n; i++) hits += values[i] >= t; break;
+            case RULE_BELOW: for (int i = 0; i < n; i++) hits += values[i] < t; break;
+            default: for (int i = 0; i < n; i++) hits += values[i] <= t; break;
+        }
+    } else {
+        for (int i = 0; i < n; i++) hits += rule_matches(rule, values[i]);
+    }
+    return hits;
+}
+
+// Fill in a rule's message template
+static void format_rule_message(const Rule *rule, const HealthStats *stats, double value,
+                                const char *date, long long count, char *out, size_t size) {
+    size_t used = 0;
+    const char *p = rule->message;
+    out[0] = '\0';
+
+    while (*p && used + 1 < size) {
+        char field[24], text[48];
+        const char *close = (*p == '{') ? strchr(p, '}') : NULL;
+        if (!close || (size_t)(close - p - 1) >= sizeof(field)) {
+            out[used++] = *p++;
+            out[used] = '\0';
+            continue;
+        }
+        memcpy(field, p + 1, (size_t)(close - p - 1));
+        field[close - p - 1] = '\0';
+
+        Vital vital = rule->vital;
+        double shown = value;
+        int known = 1;
+        if (strcmp(field, "date") == 0) {
+            snprintf(text, sizeof(text), "%s", date ? date : "");
+        } else if (strcmp(field, "count") == 0) {
+            snprintf(text, sizeof(text), "%lld", count);
+        } else if (strcmp(field, "threshold") == 0) {
+            snprintf(text, sizeof(text), "%g", rule->threshold);
+        } else {
+            if (strcmp(field, "value") != 0) {
+                int v = 0;
+                while (v < VITAL_COUNT && strcmp(field, vital_key((Vital)v)) != 0) v++;
+                known = (v < VITAL_COUNT);
+                vital = (Vital)v;
+                if (known) shown = stats_average(stats, vital);
+            }
+            if (known) {
+                snprintf(text, sizeof(text), (vital == VITAL_TEMPERATURE) ? "%.1f" : "%.0f", shown);
+            }
+        }
+
+        if (!known) {
+            out[used++] = *p++;
+            out[used] = '\0';
+            continue;
+        }
+        used += (size_t)snprintf(out + used, size - used, "%s", text);
+        if (used >= size) used = size - 1;
+        p = close + 1;
+    }
+}
+
+// Run the rule table: average rules against the statistics, record rules
+// in one pass per chunk column over records [first, last). Then emit one
+// alert per group, from the first rule in that group that fired.
+void evaluate_rules(const RuleSet *rules, const RecordStore *store, int first, int last,
+                    const HealthStats *stats, AlertLog *alerts) {
+    RuleTally tally;
+    rule_tally_init(rules, &tally);
+    rule_tally_add(rules, store, first, last, &tally);
+    rule_alerts(rules, &tally, stats, alerts);
+}
+
+void rule_tally_init(const RuleSet *rules, RuleTally *tally) {
+    for (int r = 0; r < rules->count; r++) {
+        tally->hits[r] = 0;
+        tally->peak_index[r] = -1;
+    }
+}
+
+// Count the record-rule matches in records [first, last), which must come
+// after any records the tally already covers
+void rule_tally_add(const RuleSet *rules, const RecordStore *store, int first, int last, RuleTally *tally) {
+    int last_chunk = (last + RECORD_CHUNK_SIZE - 1) >> RECORD_CHUNK_SHIFT;
+    for (int c = first >> RECORD_CHUNK_SHIFT; c < last_chunk; c++) {
+        int offset;
+        int n = store_chunk_span(store, c, first, last, &offset);
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            const void *column = (const int *)store->chunks[c].vitals[v] + offset;
+            for (int k = 0; k < rules->record_rule_count[v]; k++) {
+                int r = rules->record_rules[v][k];
+                const Rule *rule = &rules->rules[r];
+                int found;
+                if (v == VITAL_TEMPERATURE) {
+                    found = count_floats(column, n, rule);
+                } else {
+                    found = count_int_hits(column, n, rule->bound, rule->above);
+                }
+                if (found == 0) {
+                    continue;
+                }
+                tally->hits[r] += found;
+
+                // Keep the most extreme reading: the chunk's extreme comes
+                // from the summary kernels, its position is only looked up
+                // when it beats the current peak
+                ColumnSummary chunk;
+                summary_init(&chunk);
+                summarize_column(column, (Vital)v, n, &chunk);
+                int want_high = (rule->op == RULE_ABOVE || rule->op == RULE_AT_LEAST);
+                double extreme = want_high ? chunk.max : chunk.min;
+                if (tally->peak_index[r] < 0 ||
+                    (want_high ? extreme > tally->peak[r] : extreme < tally->peak[r])) {
+                    int i = 0;
+                    if (v == VITAL_TEMPERATURE) {
+                        while ((double)((const float *)column)[i] != extreme) i++;
+                    } else {
+                        while ((double)((const int *)column)[i] != extreme) i++;
+                    }
+                    tally->peak[r] = extreme;
+                    tally->peak_index[r] = (c << RECORD_CHUNK_SHIFT) + offset + i;
+                }
+            }
+        }
+    }
+}
+
+// One alert per group from the tally and, for average rules, the statistics
+void rule_alerts(const RuleSet *rules, const RuleTally *tally, const HealthStats *stats, AlertLog *alerts) {
+    for (int g = 0; g < rules->group_count; g++) {
+        for (int r = 0; r < rules->count; r++) {
+            const Rule *rule = &rules->rules[r];
+            if (rule->group != g) {
+                continue;
+            }
+            int fired = (rule->scope == RULE_RECORD)
+                            ? tally->hits[r] > 0
+                            : stats->record_count > 0 && rule_matches(rule, stats_average(stats, rule->vital));
+            if (!fired) {
+                continue;
+            }
+            Alert alert;
+            alert.kind = ALERT_RULE;
+            alert.severity = (uint8_t)rule->severity;
+            alert.vital = (uint8_t)rule->vital;
+            alert.rule = (uint8_t)r;
+            if (rule->scope == RULE_RECORD) {
+                alert.record = tally->peak_index[r];
+                alert.count = (int)tally->hits[r];
+                alert.value = (float)tally->peak[r];
+            } else {
+                alert.record = -1;
+                alert.count = stats->record_count;
+                alert.value = (float)stats_average(stats, rule->vital);
+            }
+            alert_log_push(alerts, &alert);
+            break;
+        }
+    }
+}
+
+// Text for an alert, built from its rule's template (or the fixed trend
+// and detector wording). Record dates are looked up in the store the alert
+// came from.
+void format_alert(const Alert *alert, const HealthStats *stats, const RecordStore *store,
+                  char *out, size_t size) {
+    char text[DATE_LEN];
+    const char *date = NULL;
+    if (alert->record >= 0 && store && alert->record < store->count) {
+        days_to_date(store_day(store, alert->record), text);
+        date = text;
+    }
+    format_alert_dated(alert, stats, date, out, size);
+}
+
+// format_alert() with the record's date given (NULL = none), for alerts
+// whose record is not in a store
+void format_alert_dated(const Alert *alert, const HealthStats *stats, const char *date,
+                        char *out, size_t size) {
+    if (alert->kind == ALERT_TREND) {
+        snprintf(out, size, "%s showing consistent upward trend",
+                 alert->vital == VITAL_HEART_RATE ? "Heart rate" : "Blood pressure");
+        return;
+    }
+
+    if (alert->kind == ALERT_DETECTOR) {
+        const char *name = vital_name((Vital)alert->vital);
+        int decimals = (alert->vital == VITAL_TEMPERATURE) ? 1 : 0;
+        if (!date) date = "an unknown date";
+        if (alert->rule == DETECTOR_ZSCORE) {
+            snprintf(out, size, "Sudden %s reading of %.*f on %s (%d reading(s) far from the recent ones)",
+                     name, decimals, alert->value, date, alert->count);
+        } else if (alert->rule == DETECTOR_EWMA) {
+            snprintf(out, size, "%s drifted out of its usual range on %s, reading %.*f (EWMA, %d time(s))",
+                     name, date, decimals, alert->value, alert->count);
+        } else {
+            snprintf(out, size, "Sustained %s shift detected on %s, reading %.*f (CUSUM, %d shift(s))",
+                     name, date, decimals, alert->value, alert->count);
+        }
+        return;
+    }
+    format_rule_message(&active_rules.rules[alert->rule], stats, alert->value, date,
+                        alert->count, out, size);
+}
+
+void display_report(HealthStats stats, const AlertLog *alerts, const RecordStore *store) {
+    char storage[OUTPUT_STACK_SIZE];
+    OutputBuffer out;
+    output_init(&out, storage, sizeof(storage));
+    render_console_report(&out, stats, alerts, store);
+    output_flush(&out, stdout);
+    output_free(&out);
+}
+
+// The console report
+void render_console_report(OutputBuffer *out, HealthStats stats, const AlertLog *alerts,
+                           const RecordStore *store) {
+    output_printf(out, "\n");
+    output_line(out, '=', 60);
+    output_printf(out, "              HEALTH ANALYSIS REPORT\n");
+    output_line(out, '=', 60);
+
+    output_printf(out, "\nVITAL STATISTICS (Based on %d records)\n", stats.record_count);
+    output_line(out, '-', 60);
+
+    output_printf(out, "  Heart Rate:      %.0f BPM", stats.avg_heart_rate);
+    if (stats.avg_heart_rate >= 60 && stats.avg_heart_rate <= 100)
+        output_printf(out, " [NORMAL]\n");
+    else
+        output_printf(out, " [ABNORMAL]\n");
+
+    output_printf(out, "  Blood Pressure:  %.0f/%.0f mmHg",
+                  stats.avg_systolic, stats.avg_diastolic);
+    if (stats.avg_systolic < 120 && stats.avg_diastolic < 80)
+        output_printf(out, " [NORMAL]\n");
+    else
+        output_printf(out, " [ELEVATED]\n");
+
+    output_printf(out, "  Blood Sugar:     %.0f mg/dL", stats.avg_blood_sugar);
+    if (stats.avg_blood_sugar >= 70 && stats.avg_blood_sugar <= 125)
+        output_printf(out, " [NORMAL]\n");
+    else
+        output_printf(out, " [ABNORMAL]\n");
+
+    output_printf(out, "  Temperature:     %.1f F", stats.avg_temperature);
+    if (stats.avg_temperature >= 97.0 && stats.avg_temperature <= 99.0)
+        output_printf(out, " [NORMAL]\n");
+    else
+        output_printf(out, " [ABNORMAL]\n");
+
+    output_printf(out, "  Oxygen Level:    %.0f%%", stats.avg_oxygen);
+    if (stats.avg_oxygen >= 95)
+        output_printf(out, " [NORMAL]\n");
+    else
+        output_printf(out, " [LOW]\n");
+
+    output_printf(out, "  Total Steps:     %lld steps\n", stats.total_steps);
+    output_printf(out, "  Avg Daily Steps: %lld steps/day\n",
+                  stats.total_steps / stats.record_count);
+
+    output_printf(out, "\nVARIABILITY (Min / Max / Std Dev)\n");
+    output_line(out, '-', 60);
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        const ColumnSummary *summary = &stats.vitals[v];
+        int decimals = (v == VITAL_TEMPERATURE) ? 1 : 0;
+        char label[32];
+        snprintf(label, sizeof(label), "%s:", vital_name((Vital)v));
+        output_printf(out, "  %-17s%.*f / %.*f / %.1f\n", label,
+                      decimals, summary->min, decimals, summary->max, summary_stddev(summary));
+    }
+
+    output_printf(out, "\nDISTRIBUTION (P50 / P90 / P99)\n");
+    output_line(out, '-', 60);
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        const double *q = stats.quantiles[v];
+        int decimals = (v == VITAL_TEMPERATURE) ? 1 : 0;
+        char label[32];
+        snprintf(label, sizeof(label), "%s:", vital_name((Vital)v));
+        output_printf(out, "  %-17s%.*f / %.*f / %.*f\n", label, decimals, q[QUANTILE_P50],
+                      decimals, q[QUANTILE_P90], decimals, q[QUANTILE_P99]);
+    }
+
+    // Health Score
+    int health_score = calculate_health_score(stats);
+    render_health_score(out, health_score);
+
+    // Alerts
+    if (alerts->count > 0) {
+        output_printf(out, "\nHEALTH ALERTS\n");
+        output_line(out, '-', 60);
+
+        for (int i = 0; i < alerts->count; i++) {
+            const Alert *alert = alert_log_at(alerts, i);
+            char message[256];
+            format_alert(alert, &stats, store, message, sizeof(message));
+            switch (alert->severity) {
+                case 4:
+                    output_printf(out, "  [CRITICAL] %s\n", message);
+                    break;
+                case 3:
+                    output_printf(out, "  [HIGH]     %s\n", message);
+                    break;
+                case 2:
+                    output_printf(out, "  [MEDIUM]   %s\n", message);
+                    break;
+                default:
+                    output_printf(out, "  [LOW]      %s\n", message);
+            }
+        }
+        if (alerts->dropped > 0) {
+            output_printf(out, "  (%lld earlier alert(s) not shown; %lld raised in total)\n",
+                          alerts->dropped, alerts->emitted);
+        }
+    } else {
+        output_printf(out, "\n[SUCCESS] All vitals are within normal ranges! Keep up the good work!\n");
+    }
+    output_printf(out, "\n");
+}
+
+int calculate_health_score(HealthStats stats) {
+    int score = 100;
+
+    // Heart rate
+    if (stats.avg_heart_rate < 60 || stats.avg_heart_rate > 100) score -= 15;
+    else if (stats.avg_heart_rate < 65 || stats.avg_heart_rate > 95) score -= 5;
+
+    // Blood pressure
+    if (stats.avg_systolic > 140 || stats.avg_diastolic > 90) score -= 20;
+    else if (stats.avg_systolic > 130 || stats.avg_diastolic > 80) score -= 10;
+    else if (stats.avg_systolic < 90 || stats.avg_diastolic < 60) score -= 15;
+
+    // Blood sugar
+    if (stats.avg_blood_sugar > 200 || stats.avg_blood_sugar < 70) score -= 25;
+    else if (stats.avg_blood_sugar > 125) score -= 15;
+
+    // Temperature
+    if (stats.avg_temperature > 100.4 || stats.avg_temperature < 95.0) score -= 15;
+    else if (stats.avg_temperature > 99.5 || stats.avg_temperature < 97.0) score -= 5;
+
+    // Oxygen
+    if (stats.avg_oxygen < 90) score -= 25;
+    else if (stats.avg_oxygen < 95) score -= 10;
+
+    // Steps
+    int avg_steps = (int)(stats.total_steps / stats.record_count);
+    if (avg_steps < 5000) score -= 10;
+    else if (avg_steps > 10000) score += 5;
+
+    if (score < 0) score = 0;
+    if (score > 100) score = 100;
+
+    return score;
+}
+
+void display_health_score(int score) {
+    char storage[1024];
+    OutputBuffer out;
+    output_init(&out, storage, sizeof(storage));
+    render_health_score(&out, score);
+    output_flush(&out, stdout);
+    output_free(&out);
+}
+
+void render_health_score(OutputBuffer *out, int score) {
+    output_printf(out, "\n");
+    output_line(out, '-', 50);
+    output_printf(out, "          OVERALL HEALTH SCORE\n");
+    output_line(out, '-', 50);
+
+    // Score bar
+    output_printf(out, "  [");
+    int bars = score / 5;
+    for (int i = 0; i < 20; i++) {
+        if (i < bars) output_printf(out, "#");
+        else output_printf(out, "-");
+    }
+    output_printf(out, "]\n");
+
+    output_printf(out, "          ");
+    if (score >= 80) output_printf(out, "%d/100 - EXCELLENT!\n", score);
+    else if (score >= 60) output_printf(out, "%d/100 - GOOD\n", score);
+    else if (score >= 40) output_printf(out, "%d/100 - FAIR\n", score);
+    else output_printf(out, "%d/100 - POOR\n", score);
+
+    output_line(out, '-', 50);
+}
+
+void display_trends(const RecordStore *store) {
+    display_trends_range(store, INT_MIN, INT_MAX);
+}
+
+// Show the last records dated from_day..to_day
+void display_trends_range(const RecordStore *store, int from_day, int to_day) {
+    char storage[OUTPUT_STACK_SIZE];
+    OutputBuffer out;
+    output_init(&out, storage, sizeof(storage));
+    render_trends(&out, store, from_day, to_day);
+    output_flush(&out, stdout);
+    output_free(&out);
+}
+
+void render_trends(OutputBuffer *out, const RecordStore *store, int from_day, int to_day) {
+    int first, last;
+    double started = profile_start();
+    store_find_days(store, from_day, to_day, &first, &last);
+
+    output_printf(out, "\n");
+    output_line(out, '=', 70);
+    output_printf(out, "                  HEALTH TRENDS\n");
+    output_line(out, '=', 70);
+
+    int display_count = (last - first > 10) ? 10 : last - first;
+    int start = last - display_count;
+
+    output_printf(out, "\nLast %d Records:\n", display_count);
+    output_line(out, '-', 70);
+    output_printf(out, "%-12s  HR   BP       Sugar  Temp   SpO2  Steps\n", "Date");
+    output_line(out, '-', 70);
+
+    for (int i = start; i < last; i++) {
+        HealthRecord record;
+        char date[DATE_LEN];
+        store_get(store, i, &record);
+        days_to_date(record.day, date);
+        output_printf(out, "%-12s  %3d  %3d/%-3d  %3d    %.1f   %2d%%  %5d\n",
+                      date,
+                      record.heart_rate,
+                      record.systolic_bp,
+                      record.diastolic_bp,
+                      record.blood_sugar,
+                      record.temperature,
+                      record.oxygen_level,
+                      record.steps);
+    }
+    output_line(out, '-', 70);
+
+    // Sliding-window view of the whole range
+    TrendReport trends;
+    if (last - first >= 2 && compute_trends(store, first, last, trend_window, (1u << VITAL_COUNT) - 1, &trends)) {
+        static const char *directions[] = { "falling", "steady", "rising" };
+        char from_date[DATE_LEN], to_date[DATE_LEN];
+
+        days_to_date(store_day(store, last - trends.window), from_date);
+        days_to_date(store_day(store, last - 1), to_date);
+        output_printf(out, "\nMoving Window: last %d records (%s to %s)\n", trends.window, from_date, to_date);
+        output_line(out, '-', 70);
+        output_printf(out, "%-14s %9s %9s %9s %11s   %s\n", "Vital", "Mean", "Min", "Max", "Slope/rec",
+                      "Trend");
+        output_line(out, '-', 70);
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            int decimals = (v == VITAL_TEMPERATURE) ? 1 : 0;
+            output_printf(out, "%-14s %9.1f %9.*f %9.*f %+11.2f   %s\n", vital_name((Vital)v), trends.mean[v],
+                          decimals, trends.min[v], decimals, trends.max[v], trends.slope[v],
+                          directions[trend_direction(&trends, (Vital)v) + 1]);
+        }
+        output_line(out, '-', 70);
+
+        if (trends.sample_count >= 2) {
+            days_to_date(store_day(store, trends.sample_record[0]), from_date);
+            output_printf(out, "\n%d-Record Moving Average, %s to %s:\n", trends.window, from_date, to_date);
+            output_line(out, '-', 70);
+            for (int v = 0; v < VITAL_COUNT; v++) {
+                output_printf(out, "%-14s", vital_name((Vital)v));
+                for (int k = 0; k < trends.sample_count; k++) {
+                    output_printf(out, (v == VITAL_STEPS) ? " %7.0f" : " %7.1f", trends.samples[v][k]);
+                }
+                output_printf(out, "\n");
+            }
+            output_line(out, '-', 70);
+        }
+    }
+
+    // Long ranges also get per-period averages, read from the rollups
+    // rather than the raw rows
+    if (store->rollups.enabled && last - first > 0) {
+        int span = store_day(store, last - 1) - store_day(store, first);
+        if (span >= TREND_MONTHLY_SPAN) render_rollups(out, store, PERIOD_MONTH, from_day, to_day);
+        else if (span >= TREND_WEEKLY_SPAN) render_rollups(out, store, PERIOD_WEEK, from_day, to_day);
+    }
+    profile_stop(STAGE_TRENDS, started);
+}
+
+// Means of every vital before split_day and from split_day on, within
+// from_day..to_day. Each figure is an O(1) prefix index lookup.
+void display_comparison(const RecordStore *store, int split_day, int from_day, int to_day) {
+    char storage[OUTPUT_STACK_SIZE];
+    OutputBuffer out;
+    output_init(&out, storage, sizeof(storage));
+    render_comparison(&out, store, split_day, from_day, to_day);
+    output_flush(&out, stdout);
+    output_free(&out);
+}
+
+void render_comparison(OutputBuffer *out, const RecordStore *store, int split_day, int from_day, int to_day) {
+    int first, split, last, start;
+    char date[DATE_LEN];
+    store_find_days(store, from_day, to_day, &first, &last);
+    store_find_days(store, INT_MIN, split_day - 1, &start, &split);
+    if (split < first) split = first;
+    if (split > last) split = last;
+
+    output_printf(out, "\n");
+    output_line(out, '=', 70);
+    output_printf(out, "                  BEFORE / AFTER COMPARISON\n");
+    output_line(out, '=', 70);
+
+    days_to_date(split_day, date);
+    output_printf(out, "\nSplit at %s: %d record(s) before, %d from then on\n", date, split - first,
+                  last - split);
+    output_line(out, '-', 70);
+    output_printf(out, "%-14s %22s %22s %9s\n", "Vital", "Before (mean +/- sd)", "After (mean +/- sd)",
+                  "Change");
+    output_line(out, '-', 70);
+
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        double before_mean, before_var, after_mean, after_var;
+        int has_before = store_range_moments(store, first, split, (Vital)v, &before_mean, &before_var);
+        int has_after = store_range_moments(store, split, last, (Vital)v, &after_mean, &after_var);
+        char before[32] = "-", after[32] = "-", change[16] = "-";
+        if (has_before) snprintf(before, sizeof(before), "%.1f +/- %.1f", before_mean, sqrt(before_var));
+        if (has_after) snprintf(after, sizeof(after), "%.1f +/- %.1f", after_mean, sqrt(after_var));
+        if (has_before && has_after) snprintf(change, sizeof(change), "%+.1f", after_mean - before_mean);
+        output_printf(out, "%-14s %22s %22s %9s\n", vital_name((Vital)v), before, after, change);
+    }
+    output_line(out, '-', 70);
+    output_printf(out, "Range index: %d records, %.1f MB (%d bytes per record)\n", store->prefix.count,
+                  store_prefix_bytes(store) / (1024.0 * 1024.0), (int)sizeof(PrefixEntry));
+}
+
+// Per-period averages of the periods that have records dated
+// from_day..to_day, read from the rollups (which must be enabled): the
+// latest ROLLUP_ROWS periods, then totals over all of them. The cost
+// depends on the number of periods, not of records.
+void display_rollups(const RecordStore *store, Period period, int from_day, int to_day) {
+    char storage[OUTPUT_STACK_SIZE];
+    OutputBuffer out;
+    output_init(&out, storage, sizeof(storage));
+    render_rollups(&out, store, period, from_day, to_day);
+    output_flush(&out, stdout);
+    output_free(&out);
+}
+
+void render_rollups(OutputBuffer *out, const RecordStore *store, Period period, int from_day, int to_day) {
+    static const char *titles[PERIOD_COUNT] = { "DAILY", "WEEKLY", "MONTHLY" };
+    const RollupLevel *level = &store->rollups.levels[period];
+    int first, last;
+    store_find_periods(store, period, from_day, to_day, &first, &last);
+
+    output_printf(out, "\n");
+    output_line(out, '=', 70);
+    output_printf(out, "                  %s SUMMARY\n", titles[period]);
+    output_line(out, '=', 70);
+    if (first == last) {
+        output_printf(out, "No records in the requested date range.\n");
+        return;
+    }
+
+    int shown = (last - first > ROLLUP_ROWS) ? ROLLUP_ROWS : last - first;
+    if (last - first > shown) {
+        output_printf(out, "\nAverages per period (latest %d of %d):\n", shown, last - first);
+    } else {
+        output_printf(out, "\nAverages per period:\n");
+    }
+    output_line(out, '-', 70);
+    output_printf(out, "%-14s %7s %5s %8s %6s %6s %5s %7s\n", "Period", "Records", "HR", "BP", "Sugar", "Temp",
+                  "SpO2", "Steps");
+    output_line(out, '-', 70);
+
+    for (int b = last - shown; b < last; b++) {
+        const RollupBucket *bucket = &level->buckets[b];
+        char date[DATE_LEN], label[DATE_LEN + 4];
+        days_to_date(bucket->start_day, date);
+        if (period == PERIOD_WEEK) snprintf(label, sizeof(label), "Wk %s", date);
+        else if (period == PERIOD_MONTH) snprintf(label, sizeof(label), "%.7s", date);
+        else snprintf(label, sizeof(label), "%s", date);
+
+        double n = bucket->count;
+        output_printf(out, "%-14s %7d %5.0f %4.0f/%-3.0f %6.0f %6.1f %5.0f %7.0f\n", label, bucket->count,
+                      bucket->sum[VITAL_HEART_RATE] / n, bucket->sum[VITAL_SYSTOLIC] / n,
+                      bucket->sum[VITAL_DIASTOLIC] / n, bucket->sum[VITAL_BLOOD_SUGAR] / n,
+                      bucket->sum[VITAL_TEMPERATURE] / n, bucket->sum[VITAL_OXYGEN] / n,
+                      bucket->sum[VITAL_STEPS] / n);
+    }
+    output_line(out, '-', 70);
+
+    // Totals over every period in range, hidden ones included
+    long long records = 0;
+    double sum[VITAL_COUNT] = {0};
+    float low[VITAL_COUNT], high[VITAL_COUNT];
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        low[v] = level->buckets[first].min[v];
+        high[v] = level->buckets[first].max[v];
+    }
+    for (int b = first; b < last; b++) {
+        const RollupBucket *bucket = &level->buckets[b];
+        records += bucket->count;
+        for (int v = 0; v < VITAL_COUNT; v++) {
+            sum[v] += bucket->sum[v];
+            if (bucket->min[v] < low[v]) low[v] = bucket->min[v];
+            if (bucket->max[v] > high[v]) high[v] = bucket->max[v];
+        }
+    }
+
+    char label[24];
+    snprintf(label, sizeof(label), "All %d", last - first);
+    output_printf(out, "%-14s %7lld %5.0f %4.0f/%-3.0f %6.0f %6.1f %5.0f %7.0f\n", label, records,
+                  sum[VITAL_HEART_RATE] / records, sum[VITAL_SYSTOLIC] / records,
+                  sum[VITAL_DIASTOLIC] / records, sum[VITAL_BLOOD_SUGAR] / records,
+                  sum[VITAL_TEMPERATURE] / records, sum[VITAL_OXYGEN] / records, sum[VITAL_STEPS] / records);
+    output_printf(out, "%-14s %7s %5.0f %4.0f/%-3.0f %6.0f %6.1f %5.0f %7.0f\n", "Lowest", "",
+                  low[VITAL_HEART_RATE], low[VITAL_SYSTOLIC], low[VITAL_DIASTOLIC], low[VITAL_BLOOD_SUGAR],
+                  low[VITAL_TEMPERATURE], low[VITAL_OXYGEN], low[VITAL_STEPS]);
+    output_printf(out, "%-14s %7s %5.0f %4.0f/%-3.0f %6.0f %6.1f %5.0f %7.0f\n", "Highest", "",
+                  high[VITAL_HEART_RATE], high[VITAL_SYSTOLIC], high[VITAL_DIASTOLIC], high[VITAL_BLOOD_SUGAR],
+                  high[VITAL_TEMPERATURE], high[VITAL_OXYGEN], high[VITAL_STEPS]);
+    output_line(out, '-', 70);
+    output_printf(out, "Rollups: %d daily, %d weekly, %d monthly period(s), %.1f MB\n",
+                  store->rollups.levels[PERIOD_DAY].count, store->rollups.levels[PERIOD_WEEK].count,
+                  store->rollups.levels[PERIOD_MONTH].count, store_rollup_bytes(store) / (1024.0 * 1024.0));
+}
+
+void generate_advice(const AlertLog *alerts) {
+    printf("\n");
+    print_line('=', 60);
+    printf("              PERSONALIZED HEALTH ADVICE\n");
+    print_line('=', 60);
+
+    unsigned categories = alerts->categories;
+    int has_heart_issue = (categories & CATEGORY_HEART) != 0;
+    int has_bp_issue = (categories & CATEGORY_BLOOD_PRESSURE) != 0;
+    int has_sugar_issue = (categories & CATEGORY_SUGAR) != 0;
+    int has_oxygen_issue = (categories & CATEGORY_OXYGEN) != 0;
+    int has_activity_issue = (categories & CATEGORY_ACTIVITY) != 0;
+
+    if (alerts->emitted == 0) {
+        printf("\n[SUCCESS] Excellent! Your health metrics are optimal.\n\n");
+        printf("General Wellness Tips:\n");
+        printf("  * Maintain your current healthy lifestyle\n");
+        printf("  * Stay hydrated (8 glasses of water daily)\n");
+        printf("  * Continue regular physical activity\n");
+        printf("  * Get 7-9 hours of quality sleep\n");
+        printf("  * Practice stress management techniques\n");
+        return;
+    }
+
+    printf("\nRECOMMENDED ACTIONS:\n");
+    print_line('-', 60);
+
+    if (has_heart_issue) {
+        printf("\nFor Heart Rate Issues:\n");
+        printf("  * Consult a cardiologist for proper evaluation\n");
+        printf("  * Practice deep breathing exercises\n");
+        printf("  * Reduce caffeine and stimulant intake\n");
+        printf("  * Manage stress through meditation or yoga\n");
+        printf("  * Ensure adequate sleep (7-9 hours)\n");
+    }
+
+    if (has_bp_issue) {
+        printf("\nFor Blood Pressure Issues:\n");
+        printf("  * Reduce sodium intake (<2300mg/day)\n");
+        printf("  * Eat more fruits, vegetables, and whole grains\n");
+        printf("  * Maintain healthy weight\n");
+        printf("  * Limit alcohol consumption\n");
+        printf("  * Exercise regularly (30 min/day, 5 days/week)\n");
+        printf("  * Monitor BP daily and keep a log\n");
+    }
+
+    if (has_sugar_issue) {
+        printf("\nFor Blood Sugar Issues:\n");
+        printf("  * Consult an endocrinologist\n");
+        printf("  * Follow a balanced, low-glycemic diet\n");
+        printf("  * Eat smaller, frequent meals\n");
+        printf("  * Increase fiber intake\n");
+        printf("  * Exercise regularly to improve insulin sensitivity\n");
+        printf("  * Monitor blood sugar levels consistently\n");
+    }
+
+    if (has_oxygen_issue) {
+        printf("\nFor Oxygen Level Issues:\n");
+        printf("  * [URGENT] SEEK IMMEDIATE MEDICAL ATTENTION if severe\n");
+        printf("  * Practice breathing exercises\n");
+        printf("  * Ensure proper ventilation in living spaces\n");
+        printf("  * Avoid smoking and secondhand smoke\n");
+        printf("  * Consider pulmonary function tests\n");
+    }
+
+    if (has_activity_issue) {
+        printf("\nFor Low Physical Activity:\n");
+        printf("  * Start with 10-minute walks, gradually increase\n");
+        printf("  * Take stairs instead of elevators\n");
+        printf("  * Set hourly reminders to stand and stretch\n");
+        printf("  * Find activities you enjoy (dancing, sports, etc.)\n");
+        printf("  * Use a fitness tracker for motivation\n");
+        printf("  * Aim for 10,000 steps per day\n");
+    }
+
+    printf("\n[IMPORTANT DISCLAIMER]\n");
+    printf("This is an automated analysis tool and NOT a substitute\n");
+    printf("for professional medical advice. Please consult healthcare\n");
+    printf("professionals for proper diagnosis and treatment.\n");
+}
+
+void add_manual_record(RecordStore *store, WriteAheadLog *wal) {
+    printf("\n");
+    print_line('=', 60);
+    printf("              ADD NEW HEALTH RECORD\n");
+    print_line('=', 60);
+
+    HealthRecord new_record = {0};
+    char date[DATE_LEN];
+
+    printf("\nEnter date (YYYY-MM-DD): ");
+    scanf("%19s", date);
+    if (!parse_date(date, date + strlen(date), &new_record.day)) {
+        printf("[ERROR] '%s' is not a valid date - record not added!\n", date);
+        return;
+    }
+
+    printf("Enter heart rate (BPM): ");
+    scanf("%d", &new_record.heart_rate);
+
+    printf("Enter systolic BP: ");
+    scanf("%d", &new_record.systolic_bp);
+
+    printf("Enter diastolic BP: ");
+    scanf("%d", &new_record.diastolic_bp);
+
+    printf("Enter blood sugar (mg/dL): ");
+    scanf("%d", &new_record.blood_sugar);
+
+    printf("Enter temperature (F): ");
+    scanf("%f", &new_record.temperature);
+
+    printf("Enter oxygen level (%%): ");
+    scanf("%d", &new_record.oxygen_level);
+
+    printf("Enter steps: ");
+    scanf("%d", &new_record.steps);
+
+    // Logged before it is applied: once the commit returns, the record
+    // survives a crash
+    int logged = wal_append(wal, &new_record) && wal_commit(wal);
+    if (!logged) {
+        printf("[WARNING] Could not save the record to the record log - it will be lost on exit.\n");
+    }
+
+    // The detectors start here if no analysis has switched them on yet
+    if (!store->detectors.enabled && !store_enable_detectors(store)) {
+        printf("[WARNING] Out of memory - the anomaly detectors are off.\n");
+    }
+    int in_order = store->count == 0 || new_record.day >= store_day(store, store->count - 1);
+    long long known_events = store->detectors.event_count;
+    // An earlier date than the last record goes into place; the store only
+    // changes if that worked
+    if (!store_insert(store, &new_record)) {
+        printf("[ERROR] Out of memory - record not added!%s\n",
+               logged ? " It is in the record log and comes back at the next load." : "");
+        return;
+    }
+
+    // The detectors have just seen the record; report what it set off. An
+    // earlier-dated record was re-run in its place with the others instead.
+    for (long long e = known_events; in_order && e < store->detectors.event_count; e++) {
+        Alert alert;
+        char message[256];
+        detector_alert(detector_event(&store->detectors, e), 1, &alert);
+        format_alert(&alert, NULL, store, message, sizeof(message));
+        printf("[WARNING] [%s] %s\n", severity_name(alert.severity), message);
+    }
+
+    printf("\n[SUCCESS] Record added successfully!\n");
+}
+
+// Put the logged manual records back into the store
+void restore_manual_records(const WriteAheadLog *wal, RecordStore *store) {
+    if (wal->count == 0) {
+        return;
+    }
+    if (!wal_restore(wal, store)) {
+        printf("[ERROR] Out of memory - manual records not restored.\n");
+        return;
+    }
+    printf("[SUCCESS] Restored %d manual record(s) from '%s'\n", wal->count, wal->path);
+}
+
+// After a load: move to the log of what the store now holds and restore its
+// records. A loaded input keeps its manual records in INPUT.wal; with
+// nothing loaded (the load failed) they go to default_log. So records
+// entered for one file never show up in another's analysis.
+void switch_manual_records(WriteAheadLog *wal, const char *input, const char *default_log, RecordStore *store) {
+    char path[MAX_PATH_LEN];
+    if (store->count == 0 ||
+        snprintf(path, sizeof(path), "%s%s", input, WAL_SUFFIX) >= (int)sizeof(path)) {
+        snprintf(path, sizeof(path), "%s", default_log);
+    }
+    if (strcmp(path, wal->path) != 0) {
+        wal_close(wal);
+        if (!wal_open(wal, path)) {
+            printf("[WARNING] '%s' is not a usable record log - manual records will not be saved.\n", path);
+        }
+    }
+    restore_manual_records(wal, store);
+}
+
+int export_report(HealthStats stats, const AlertLog *alerts, const RecordStore *store, ReportFormat format,
+                  const char *filename) {
+    if (!write_report_file(stats, alerts, store, format, filename)) {
+        printf("[ERROR] Failed to write report file.\n");
+        return 0;
+    }
+    printf("\n[SUCCESS] Report exported successfully to '%s'\n", filename);
+    return 1;
+}
+
+// Write the report without any console output; safe to call from workers.
+// REPORT_AUTO picks the format from the extension (.csv, .json, else text).
+int write_report_file(HealthStats stats, const AlertLog *alerts, const RecordStore *store,
+                      ReportFormat format, const char *filename) {
+    double started = profile_start();
+    char storage[OUTPUT_STACK_SIZE];
+    OutputBuffer out;
+    output_init(&out, storage, sizeof(storage));
+    if (format == REPORT_AUTO) format = report_format_for(filename);
+    render_report_as(&out, format, stats, alerts, store);
+    int ok = output_save(&out, filename);
+    output_free(&out);
+    profile_stop(STAGE_REPORT_EXPORT, started);
+    return ok;
+}
+
+ReportFormat report_format_for(const char *filename) {
+    if (has_extension(filename, ".csv")) return REPORT_CSV;
+    if (has_extension(filename, ".json")) return REPORT_JSON;
+    return REPORT_TEXT;
+}
+
+const char *report_extension(ReportFormat format) {
+    switch (format) {
+        case REPORT_CSV: return "csv";
+        case REPORT_JSON: return "json";
+        default: return "txt";
+    }
+}
+
+void render_report_as(OutputBuffer *out, ReportFormat format, HealthStats stats, const AlertLog *alerts,
+                      const RecordStore *store) {
+    switch (format) {
+        case REPORT_CSV: render_report_csv(out, stats, alerts, store); break;
+        case REPORT_JSON: render_report_json(out, stats, alerts, store); break;
+        default: render_report_text(out, stats, alerts, store); break;
+    }
+}
+
+// The exported text report
+void render_report_text(OutputBuffer *out, HealthStats stats, const AlertLog *alerts,
+                        const RecordStore *store) {
+    char timestamp[32];
+    format_timestamp(timestamp, sizeof(timestamp));
+
+    output_printf(out, "============================================================\n");
+    output_printf(out, "           SMART HEALTH MONITOR - ANALYSIS REPORT\n");
+    output_printf(out, "============================================================\n");
+    output_printf(out, "Generated: %s\n", timestamp);
+    output_printf(out, "Based on %d health records\n\n", stats.record_count);
+
+    output_printf(out, "VITAL STATISTICS SUMMARY\n");
+    output_printf(out, "------------------------------------------------------------\n");
+    output_printf(out, "Average Heart Rate:      %.0f BPM\n", stats.avg_heart_rate);
+    output_printf(out, "Average Blood Pressure:  %.0f/%.0f mmHg\n", stats.avg_systolic, stats.avg_diastolic);
+    output_printf(out, "Average Blood Sugar:     %.0f mg/dL\n", stats.avg_blood_sugar);
+    output_printf(out, "Average Temperature:     %.1f F\n", stats.avg_temperature);
+    output_printf(out, "Average Oxygen Level:    %.0f%%\n", stats.avg_oxygen);
+    output_printf(out, "Total Steps:             %lld steps\n", stats.total_steps);
+    output_printf(out, "Average Daily Steps:     %lld steps/day\n\n", stats.total_steps / stats.record_count);
+
+    output_printf(out, "VARIABILITY (Min / Max / Std Dev)\n");
+    output_printf(out, "------------------------------------------------------------\n");
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        const ColumnSummary *summary = &stats.vitals[v];
+        int decimals = (v == VITAL_TEMPERATURE) ? 1 : 0;
+        char label[32];
+        snprintf(label, sizeof(label), "%s:", vital_name((Vital)v));
+        output_printf(out, "%-25s%.*f / %.*f / %.1f\n", label,
+                decimals, summary->min, decimals, summary->max, summary_stddev(summary));
+    }
+    output_printf(out, "\n");
+
+    output_printf(out, "DISTRIBUTION (P50 / P90 / P99)\n");
+    output_printf(out, "------------------------------------------------------------\n");
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        const double *q = stats.quantiles[v];
+        int decimals = (v == VITAL_TEMPERATURE) ? 1 : 0;
+        char label[32];
+        snprintf(label, sizeof(label), "%s:", vital_name((Vital)v));
+        output_printf(out, "%-25s%.*f / %.*f / %.*f\n", label, decimals, q[QUANTILE_P50],
+                decimals, q[QUANTILE_P90], decimals, q[QUANTILE_P99]);
+    }
+    output_printf(out, "\n");
+
+    int health_score = calculate_health_score(stats);
+    output_printf(out, "OVERALL HEALTH SCORE: %d/100\n", health_score);
+    if (health_score >= 80) output_printf(out, "Status: EXCELLENT\n\n");
+    else if (health_score >= 60) output_printf(out, "Status: GOOD\n\n");
+    else if (health_score >= 40) output_printf(out, "Status: FAIR\n\n");
+    else output_printf(out, "Status: POOR - NEEDS ATTENTION\n\n");
+
+    if (alerts->count > 0) {
+        output_printf(out, "HEALTH ALERTS\n");
+        output_printf(out, "------------------------------------------------------------\n");
+        for (int i = 0; i < alerts->count; i++) {
+            const Alert *alert = alert_log_at(alerts, i);
+            char tag[16], message[256];
+            snprintf(tag, sizeof(tag), "[%s]", severity_name(alert->severity));
+            format_alert(alert, &stats, store, message, sizeof(message));
+            output_printf(out, "%-11s%s\n", tag, message);
+        }
+        if (alerts->dropped > 0) {
+            output_printf(out, "(%lld earlier alert(s) not shown; %lld raised in total)\n",
+                    alerts->dropped, alerts->emitted);
+        }
+        output_printf(out, "\n");
+    }
+
+    output_printf(out, "DISCLAIMER\n");
+    output_printf(out, "------------------------------------------------------------\n");
+    output_printf(out, "This report is generated by an automated analysis system\n");
+    output_printf(out, "and is NOT a substitute for professional medical advice.\n");
+    output_printf(out, "Please consult healthcare professionals for proper\n");
+    output_printf(out, "diagnosis and treatment.\n");
+    output_printf(out, "============================================================\n");
+}
+
+// Where an alert came from: its rule group, "trend" or the detector
+static const char *alert_source(const Alert *alert) {
+    static const char *detectors[DETECTOR_COUNT] = { "zscore", "ewma", "cusum" };
+    if (alert->kind == ALERT_TREND) return "trend";
+    if (alert->kind == ALERT_DETECTOR) return detectors[alert->rule];
+    return active_rules.groups[active_rules.rules[alert->rule].group];
+}
+
+static const char *score_status(int score) {
+    if (score >= 80) return "EXCELLENT";
+    if (score >= 60) return "GOOD";
+    if (score >= 40) return "FAIR";
+    return "POOR";
+}
+
+// One CSV table: a summary row, a row per vital, then a row per alert.
+// Columns that do not apply to a row are left empty.
+void render_report_csv(OutputBuffer *out, HealthStats stats, const AlertLog *alerts,
+                       const RecordStore *store) {
+    int score = calculate_health_score(stats);
+    output_printf(out, "type,vital,severity,source,date,count,value,min,max,stddev,p50,p90,p99,message\n");
+    output_printf(out, "summary,,,,,%d,%d,,,,,,,%s\n", stats.record_count, score, score_status(score));
+
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        const ColumnSummary *summary = &stats.vitals[v];
+        const double *q = stats.quantiles[v];
+        output_printf(out, "vital,%s,,,,%lld,%.6g,%.6g,%.6g,%.6g", vital_key((Vital)v), summary->count,
+                      summary_mean(summary), summary->min, summary->max, summary_stddev(summary));
+        for (int k = 0; k < QUANTILE_COUNT; k++) {
+            if (isnan(q[k])) output_printf(out, ",");
+            else output_printf(out, ",%.6g", q[k]);
+        }
+        output_printf(out, ",\n");
+    }
+
+    for (int i = 0; i < alerts->count; i++) {
+        const Alert *alert = alert_log_at(alerts, i);
+        char date[DATE_LEN] = "", message[256];
+        if (alert->record >= 0 && alert->record < store->count) {
+            days_to_date(store_day(store, alert->record), date);
+        }
+        format_alert(alert, &stats, store, message, sizeof(message));
+        output_printf(out, "alert,%s,%s,", vital_key((Vital)alert->vital), severity_name(alert->severity));
+        output_csv_field(out, alert_source(alert));
+        output_printf(out, ",%s,%d,%.6g,,,,,,,", date, alert->count, alert->value);
+        output_csv_field(out, message);
+        output_printf(out, "\n");
+    }
+}
+
+// The "vitals" object of the JSON report
+static void render_json_vitals(OutputBuffer *out, const HealthStats *stats) {
+    static const char *quantile_keys[QUANTILE_COUNT] = { "p50", "p90", "p99" };
+    output_printf(out, "  \"vitals\": {\n");
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        const ColumnSummary *summary = &stats->vitals[v];
+        output_printf(out, "    \"%s\": {\"mean\": %.6g, \"min\": %.6g, \"max\": %.6g, \"stddev\": %.6g",
+                      vital_key((Vital)v), summary_mean(summary), summary->min, summary->max,
+                      summary_stddev(summary));
+        for (int k = 0; k < QUANTILE_COUNT; k++) {
+            double q = stats->quantiles[v][k];
+            if (isnan(q)) output_printf(out, ", \"%s\": null", quantile_keys[k]);
+            else output_printf(out, ", \"%s\": %.6g", quantile_keys[k], q);
+        }
+        output_printf(out, "}%s\n", (v + 1 < VITAL_COUNT) ? "," : "");
+    }
+    output_printf(out, "  }");
+}
+
+// The alert counters and "alerts" array of the JSON report
+static void render_json_alerts(OutputBuffer *out, const HealthStats *stats, const AlertLog *alerts,
+                               const RecordStore *store) {
+    output_printf(out, "  \"alerts_raised\": %lld,\n  \"alerts_dropped\": %lld,\n  \"alerts\": [",
+                  alerts->emitted, alerts->dropped);
+    for (int i = 0; i < alerts->count; i++) {
+        const Alert *alert = alert_log_at(alerts, i);
+        char message[256];
+        format_alert(alert, stats, store, message, sizeof(message));
+        output_printf(out, "%s\n    {\"severity\": \"%s\", \"vital\": \"%s\", \"source\": ", i ? "," : "",
+                      severity_name(alert->severity), vital_key((Vital)alert->vital));
+        output_json_string(out, alert_source(alert));
+        if (alert->record >= 0 && alert->record < store->count) {
+            char date[DATE_LEN];
+            days_to_date(store_day(store, alert->record), date);
+            output_printf(out, ", \"date\": \"%s\"", date);
+        } else {
+            output_printf(out, ", \"date\": null");
+        }
+        output_printf(out, ", \"count\": %d, \"value\": %.6g, \"message\": ", alert->count, alert->value);
+        output_json_string(out, message);
+        output_printf(out, "}");
+    }
+    output_printf(out, "%s]", alerts->count ? "\n  " : "");
+}
+
+// The report as one JSON object
+void render_report_json(OutputBuffer *out, HealthStats stats, const AlertLog *alerts,
+                        const RecordStore *store) {
+    int score = calculate_health_score(stats);
+
+    output_printf(out, "{\n  \"records\": %d,\n  \"health_score\": %d,\n  \"status\": \"%s\",\n",
+                  stats.record_count, score, score_status(score));
+    render_json_vitals(out, &stats);
+    output_printf(out, ",\n");
+    render_json_alerts(out, &stats, alerts, store);
+    output_printf(out, "\n}\n");
+}
+
+// Same text as ctime(), without its shared static buffer
+void format_timestamp(char *buffer, size_t size) {
+    static const char days[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static const char months[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    time_t now = time(NULL);
+    struct tm local;
+#ifndef _WIN32
+    localtime_r(&now, &local);
+#else
+    localtime_s(&local, &now);
+#endif
+    snprintf(buffer, size, "%.3s %.3s%3d %.2d:%.2d:%.2d %d\n",
+             days[local.tm_wday], months[local.tm_mon], local.tm_mday,
+             local.tm_hour, local.tm_min, local.tm_sec, 1900 + local.tm_year);
+}
+
+const char *severity_name(int severity) {
+    switch (severity) {
+        case 4: return "CRITICAL";
+        case 3: return "HIGH";
+        case 2: return "MEDIUM";
+        case 1: return "LOW";
+        default: return "NONE";
+    }
+}
+
+void create_sample_data() {
+    printf("\n");
+    print_line('=', 60);
+    printf("              CREATE SAMPLE DATA FILE\n");
+    print_line('=', 60);
+
+    printf("\nSelect format:\n");
+    printf("1. CSV Format\n");
+    printf("2. TXT Format\n");
+    printf("\nEnter choice: ");
+
+    int choice;
+    scanf("%d", &choice);
+    getchar();
+
+    if (choice == 1) {
+        FILE *file = fopen("sample_health_data.csv", "w");
+        if (!file) {
+            printf("[ERROR] Failed to create file.\n");
+            return;
+        }
+
+        // Write header
+        fprintf(file, "Date,HeartRate,SystolicBP,DiastolicBP,BloodSugar,Temperature,OxygenLevel,Steps\n");
+
+        // Write 7 days of data
+        fprintf(file, "2025-10-26,72,118,78,95,98.2,98,8500\n");
+        fprintf(file, "2025-10-27,75,120,80,102,98.4,97,9200\n");
+        fprintf(file, "2025-10-28,78,122,82,98,98.6,98,7800\n");
+        fprintf(file, "2025-10-29,115,145,95,180,99.1,96,4500\n");
+        fprintf(file, "2025-10-30,118,148,96,185,99.3,95,4200\n");
+        fprintf(file, "2025-10-31,120,150,98,190,99.5,94,3800\n");
+        fprintf(file, "2025-11-01,122,152,99,195,99.8,93,3500\n");
+
+        fclose(file);
+        printf("[SUCCESS] Sample CSV created: sample_health_data.csv\n");
+        printf("File location: In your project's bin/Debug folder\n");
+        printf("This file contains 7 days of health data.\n");
+
+    } else if (choice == 2) {
+        FILE *file = fopen("sample_health_data.txt", "w");
+        if (!file) {
+            printf("[ERROR] Failed to create file.\n");
+            return;
+        }
+
+        // Record 1
+        fprintf(file, "Date: 2025-10-26\n");
+        fprintf(file, "Heart Rate: 72\n");
+        fprintf(file, "Blood Pressure: 118/78\n");
+        fprintf(file, "Blood Sugar: 95\n");
+        fprintf(file, "Temperature: 98.2\n");
+        fprintf(file, "Oxygen Level: 98\n");
+        fprintf(file, "Steps: 8500\n");
+        fprintf(file, "\n");
+
+        // Record 2
+        fprintf(file, "Date: 2025-10-27\n");
+        fprintf(file, "Heart Rate: 75\n");
+        fprintf(file, "Blood Pressure: 120/80\n");
+        fprintf(file, "Blood Sugar: 102\n");
+        fprintf(file, "Temperature: 98.4\n");
+        fprintf(file, "Oxygen Level: 97\n");
+        fprintf(file, "Steps: 9200\n");
+        fprintf(file, "\n");
+
+        // Record 3
+        fprintf(file, "Date: 2025-10-28\n");
+        fprintf(file, "Heart Rate: 78\n");
+        fprintf(file, "Blood Pressure: 122/82\n");
+        fprintf(file, "Blood Sugar: 98\n");
+        fprintf(file, "Temperature: 98.6\n");
+        fprintf(file, "Oxygen Level: 98\n");
+        fprintf(file, "Steps: 7800\n");
+        fprintf(file, "\n");
+
+        // Record 4
+        fprintf(file, "Date: 2025-10-29\n");
+        fprintf(file, "Heart Rate: 115\n");
+        fprintf(file, "Blood Pressure: 145/95\n");
+        fprintf(file, "Blood Sugar: 180\n");
+        fprintf(file, "Temperature: 99.1\n");
+        fprintf(file, "Oxygen Level: 96\n");
+        fprintf(file, "Steps: 4500\n");
+        fprintf(file, "\n");
+
+        // Record 5
+        fprintf(file, "Date: 2025-10-30\n");
+        fprintf(file, "Heart Rate: 118\n");
+        fprintf(file, "Blood Pressure: 148/96\n");
+        fprintf(file, "Blood Sugar: 185\n");
+        fprintf(file, "Temperature: 99.3\n");
+        fprintf(file, "Oxygen Level: 95\n");
+        fprintf(file, "Steps: 4200\n");
+        fprintf(file, "\n");
+
+        // Record 6
+        fprintf(file, "Date: 2025-10-31\n");
+        fprintf(file, "Heart Rate: 120\n");
+        fprintf(file, "Blood Pressure: 150/98\n");
+        fprintf(file, "Blood Sugar: 190\n");
+        fprintf(file, "Temperature: 99.5\n");
+        fprintf(file, "Oxygen Level: 94\n");
+        fprintf(file, "Steps: 3800\n");
+        fprintf(file, "\n");
+
+        // Record 7
+        fprintf(file, "Date: 2025-11-01\n");
+        fprintf(file, "Heart Rate: 122\n");
+        fprintf(file, "Blood Pressure: 152/99\n");
+        fprintf(file, "Blood Sugar: 195\n");
+        fprintf(file, "Temperature: 99.8\n");
+        fprintf(file, "Oxygen Level: 93\n");
+        fprintf(file, "Steps: 3500\n");
+
+        fclose(file);
+        printf("[SUCCESS] Sample TXT created: sample_health_data.txt\n");
+        printf("File location: In your project's bin/Debug folder\n");
+        printf("This file contains 7 days of health data.\n");
+    } else {
+        printf("[ERROR] Invalid choice.\n");
+    }
+}
+
+uint64_t synth_next(SynthRng *rng) {
+    uint64_t z = (rng->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1) with 53 random bits
+double synth_uniform(SynthRng *rng) {
+    return (double)(synth_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Standard normal (Box-Muller; one value per call keeps the stream simple)
+double synth_normal(SynthRng *rng) {
+    double u1 = 1.0 - synth_uniform(rng); // (0, 1], safe for log()
+    double u2 = synth_uniform(rng);
+    return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+// Days since 1970-01-01 to year, month and day of month (proleptic
+// Gregorian calendar)
+void civil_from_days(long long days, int *year, int *month, int *mday) {
+    long long z = days + 719468;
+    long long era = (z >= 0 ? z : z - 146096) / 146097;
+    long long doe = z - era * 146097;
+    long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long long mp = (5 * doy + 2) / 153;
+    *mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *year = (int)(yoe + era * 400 + (*month <= 2));
+}
+
+// The inverse of civil_from_days(); the date must be valid
+int days_from_civil(int year, int month, int mday) {
+    // Years start in March, so the leap day is the last day of the year
+    int y = year - (month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + mday - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Days since 1970-01-01 to "YYYY-MM-DD"
+void days_to_date(long long days, char *date) {
+    int year, month, mday;
+    civil_from_days(days, &year, &month, &mday);
+    snprintf(date, DATE_LEN, "%04u-%02u-%02u", (unsigned)year % 10000, (unsigned)month % 13,
+             (unsigned)mday % 32);
+}
+
+// "YYYY-MM-DD" in [p, end) to days since 1970-01-01; the inverse of
+// days_to_date(). Returns 0 unless the text is exactly a valid date.
+int parse_date(const char *p, const char *end, int *day) {
+    static const int month_days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    int digits[8], k = 0;
+
+    if (end - p != 10 || p[4] != '-' || p[7] != '-') {
+        return 0;
+    }
+    for (int i = 0; i < 10; i++) {
+        if (i == 4 || i == 7) continue;
+        if (p[i] < '0' || p[i] > '9') return 0;
+        digits[k++] = p[i] - '0';
+    }
+
+    int year = digits[0] * 1000 + digits[1] * 100 + digits[2] * 10 + digits[3];
+    int month = digits[4] * 10 + digits[5];
+    int mday = digits[6] * 10 + digits[7];
+    int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month < 1 || month > 12 || mday < 1 ||
+        mday > month_days[month - 1] + (month == 2 && leap)) {
+        return 0;
+    }
+
+    *day = days_from_civil(year, month, mday);
+    return 1;
+}
+
+static double clamp(double value, double low, double high) {
+    return value < low ? low : (value > high ? high : value);
+}
+
+// Normal noise of standard deviation sigma, cut off at SYNTH_NOISE_LIMIT
+// so that healthy days stay healthy however many are generated
+static double synth_noise(SynthRng *rng, double sigma) {
+    return sigma * clamp(synth_normal(rng), -SYNTH_NOISE_LIMIT, SYNTH_NOISE_LIMIT);
+}
+
+void synth_init(SynthPatient *patient, uint64_t seed, long long count, double anomaly_rate) {
+    memset(patient, 0, sizeof(*patient));
+    patient->rng.state = seed;
+    patient->count = count;
+    patient->span_days = (count < SYNTH_MAX_DAYS) ? count : SYNTH_MAX_DAYS;
+    patient->anomaly_rate = anomaly_rate;
+
+    // Personal baselines, roughly adult population distributions. With the
+    // drift and noise of synth_next_record() they keep every reading inside
+    // the record rules' limits, so only anomaly episodes cross them.
+    SynthRng *rng = &patient->rng;
+    patient->base_heart_rate = clamp(72 + 7 * synth_normal(rng), 60, 95);
+    patient->base_systolic = clamp(120 + 10 * synth_normal(rng), 100, 145);
+    patient->base_diastolic = clamp(0.6 * patient->base_systolic + 6 + 5 * synth_normal(rng), 60, 92);
+    patient->base_blood_sugar = clamp(98 + 10 * synth_normal(rng), 90, 130);
+    patient->base_temperature = clamp(98.4 + 0.3 * synth_normal(rng), 97.5, 99.2);
+    patient->base_oxygen = clamp(97.5 + 0.8 * synth_normal(rng), 95, 99.5);
+    patient->base_steps = clamp(7500 + 2500 * synth_normal(rng), 1500, 16000);
+
+    patient->heart_rate = patient->base_heart_rate;
+    patient->systolic = patient->base_systolic;
+    patient->blood_sugar = patient->base_blood_sugar;
+    patient->steps = patient->base_steps;
+}
+
+// Next day's record: drifting baselines, daily noise and anomaly episodes
+void synth_next_record(SynthPatient *patient, HealthRecord *record) {
+    SynthRng *rng = &patient->rng;
+
+    // Mean-reverting drift so long series wander without running away,
+    // kept within a band around the baseline
+    patient->heart_rate += 0.05 * (patient->base_heart_rate - patient->heart_rate) + 0.6 * synth_normal(rng);
+    patient->systolic += 0.05 * (patient->base_systolic - patient->systolic) + 0.8 * synth_normal(rng);
+    patient->blood_sugar += 0.05 * (patient->base_blood_sugar - patient->blood_sugar) + 1.0 * synth_normal(rng);
+    patient->steps += 0.05 * (patient->base_steps - patient->steps) + 150 * synth_normal(rng);
+    patient->heart_rate = clamp(patient->heart_rate, patient->base_heart_rate - 5, patient->base_heart_rate + 5);
+    patient->systolic = clamp(patient->systolic, patient->base_systolic - 8, patient->base_systolic + 8);
+    patient->blood_sugar = clamp(patient->blood_sugar, patient->base_blood_sugar - 10, patient->base_blood_sugar + 10);
+
+    double heart_rate = patient->heart_rate + synth_noise(rng, 5);
+    double systolic_noise = synth_noise(rng, 7);
+    double systolic = patient->systolic + systolic_noise;
+    double diastolic = patient->base_diastolic + 0.5 * (patient->systolic - patient->base_systolic) +
+                       0.6 * systolic_noise + synth_noise(rng, 3);
+    double blood_sugar = patient->blood_sugar + synth_noise(rng, 8);
+    double temperature = patient->base_temperature + synth_noise(rng, 0.25);
+    double oxygen = patient->base_oxygen + synth_noise(rng, 0.8);
+    double steps = patient->steps * (1 + synth_noise(rng, 0.3));
+
+    // Start a new episode, or continue the current one
+    if (patient->anomaly_days == 0 && synth_uniform(rng) < patient->anomaly_rate) {
+        patient->anomaly = (AnomalyType)(1 + synth_next(rng) % (ANOMALY_COUNT - 1));
+        patient->anomaly_days = 1 + (int)(synth_next(rng) % 5);
+        patient->episodes++;
+    }
+    if (patient->anomaly_days > 0) {
+        switch (patient->anomaly) {
+            case ANOMALY_TACHYCARDIA: heart_rate += 35 + 10 * synth_uniform(rng); break;
+            case ANOMALY_HYPERTENSION: systolic += 30; diastolic += 15; break;
+            case ANOMALY_HYPERGLYCEMIA: blood_sugar += 80 + 40 * synth_uniform(rng); break;
+            case ANOMALY_FEVER: temperature += 2.0 + synth_uniform(rng); heart_rate += 10; break;
+            case ANOMALY_HYPOXIA: oxygen -= 6 + 4 * synth_uniform(rng); break;
+            case ANOMALY_SEDENTARY: steps *= 0.2; break;
+            default: break;
+        }
+        if (--patient->anomaly_days == 0) {
+            patient->anomaly = ANOMALY_NONE;
+        }
+    }
+
+    memset(record, 0, sizeof(*record));
+    // One record per day while dates last, then several per day
+    record->day = (int)(SYNTH_START_DAY + patient->index * patient->span_days / patient->count);
+    record->heart_rate = (int)lround(clamp(heart_rate, 35, 220));
+    record->systolic_bp = (int)lround(clamp(systolic, 70, 240));
+    record->diastolic_bp = (int)lround(clamp(diastolic, 40, systolic - 10));
+    record->blood_sugar = (int)lround(clamp(blood_sugar, 40, 500));
+    // Same value the loaders produce for a one-decimal field
+    record->temperature = (float)(lround(clamp(temperature, 94.0, 106.0) * 10) / 10.0);
+    record->oxygen_level = (int)lround(clamp(oxygen, 70, 100));
+    record->steps = (int)lround(clamp(steps, 0, 60000));
+    patient->index++;
+}
+
+// Write count synthetic records as CSV, TXT, .shm or .shz. The same seed
+// always gives the same file.
+int generate_dataset(const char *filename, InputFormat format, long long count,
+                     uint64_t seed, double anomaly_rate, long long *episodes) {
+    SynthPatient patient;
+    HealthRecord record;
+
+    if (format == FORMAT_AUTO) {
+        if (has_extension(filename, ".txt")) format = FORMAT_TXT;
+        else if (has_extension(filename, ".shm")) format = FORMAT_SHM;
+        else if (has_extension(filename, ".shz")) format = FORMAT_SHZ;
+        else format = FORMAT_CSV;
+    }
+    synth_init(&patient, seed, count, anomaly_rate);
+
+    if (format == FORMAT_SHM || format == FORMAT_SHZ) {
+        // Columnar files are written from a store, so they are limited to
+        // what one store can hold
+        if (count > INT_MAX) {
+            return 0;
+        }
+        RecordStore store;
+        store_init(&store);
+        int ok = 1;
+        for (long long i = 0; ok && i < count; i++) {
+            synth_next_record(&patient, &record);
+            ok = store_append(&store, &record);
+        }
+        ok = ok && (format == FORMAT_SHZ ? export_shz_data(&store, filename)
+                                         : export_shm_data(&store, filename));
+        store_free(&store);
+        if (episodes) *episodes = patient.episodes;
+        return ok;
+    }
+
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return 0;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    if (format == FORMAT_CSV) {
+        fprintf(file, "Date,HeartRate,SystolicBP,DiastolicBP,BloodSugar,Temperature,OxygenLevel,Steps\n");
+    }
+    for (long long i = 0; i < count; i++) {
+        char date[DATE_LEN];
+        synth_next_record(&patient, &record);
+        days_to_date(record.day, date);
+        if (format == FORMAT_CSV) {
+            fprintf(file, "%s,%d,%d,%d,%d,%.1f,%d,%d\n", date, record.heart_rate,
+                    record.systolic_bp, record.diastolic_bp, record.blood_sugar,
+                    record.temperature, record.oxygen_level, record.steps);
+        } else {
+            fprintf(file, "%sDate: %s\nHeart Rate: %d\nBlood Pressure: %d/%d\nBlood Sugar: %d\n"
+                    "Temperature: %.1f\nOxygen Level: %d\nSteps: %d\n", i ? "\n" : "",
+                    date, record.heart_rate, record.systolic_bp, record.diastolic_bp,
+                    record.blood_sugar, record.temperature, record.oxygen_level, record.steps);
+        }
+    }
+
+    int ok = !ferror(file);
+    if (fclose(file) != 0) ok = 0;
+    if (!ok) remove(filename);
+    if (episodes) *episodes = patient.episodes;
+    return ok;
+}
+
+int run_generate(const BatchOptions *options) {
+    long long episodes = 0;
+    if (!generate_dataset(options->output, options->format, options->generate,
+                          options->seed, options->anomaly_rate, &episodes)) {
+        fprintf(stderr, "[ERROR] Failed to generate '%s'.\n", options->output);
+        return EXIT_EXPORT_FAILED;
+    }
+    printf("[SUCCESS] Generated %lld records with %lld anomaly episode(s) in '%s' (seed %llu)\n",
+           options->generate, episodes, options->output, (unsigned long long)options->seed);
+    return EXIT_OK;
+}
+
+void stream_init(StreamMonitor *monitor) {
+    memset(monitor, 0, sizeof(*monitor));
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        summary_init(&monitor->stats.vitals[v]);
+    }
+    monitor->sketch = malloc(sizeof(QuantileSketch));
+    if (monitor->sketch) sketch_init(monitor->sketch);
+    alert_log_init(&monitor->alerts);
+    for (int g = 0; g < MAX_RULES; g++) {
+        monitor->record_rule[g] = -1;
+        monitor->average_rule[g] = -1;
+    }
+    monitor->started = monotonic_seconds();
+}
+
+void stream_free(StreamMonitor *monitor) {
+    free(monitor->sketch);
+    monitor->sketch = NULL;
+}
+
+// Keep the alert and print it straight away
+static void stream_emit(StreamMonitor *monitor, const Alert *alert, const char *date, OutputBuffer *out) {
+    char message[256];
+    alert_log_push(&monitor->alerts, alert);
+    format_alert_dated(alert, &monitor->stats, date, message, sizeof(message));
+    output_printf(out, "[WARNING] [%s] %s\n", severity_name(alert->severity), message);
+}
+
+// One line of CSV input: a record, the header, a blank line or a reject
+void stream_line(StreamMonitor *monitor, const char *line, const char *end, OutputBuffer *out) {
+    const char *cr = memchr(line, '\r', (size_t)(end - line));
+    if (cr) end = cr;
+    if (end - line < 5) {
+        return;
+    }
+
+    HealthRecord record = {0};
+    if (parse_csv_row(line, end, &record) < 5) {
+        // A header (sources may start with one) is not an error
+        if (memcmp(line, "Date,", 5) != 0) monitor->rejected++;
+        return;
+    }
+    stream_record(monitor, &record, out);
+}
+
+// Fold one record into the statistics and run the detectors and record
+// rules on it, printing any alert it raises. O(vitals + rules).
+// A record rule alerts when a reading starts to match it, not again for
+// each reading while it keeps matching.
+void stream_record(StreamMonitor *monitor, const HealthRecord *record, OutputBuffer *out) {
+    const void *fields[VITAL_COUNT] = {
+        &record->heart_rate, &record->systolic_bp, &record->diastolic_bp, &record->blood_sugar,
+        &record->temperature, &record->oxygen_level, &record->steps
+    };
+    double values[VITAL_COUNT];
+    char date[DATE_LEN];
+    days_to_date(record->day, date);
+
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        double x = (v == VITAL_TEMPERATURE) ? *(const float *)fields[v] : *(const int *)fields[v];
+        values[v] = x;
+        summary_add_block(&monitor->stats.vitals[v], 1, x, x * x, x, x);
+        if (monitor->sketch) sketch_add_column(&monitor->sketch->vitals[v], fields[v], (Vital)v, 1);
+    }
+    // Averages in alert messages include this record
+    statistics_finish(&monitor->stats, NULL);
+
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        DetectorEvent events[DETECTOR_COUNT];
+        int raised = detector_step(&monitor->detectors[v], (Vital)v, values[v], events);
+        for (int e = 0; e < raised; e++) {
+            Alert alert;
+            events[e].record = -1;
+            events[e].vital = (uint8_t)v;
+            events[e].value = (float)values[v];
+            detector_alert(&events[e], 1, &alert);
+            stream_emit(monitor, &alert, date, out);
+        }
+        detector_remember(&monitor->detectors[v], values[v]);
+    }
+
+    // First matching record rule of each group, as in rule_alerts()
+    int matched[MAX_RULES];
+    for (int g = 0; g < active_rules.group_count; g++) {
+        matched[g] = -1;
+    }
+    for (int r = 0; r < active_rules.count; r++) {
+        const Rule *rule = &active_rules.rules[r];
+        if (rule->scope != RULE_RECORD || !rule_matches(rule, values[rule->vital])) {
+            continue;
+        }
+        monitor->rule_hits[r]++;
+        if (matched[rule->group] < 0) matched[rule->group] = r;
+    }
+    for (int g = 0; g < active_rules.group_count; g++) {
+        int r = matched[g];
+        if (r >= 0 && r != monitor->record_rule[g]) {
+            const Rule *rule = &active_rules.rules[r];
+            Alert alert;
+            alert.kind = ALERT_RULE;
+            alert.severity = (uint8_t)rule->severity;
+            alert.vital = (uint8_t)rule->vital;
+            alert.rule = (uint8_t)r;
+            alert.record = -1;
+            alert.count = (int)(monitor->rule_hits[r] < INT_MAX ? monitor->rule_hits[r] : INT_MAX);
+            alert.value = (float)values[rule->vital];
+            stream_emit(monitor, &alert, date, out);
+        }
+        monitor->record_rule[g] = r;
+    }
+}
+
+// Average rules against the running averages; like record rules they
+// alert when they start to apply
+void stream_check_averages(StreamMonitor *monitor, OutputBuffer *out) {
+    const HealthStats *stats = &monitor->stats;
+    if (stats->vitals[VITAL_HEART_RATE].count == 0) {
+        return;
+    }
+    for (int g = 0; g < active_rules.group_count; g++) {
+        int matched = -1;
+        for (int r = 0; r < active_rules.count && matched < 0; r++) {
+            const Rule *rule = &active_rules.rules[r];
+            if (rule->group == g && rule->scope == RULE_AVERAGE &&
+                rule_matches(rule, stats_average(stats, rule->vital))) {
+                matched = r;
+            }
+        }
+        if (matched >= 0 && matched != monitor->average_rule[g]) {
+            const Rule *rule = &active_rules.rules[matched];
+            Alert alert;
+            alert.kind = ALERT_RULE;
+            alert.severity = (uint8_t)rule->severity;
+            alert.vital = (uint8_t)rule->vital;
+            alert.rule = (uint8_t)matched;
+            alert.record = -1;
+            alert.count = stats->record_count;
+            alert.value = (float)stats_average(stats, rule->vital);
+            stream_emit(monitor, &alert, NULL, out);
+        }
+        monitor->average_rule[g] = matched;
+    }
+}
+
+// Records so far, alert totals and per-vital statistics with percentiles
+void render_stream_summary(OutputBuffer *out, StreamMonitor *monitor) {
+    HealthStats *stats = &monitor->stats;
+    long long records = stats->vitals[VITAL_HEART_RATE].count;
+    double elapsed = monotonic_seconds() - monitor->started;
+    statistics_finish(stats, monitor->sketch);
+
+    output_printf(out, "\n");
+    output_line(out, '=', 72);
+    output_printf(out, "              LIVE STREAM SUMMARY\n");
+    output_line(out, '=', 72);
+    output_printf(out, "Records: %lld   Rejected lines: %lld   Rate: %.0f records/s\n", records,
+                  monitor->rejected, elapsed > 0 ? records / elapsed : 0.0);
+    output_printf(out, "Alerts: %lld raised, highest severity %s\n", monitor->alerts.emitted,
+                  severity_name(monitor->alerts.max_severity));
+    if (records == 0) {
+        output_line(out, '=', 72);
+        return;
+    }
+    output_line(out, '-', 72);
+    output_printf(out, "%-14s %9s %9s %9s %9s %9s %9s\n", "Vital", "Mean", "Min", "Max", "p50", "p90", "p99");
+    output_line(out, '-', 72);
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        const ColumnSummary *summary = &stats->vitals[v];
+        int decimals = (v == VITAL_TEMPERATURE) ? 1 : 0;
+        output_printf(out, "%-14s %9.1f %9.*f %9.*f", vital_name((Vital)v), summary_mean(summary),
+                      decimals, summary->min, decimals, summary->max);
+        for (int q = 0; q < QUANTILE_COUNT; q++) {
+            if (isnan(stats->quantiles[v][q])) output_printf(out, " %9s", "-");
+            else output_printf(out, " %9.*f", decimals, stats->quantiles[v][q]);
+        }
+        output_printf(out, "\n");
+    }
+    output_line(out, '-', 72);
+    int score = calculate_health_score(*stats);
+    output_printf(out, "Health score: %d/100 (%s)\n", score, score_status(score));
+    output_line(out, '=', 72);
+}
+
+#ifndef _WIN32
+static volatile sig_atomic_t stream_stop = 0;
+
+static void stream_on_signal(int signal_number) {
+    (void)signal_number;
+    stream_stop = 1;
+}
+
+// Split what a source delivered into lines. Complete lines are parsed
+// where they lie; only a line cut by the end of a read is copied.
+static void stream_feed(StreamMonitor *monitor, StreamSource *source, const char *data, size_t size,
+                        OutputBuffer *out) {
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end) {
+        const char *newline = memchr(p, '\n', (size_t)(end - p));
+        const char *stop = newline ? newline : end;
+        if (newline && source->length == 0 && !source->overlong) {
+            stream_line(monitor, p, newline, out);
+            p = newline + 1;
+            continue;
+        }
+
+        size_t n = (size_t)(stop - p);
+        if (!source->overlong && source->length + n >= MAX_LINE) {
+            source->overlong = 1;
+            monitor->rejected++;
+        }
+        if (!source->overlong) {
+            memcpy(source->line + source->length, p, n);
+            source->length += n;
+        }
+        if (!newline) {
+            break;
+        }
+        if (!source->overlong) stream_line(monitor, source->line, source->line + source->length, out);
+        source->length = 0;
+        source->overlong = 0;
+        p = newline + 1;
+    }
+}
+
+// Listening Unix socket at path; a socket left there by an earlier run is
+// replaced, anything else is not touched
+static int stream_listen(const char *path) {
+    struct sockaddr_un address;
+    struct stat info;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, STREAM_MAX_CLIENTS) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+// Streaming mode: read CSV records as they arrive and alert at once.
+// Sources are stdin ("-"), a FIFO (reopened for each new writer) or file,
+// or a Unix socket (unix:PATH) that accepts up to STREAM_MAX_CLIENTS
+// gateways at a time. Runs until the input ends or SIGINT/SIGTERM.
+int run_stream(const BatchOptions *options) {
+    static char chunk[STREAM_READ_SIZE];
+    static StreamSource sources[STREAM_MAX_CLIENTS];
+    StreamMonitor monitor;
+    char storage[OUTPUT_STACK_SIZE];
+    OutputBuffer out;
+    int source_count = 0;
+    int status = EXIT_OK;
+
+    stream_init(&monitor);
+    output_init(&out, storage, sizeof(storage));
+
+#ifndef _WIN32
+    const char *socket_path = NULL;
+    int listener = -1, fifo = 0;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stream_on_signal; // no SA_RESTART: poll() returns at once
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    if (strcmp(options->stream, "-") == 0) {
+        sources[source_count++].fd = STDIN_FILENO;
+    } else if (strncmp(options->stream, "unix:", 5) == 0) {
+        socket_path = options->stream + 5;
+        listener = stream_listen(socket_path);
+        if (listener < 0) {
+            fprintf(stderr, "[ERROR] Cannot listen on '%s': %s\n", socket_path, strerror(errno));
+            stream_free(&monitor);
+            return EXIT_LOAD_FAILED;
+        }
+    } else {
+        struct stat info;
+        int fd = open(options->stream, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "[ERROR] Cannot open '%s': %s\n", options->stream, strerror(errno));
+            stream_free(&monitor);
+            return EXIT_LOAD_FAILED;
+        }
+        fifo = fstat(fd, &info) == 0 && S_ISFIFO(info.st_mode);
+        sources[source_count++].fd = fd;
+    }
+    fprintf(stderr, "[SUCCESS] Streaming records from %s\n", options->stream);
+
+    double interval = options->summary_every;
+    double next_summary = (interval > 0) ? monotonic_seconds() + interval : INFINITY;
+    while (!stream_stop && (source_count > 0 || listener >= 0)) {
+        struct pollfd fds[1 + STREAM_MAX_CLIENTS];
+        int first = 0, n = 0;
+        if (listener >= 0) {
+            fds[n].fd = listener;
+            fds[n++].events = POLLIN;
+            first = 1;
+        }
+        for (int i = 0; i < source_count; i++) {
+            fds[n].fd = sources[i].fd;
+            fds[n++].events = POLLIN;
+        }
+
+        int timeout = -1;
+        if (interval > 0) {
+            double wait = next_summary - monotonic_seconds();
+            timeout = (wait > 0) ? (int)(wait * 1000.0) + 1 : 0;
+        }
+        int ready = poll(fds, (nfds_t)n, timeout);
+        if (ready < 0 && errno != EINTR) {
+            fprintf(stderr, "[ERROR] Waiting for input failed: %s\n", strerror(errno));
+            status = EXIT_LOAD_FAILED;
+            break;
+        }
+
+        for (int k = first; ready > 0 && k < n; k++) {
+            StreamSource *source = &sources[k - first];
+            if (!fds[k].revents) {
+                continue;
+            }
+            ssize_t got = read(source->fd, chunk, sizeof(chunk));
+            if (got < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            if (got > 0) {
+                stream_feed(&monitor, source, chunk, (size_t)got, &out);
+                continue;
+            }
+
+            // End of this source; a last line without a newline still counts
+            if (source->length > 0 && !source->overlong) {
+                stream_line(&monitor, source->line, source->line + source->length, &out);
+            }
+            if (source->fd != STDIN_FILENO) close(source->fd);
+            source->fd = -1;
+            source->length = 0;
+            source->overlong = 0;
+        }
+
+        // Drop finished sources; a FIFO waits for its next writer
+        int kept = 0;
+        for (int i = 0; i < source_count; i++) {
+            if (sources[i].fd >= 0) sources[kept++] = sources[i];
+        }
+        source_count = kept;
+        if (fifo && source_count == 0 && !stream_stop) {
+            stream_check_averages(&monitor, &out);
+            output_flush(&out, stdout);
+            int fd = open(options->stream, O_RDONLY); // blocks until a writer opens it
+            while (fd < 0 && errno == EINTR && !stream_stop) fd = open(options->stream, O_RDONLY);
+            if (fd >= 0) {
+                memset(&sources[0], 0, sizeof(sources[0]));
+                sources[source_count++].fd = fd;
+            }
+        }
+
+        if (listener >= 0 && ready > 0 && (fds[0].revents & POLLIN)) {
+            int client = accept(listener, NULL, NULL);
+            if (client >= 0 && source_count < STREAM_MAX_CLIENTS) {
+                memset(&sources[source_count], 0, sizeof(sources[0]));
+                sources[source_count++].fd = client;
+            } else if (client >= 0) {
+                fprintf(stderr, "[WARNING] Already serving %d gateways - connection refused.\n",
+                        STREAM_MAX_CLIENTS);
+                close(client);
+            }
+        }
+
+        stream_check_averages(&monitor, &out);
+        if (interval > 0 && monotonic_seconds() >= next_summary) {
+            render_stream_summary(&out, &monitor);
+            next_summary += interval * (floor((monotonic_seconds() - next_summary) / interval) + 1);
+        }
+        // Everything this round raised leaves in one write
+        if (out.length > 0) output_flush(&out, stdout);
+    }
+
+    for (int i = 0; i < source_count; i++) {
+        if (sources[i].fd != STDIN_FILENO) close(sources[i].fd);
+    }
+    if (listener >= 0) {
+        close(listener);
+        unlink(socket_path);
+    }
+#else
+    // No poll() or Unix sockets here: stdin, one line at a time
+    (void)source_count;
+    (void)sources;
+    if (strcmp(options->stream, "-") != 0) {
+        fprintf(stderr, "[ERROR] Only --stream - (stdin) is supported on this platform.\n");
+        stream_free(&monitor);
+        return EXIT_USAGE;
+    }
+    while (fgets(chunk, MAX_LINE, stdin)) {
+        stream_line(&monitor, chunk, chunk + strcspn(chunk, "\n"), &out);
+        stream_check_averages(&monitor, &out);
+        output_flush(&out, stdout);
+    }
+#endif
+
+    render_stream_summary(&out, &monitor);
+    if (!output_flush(&out, stdout) && status == EXIT_OK) status = EXIT_EXPORT_FAILED;
+    output_free(&out);
+    if (status == EXIT_OK && options->fail_on > 0 && monitor.alerts.max_severity >= options->fail_on) {
+        status = EXIT_ALERT_THRESHOLD;
+    }
+    stream_free(&monitor);
+    return status;
+}
+
+// An empty patient, ready to be loaded
+void patient_init(Patient *patient, const char *name, size_t length, const char *input) {
+    if (length >= sizeof(patient->name)) length = sizeof(patient->name) - 1;
+    memcpy(patient->name, name, length);
+    patient->name[length] = '\0';
+    snprintf(patient->input, sizeof(patient->input), "%s", input);
+    store_init(&patient->store);
+    memset(&patient->stats, 0, sizeof(patient->stats));
+    alert_log_init(&patient->alerts);
+}
+
+// Load one patient file and analyze all of its records. Returns 0 (and
+// holds nothing) if the file can't be loaded.
+int patient_load(Patient *patient, const char *name, const char *input, InputFormat format) {
+    patient_init(patient, name, strlen(name), input);
+    if (!load_data(input, format, &patient->store, 1)) {
+        store_free(&patient->store);
+        return 0;
+    }
+    patient_analyze(patient);
+    return 1;
+}
+
+// Statistics and alerts over all of the patient's records
+void patient_analyze(Patient *patient) {
+    if (!store_enable_detectors(&patient->store)) {
+        fprintf(stderr, "[WARNING] Out of memory - patient '%s' analyzed without the anomaly detectors.\n",
+                patient->name);
+    }
+    calculate_statistics(&patient->store, &patient->stats);
+    analyze_health(&patient->store, patient->stats, &patient->alerts);
+}
+
+void patient_free(Patient *patient) {
+    store_free(&patient->store);
+}
+
+// FNV-1a of a patient ID, finished with a 64-bit mix so the top bits
+// (the shard) vary as much as the low ones; never 0, which marks an empty slot
+uint64_t patient_hash(const char *id, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)id[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash ? hash : 1;
+}
+
+static PatientShard *patient_shard(PatientStore *patients, uint64_t hash) {
+    return &patients->shards[hash >> (64 - PATIENT_SHARD_BITS)];
+}
+
+static void shard_lock(PatientShard *shard, int write) {
+#ifndef _WIN32
+    if (write) pthread_rwlock_wrlock(&shard->lock);
+    else pthread_rwlock_rdlock(&shard->lock);
+#else
+    (void)shard;
+    (void)write;
+#endif
+}
+
+static void shard_unlock(PatientShard *shard) {
+#ifndef _WIN32
+    pthread_rwlock_unlock(&shard->lock);
+#else
+    (void)shard;
+#endif
+}
+
+// Slot holding id, or the empty slot where it would go
+static int shard_probe(const PatientShard *shard, uint64_t hash, const char *id, size_t length) {
+    int mask = shard->capacity - 1;
+    int i = (int)(hash & (uint64_t)mask);
+    while (shard->slots[i].hash != 0) {
+        if (shard->slots[i].hash == hash) {
+            const char *name = shard->slots[i].patient->name;
+            if (strncmp(name, id, length) == 0 && name[length] == '\0') return i;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// Double the table, keeping it at most 3/4 full. Returns 0 if memory ran out.
+static int shard_grow(PatientShard *shard) {
+    int capacity = shard->capacity ? shard->capacity * 2 : 16;
+    PatientSlot *slots = calloc((size_t)capacity, sizeof(PatientSlot));
+    if (!slots) {
+        return 0;
+    }
+    for (int i = 0; i < shard->capacity; i++) {
+        if (shard->slots[i].hash == 0) continue;
+        int k = (int)(shard->slots[i].hash & (uint64_t)(capacity - 1));
+        while (slots[k].hash != 0) k = (k + 1) & (capacity - 1);
+        slots[k] = shard->slots[i];
+    }
+    free(shard->slots);
+    shard->slots = slots;
+    shard->capacity = capacity;
+    return 1;
+}
+
+void patients_init(PatientStore *patients) {
+    memset(patients, 0, sizeof(*patients));
+#ifndef _WIN32
+    for (int s = 0; s < PATIENT_SHARDS; s++) {
+        pthread_rwlock_init(&patients->shards[s].lock, NULL);
+    }
+#endif
+}
+
+// Free the tables and every patient still in them
+void patients_free(PatientStore *patients) {
+    for (int s = 0; s < PATIENT_SHARDS; s++) {
+        PatientShard *shard = &patients->shards[s];
+        for (int i = 0; i < shard->capacity; i++) {
+            if (shard->slots[i].hash == 0) continue;
+            patient_free(shard->slots[i].patient);
+            free(shard->slots[i].patient);
+        }
+        free(shard->slots);
+        shard->slots = NULL;
+        shard->capacity = shard->count = 0;
+#ifndef _WIN32
+        pthread_rwlock_destroy(&shard->lock);
+#endif
+    }
+}
+
+// Patient id, with its shard read-locked until patients_release(): it
+// can't be replaced meanwhile. NULL (and no lock held) if there is none.
+Patient *patients_acquire(PatientStore *patients, const char *id, size_t length) {
+    if (length >= MAX_NAME) {
+        return NULL;
+    }
+    uint64_t hash = patient_hash(id, length);
+    PatientShard *shard = patient_shard(patients, hash);
+    shard_lock(shard, 0);
+    if (shard->capacity > 0) {
+        int i = shard_probe(shard, hash, id, length);
+        if (shard->slots[i].hash != 0) return shard->slots[i].patient;
+    }
+    shard_unlock(shard);
+    return NULL;
+}
+
+void patients_release(PatientStore *patients, const Patient *patient) {
+    shard_unlock(patient_shard(patients, patient_hash(patient->name, strlen(patient->name))));
+}
+
+// Add patient, or put it in place of the one with its ID, which is then
+// returned in *replaced for the caller to free. Returns 0 if memory ran out.
+int patients_put(PatientStore *patients, Patient *patient, Patient **replaced) {
+    size_t length = strlen(patient->name);
+    uint64_t hash = patient_hash(patient->name, length);
+    PatientShard *shard = patient_shard(patients, hash);
+    *replaced = NULL;
+
+    shard_lock(shard, 1);
+    if ((shard->count + 1) * 4 > shard->capacity * 3 && !shard_grow(shard)) {
+        shard_unlock(shard);
+        return 0;
+    }
+    int i = shard_probe(shard, hash, patient->name, length);
+    if (shard->slots[i].hash != 0) {
+        *replaced = shard->slots[i].patient;
+    } else {
+        shard->slots[i].hash = hash;
+        shard->count++;
+    }
+    shard->slots[i].patient = patient;
+    shard_unlock(shard);
+    return 1;
+}
+
+// Move every patient out into a new array (in no particular order),
+// leaving the store empty. Returns the count, or -1 if memory ran out.
+int patients_take_all(PatientStore *patients, Patient ***list) {
+    int count = 0, taken = 0;
+    for (int s = 0; s < PATIENT_SHARDS; s++) count += patients->shards[s].count;
+    *list = malloc((size_t)(count ? count : 1) * sizeof(Patient *));
+    if (!*list) {
+        return -1;
+    }
+    for (int s = 0; s < PATIENT_SHARDS; s++) {
+        PatientShard *shard = &patients->shards[s];
+        shard_lock(shard, 1);
+        for (int i = 0; i < shard->capacity && taken < count; i++) {
+            if (shard->slots[i].hash != 0) (*list)[taken++] = shard->slots[i].patient;
+        }
+        if (shard->slots) memset(shard->slots, 0, (size_t)shard->capacity * sizeof(PatientSlot));
+        shard->count = 0;
+        shard_unlock(shard);
+    }
+    return taken;
+}
+
+// Patients, records and bytes of every shard
+void patients_usage(PatientStore *patients, PatientShardUsage *usage) {
+    for (int s = 0; s < PATIENT_SHARDS; s++) {
+        PatientShard *shard = &patients->shards[s];
+        shard_lock(shard, 0);
+        usage[s].patients = shard->count;
+        usage[s].records = 0;
+        usage[s].bytes = (size_t)shard->capacity * sizeof(PatientSlot);
+        for (int i = 0; i < shard->capacity; i++) {
+            if (shard->slots[i].hash == 0) continue;
+            const Patient *patient = shard->slots[i].patient;
+            usage[s].records += patient->store.count;
+            usage[s].bytes += sizeof(Patient) + store_memory(&patient->store);
+        }
+        shard_unlock(shard);
+    }
+}
+
+// A multi-patient CSV has PatientID as its first header field
+int csv_has_patient_column(const char *filename) {
+    char line[MAX_LINE];
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return 0;
+    }
+    int keyed = fgets(line, sizeof(line), file) != NULL &&
+                strncmp(line, PATIENT_ID_COLUMN ",", strlen(PATIENT_ID_COLUMN ",")) == 0;
+    fclose(file);
+    return keyed;
+}
+
+// The patient of a store being loaded, added empty if new. Only for stores
+// no one else reads yet: the patient is used after its lock is dropped.
+static Patient *patients_route(PatientStore *patients, const char *id, size_t length, const char *input) {
+    Patient *patient = patients_acquire(patients, id, length);
+    if (patient) {
+        patients_release(patients, patient);
+        return patient;
+    }
+    Patient *replaced;
+    patient = malloc(sizeof(Patient));
+    if (!patient) {
+        return NULL;
+    }
+    patient_init(patient, id, length, input);
+    if (!patients_put(patients, patient, &replaced)) {
+        patient_free(patient);
+        free(patient);
+        return NULL;
+    }
+    return patient;
+}
+
+// Load a multi-patient CSV (PatientID, then the columns of a patient file),
+// routing every row to its patient's store by the PatientID column. With
+// only_id, rows of other patients are skipped unparsed. The stores come
+// back sorted by day but not analyzed. Returns the number of patients, or
+// -1 if the file can't be read or memory ran out.
+int load_patient_csv(const char *filename, const char *only_id, Patient ***loaded) {
+    MappedFile file;
+    PatientStore routed;
+    double started = profile_start();
+    long long rows = 0, rejected = 0;
+    size_t only_length = only_id ? strlen(only_id) : 0;
+    Patient *current = NULL; // patient of the previous row: a file holds runs of one patient
+    int ok = 1;
+
+    *loaded = NULL;
+    if (!map_file(filename, &file)) {
+        return -1;
+    }
+    patients_init(&routed);
+
+    const char *p = file.data;
+    const char *end = file.data + file.size;
+    const char *newline = memchr(p, '\n', (size_t)(end - p)); // header
+    p = newline ? newline + 1 : end;
+
+    while (ok && p < end) {
+        newline = memchr(p, '\n', (size_t)(end - p));
+        const char *line_end = newline ? newline : end;
+        const char *next = newline ? newline + 1 : end;
+        const char *cr = memchr(p, '\r', (size_t)(line_end - p));
+        if (cr) line_end = cr;
+        const char *comma = memchr(p, ',', (size_t)(line_end - p));
+        size_t length = comma ? (size_t)(comma - p) : 0;
+
+        if (line_end - p >= 5 && (!only_id || (length == only_length && memcmp(p, only_id, length) == 0))) {
+            HealthRecord record = {0};
+            rows++;
+            if (length == 0 || length >= MAX_NAME || parse_csv_row(comma + 1, line_end, &record) < 5) {
+                rejected++;
+            } else {
+                if (!current || strncmp(current->name, p, length) != 0 || current->name[length] != '\0') {
+                    current = patients_route(&routed, p, length, filename);
+                }
+                ok = current && store_append(&current->store, &record);
+            }
+        }
+        p = next;
+    }
+    profile_rows(rows, rejected, (long long)file.size);
+    unmap_file(&file);
+
+    int count = ok ? patients_take_all(&routed, loaded) : -1;
+    patients_free(&routed);
+    for (int i = 0; i < count; i++) {
+        ok = ok && store_sort_by_day(&(*loaded)[i]->store);
+    }
+    if (!ok && count > 0) {
+        for (int i = 0; i < count; i++) {
+            patient_free((*loaded)[i]);
+            free((*loaded)[i]);
+        }
+        count = -1;
+    }
+    if (count < 0) {
+        free(*loaded);
+        *loaded = NULL;
+    }
+    profile_stop(STAGE_CSV_LOAD, started);
+    return count;
+}
+
+// Load the records of patient id from a multi-patient CSV into store.
+// Returns 0 if the file can't be read or holds no records of id.
+int load_patient_data(const char *filename, const char *id, RecordStore *store) {
+    Patient **loaded;
+    int count = load_patient_csv(filename, id, &loaded);
+    int ok = count > 0;
+    if (ok) {
+        store_clear(store);
+        ok = store_append_all(store, &loaded[0]->store) && store->count > 0;
+    }
+    for (int i = 0; i < count; i++) {
+        patient_free(loaded[i]);
+        free(loaded[i]);
+    }
+    free(loaded);
+    return ok;
+}
+
+// Fold the text from start on onto one line: every newline goes, with the
+// indent after it (a space stays after a comma). JSON strings are escaped,
+// so none of them is touched.
+static void output_compact(OutputBuffer *out, size_t start) {
+    if (out->failed || !out->data) {
+        return;
+    }
+    size_t kept = start;
+    for (size_t i = start; i < out->length; i++) {
+        if (out->data[i] == '\n') {
+            while (i + 1 < out->length && out->data[i + 1] == ' ') i++;
+            if (kept > start && out->data[kept - 1] == ',') out->data[kept++] = ' ';
+            continue;
+        }
+        out->data[kept++] = out->data[i];
+    }
+    out->length = kept;
+    out->data[kept] = '\0';
+}
+
+void render_query_error(OutputBuffer *out, const char *message) {
+    output_printf(out, "{\"ok\": false, \"error\": ");
+    output_json_string(out, message);
+    output_printf(out, "}\n");
+}
+
+// The "trends" object of a query: the last window of the range per vital
+static void render_json_trends(OutputBuffer *out, const RecordStore *store, int from_day, int to_day) {
+    static const char *directions[] = { "falling", "steady", "rising" };
+    TrendReport trends;
+    int first, last;
+    store_find_days(store, from_day, to_day, &first, &last);
+    if (last - first < 2 || !compute_trends(store, first, last, trend_window, (1u << VITAL_COUNT) - 1,
+                                            &trends)) {
+        output_printf(out, "  \"window\": 0,\n  \"trends\": null");
+        return;
+    }
+
+    output_printf(out, "  \"window\": %d,\n  \"trends\": {\n", trends.window);
+    for (int v = 0; v < VITAL_COUNT; v++) {
+        output_printf(out, "    \"%s\": {\"mean\": %.6g, \"min\": %.6g, \"max\": %.6g, \"slope\": %.6g, "
+                      "\"t\": %.6g, \"direction\": \"%s\"}%s\n", vital_key((Vital)v), trends.mean[v],
+                      trends.min[v], trends.max[v], trends.slope[v], trends.slope_t[v],
+                      directions[trend_direction(&trends, (Vital)v) + 1], (v + 1 < VITAL_COUNT) ? "," : "");
+    }
+    output_printf(out, "  }");
+}
+
+// One query on a patient as a JSON object on one line. from_day..to_day
+// limits it to a date range; the whole range is answered from the analysis
+// done at load.
+void render_query(OutputBuffer *out, const Patient *patient, QueryKind kind, int from_day, int to_day) {
+    HealthStats ranged_stats;
+    AlertLog ranged_alerts;
+    const HealthStats *stats = &patient->stats;
+    const AlertLog *alerts = &patient->alerts;
+
+    if (from_day != INT_MIN || to_day != INT_MAX) {
+        calculate_statistics_range(&patient->store, from_day, to_day, &ranged_stats);
+        stats = &ranged_stats;
+        if (ranged_stats.record_count > 0 && (kind == QUERY_ALERTS || kind == QUERY_REPORT)) {
+            analyze_health_range(&patient->store, from_day, to_day, ranged_stats, &ranged_alerts);
+            alerts = &ranged_alerts;
+        }
+    }
+    if (stats->record_count == 0) {
+        render_query_error(out, "no records in the date range");
+        return;
+    }
+
+    size_t start = out->length;
+    output_printf(out, "{\"ok\": true, \"patient\": ");
+    output_json_string(out, patient->name);
+    output_printf(out, ", \"records\": %d", stats->record_count);
+    if (kind == QUERY_SCORE || kind == QUERY_REPORT) {
+        int score = calculate_health_score(*stats);
+        output_printf(out, ", \"health_score\": %d, \"status\": \"%s\"", score, score_status(score));
+    }
+    if (kind == QUERY_STATS || kind == QUERY_REPORT) {
+        output_printf(out, ",\n");
+        render_json_vitals(out, stats);
+    }
+    if (kind == QUERY_ALERTS || kind == QUERY_REPORT) {
+        output_printf(out, ",\n");
+        render_json_alerts(out, stats, alerts, &patient->store);
+    }
+    if (kind == QUERY_TRENDS) {
+        output_printf(out, ",\n");
+        render_json_trends(out, &patient->store, from_day, to_day);
+    }
+    output_printf(out, "}");
+    output_compact(out, start);
+    output_printf(out, "\n");
+}
+
+#ifdef __linux__
+// A request on its way through the worker pool. Answers are matched to
+// their client by slot and generation, so an answer for a client that has
+// gone (and whose slot was reused) is dropped.
+typedef struct ServerTask {
+    struct ServerTask *next;
+    int connection;          // client slot, -1 = a load at startup
+    unsigned generation;
+    char request[SERVER_MAX_REQUEST];
+    OutputBuffer response;
+} ServerTask;
+
+// Queries hold the read lock of their patient's shard; LOAD takes the
+// write lock only to swap a loaded patient in.
+typedef struct {
+    const char *dir;
+    InputFormat format;
+    PatientStore patients;
+
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_ready;  // a task was queued, or the server is stopping
+    pthread_cond_t loads_done;   // the last startup load finished
+    ServerTask *queue_head;
+    ServerTask *queue_tail;
+    ServerTask *done;            // answered, waiting for the event loop
+    int loading;                 // startup loads not finished yet
+    int stopping;
+    int wake_fd;                 // eventfd: done has tasks
+} QueryServer;
+
+// One client. It has at most one request with the workers; requests it
+// sends meanwhile wait in input, so answers go back in order.
+typedef struct {
+    int fd;                  // -1 = free slot
+    unsigned generation;
+    unsigned events;         // epoll events being watched
+    int busy;
+    int closing;             // close once every answer is sent
+    size_t length;           // bytes in input
+    char input[SERVER_MAX_REQUEST];
+    OutputBuffer output;     // answers not sent yet
+    size_t sent;
+} ServerConnection;
+
+// epoll tags: the listener, the eventfd, then client slots
+enum { SERVER_TAG_LISTENER = 0, SERVER_TAG_WAKE, SERVER_TAG_FIRST_CLIENT };
+
+static volatile sig_atomic_t server_stop = 0;
+
+static void server_on_signal(int signal_number) {
+    (void)signal_number;
+    server_stop = 1;
+}
+
+// LOAD: read file from the data directory into the table, replacing the
+// patients it holds. A multi-patient CSV fills one patient per PatientID;
+// any other file is one patient named after it. Files are read and
+// analyzed with no lock held, so queries see either the old records or the
+// new ones. Returns 0 if not every patient was loaded.
+static int server_load(QueryServer *server, const char *file, OutputBuffer *out) {
+    char name[MAX_NAME], input[MAX_PATH_LEN];
+    const char *dot = strrchr(file, '.');
+    static const char *extensions[] = { NULL, ".csv", ".txt", ".shm", ".shz" }; // by InputFormat
+    int supported = (server->format == FORMAT_AUTO)
+                    ? has_extension(file, ".csv") || has_extension(file, ".txt") ||
+                      has_extension(file, ".shm") || has_extension(file, ".shz")
+                    : has_extension(file, extensions[server->format]);
+    // Only plain file names: a client can't make the server read elsewhere
+    if (file[0] == '.' || strchr(file, '/') || !supported || (size_t)(dot - file) >= sizeof(name)) {
+        render_query_error(out, "not a patient file name");
+        return 0;
+    }
+    int length = snprintf(input, sizeof(input), "%s/%s", server->dir, file);
+    if (length < 0 || length >= (int)sizeof(input)) {
+        render_query_error(out, "path too long");
+        return 0;
+    }
+    memcpy(name, file, (size_t)(dot - file));
+    name[dot - file] = '\0';
+
+    Patient **loaded;
+    int count;
+    int keyed = has_extension(file, ".csv") && csv_has_patient_column(input);
+    if (keyed) {
+        count = load_patient_csv(input, NULL, &loaded);
+    } else {
+        Patient *patient = malloc(sizeof(Patient));
+        loaded = malloc(sizeof(Patient *));
+        count = (patient && loaded && patient_load(patient, name, input, server->format)) ? 1 : -1;
+        if (count == 1) loaded[0] = patient;
+        else free(patient);
+    }
+    if (count <= 0) {
+        free(loaded);
+        render_query_error(out, "cannot load the file");
+        return 0;
+    }
+
+    long long records = 0;
+    int stored = 0;
+    for (int i = 0; i < count; i++) {
+        Patient *patient = loaded[i], *replaced;
+        if (keyed) patient_analyze(patient);
+        records += patient->store.count;
+        if (patients_put(&server->patients, patient, &replaced)) {
+            stored++;
+            patient = replaced;
+        }
+        if (patient) {
+            patient_free(patient);
+            free(patient);
+        }
+    }
+    free(loaded);
+
+    if (stored < count) {
+        render_query_error(out, "out of memory");
+    } else if (keyed) {
+        output_printf(out, "{\"ok\": true, \"patients\": %d, \"records\": %lld}\n", count, records);
+    } else {
+        output_printf(out, "{\"ok\": true, \"patient\": ");
+        output_json_string(out, name);
+        output_printf(out, ", \"records\": %lld}\n", records);
+    }
+    return stored == count;
+}
+
+// A PATIENTS line: what is known of each patient, taken shard by shard
+typedef struct {
+    char name[MAX_NAME];
+    int records;
+    int first_day;
+    int last_day;
+} PatientListing;
+
+static int compare_listings(const void *a, const void *b) {
+    return strcmp(((const PatientListing *)a)->name, ((const PatientListing *)b)->name);
+}
+
+// PATIENTS: every patient by name, with its record count and date span
+static void server_list_patients(QueryServer *server, OutputBuffer *out) {
+    PatientListing *list = NULL;
+    int count = 0, capacity = 0;
+    for (int s = 0; s < PATIENT_SHARDS; s++) {
+        PatientShard *shard = &server->patients.shards[s];
+        pthread_rwlock_rdlock(&shard->lock);
+        if (count + shard->count > capacity) {
+            int grown_capacity = (count + shard->count) * 2;
+            PatientListing *grown = realloc(list, (size_t)grown_capacity * sizeof(PatientListing));
+            if (grown) {
+                list = grown;
+                capacity = grown_capacity;
+            }
+        }
+        for (int i = 0; i < shard->capacity && count < capacity; i++) {
+            if (shard->slots[i].hash == 0) continue;
+            const Patient *patient = shard->slots[i].patient;
+            PatientListing *entry = &list[count++];
+            memcpy(entry->name, patient->name, sizeof(entry->name));
+            entry->records = patient->store.count;
+            entry->first_day = entry->records ? store_day(&patient->store, 0) : 0;
+            entry->last_day = entry->records ? store_day(&patient->store, entry->records - 1) : 0;
+        }
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    qsort(list, (size_t)count, sizeof(PatientListing), compare_listings);
+
+    output_printf(out, "{\"ok\": true, \"patients\": [");
+    for (int i = 0; i < count; i++) {
+        output_printf(out, "%s{\"name\": ", i ? ", " : "");
+        output_json_string(out, list[i].name);
+        output_printf(out, ", \"records\": %d", list[i].records);
+        if (list[i].records > 0) {
+            char first[DATE_LEN], last[DATE_LEN];
+            days_to_date(list[i].first_day, first);
+            days_to_date(list[i].last_day, last);
+            output_printf(out, ", \"from\": \"%s\", \"to\": \"%s\"", first, last);
+        }
+        output_printf(out, "}");
+    }
+    output_printf(out, "]}\n");
+    free(list);
+}
+
+// Day for a query date; "-" leaves that end of the range open
+static int parse_query_day(const char *text, int open, int *day) {
+    if (strcmp(text, "-") == 0) {
+        *day = open;
+        return 1;
+    }
+    return parse_date(text, text + strlen(text), day);
+}
+
+// Answer one request line into task->response
+static void server_execute(QueryServer *server, ServerTask *task) {
+    static const struct {
+        const char *command;
+        QueryKind kind;
+    } queries[] = {
+        { "STATS", QUERY_STATS }, { "ALERTS", QUERY_ALERTS }, { "SCORE", QUERY_SCORE },
+        { "TRENDS", QUERY_TRENDS }, { "REPORT", QUERY_REPORT }
+    };
+    OutputBuffer *out = &task->response;
+    char *words[5];
+    int count = 0;
+    char *save = NULL;
+    for (char *word = strtok_r(task->request, " \t", &save); word && count < 5;
+         word = strtok_r(NULL, " \t", &save)) {
+        words[count++] = word;
+    }
+
+    if (count == 1 && strcmp(words[0], "PING") == 0) {
+        output_printf(out, "{\"ok\": true}\n");
+        return;
+    }
+    if (count == 1 && strcmp(words[0], "PATIENTS") == 0) {
+        server_list_patients(server, out);
+        return;
+    }
+    if (count == 1 && strcmp(words[0], "SHARDS") == 0) {
+        PatientShardUsage usage[PATIENT_SHARDS];
+        long long records = 0;
+        size_t bytes = 0;
+        int patients = 0;
+        patients_usage(&server->patients, usage);
+        output_printf(out, "{\"ok\": true, \"shards\": [");
+        for (int i = 0; i < PATIENT_SHARDS; i++) {
+            output_printf(out, "%s{\"patients\": %d, \"records\": %lld, \"bytes\": %zu}", i ? ", " : "",
+                          usage[i].patients, usage[i].records, usage[i].bytes);
+            patients += usage[i].patients;
+            records += usage[i].records;
+            bytes += usage[i].bytes;
+        }
+        output_printf(out, "], \"patients\": %d, \"records\": %lld, \"bytes\": %zu}\n",
+                      patients, records, bytes);
+        return;
+    }
+    if (count == 2 && strcmp(words[0], "LOAD") == 0) {
+        server_load(server, words[1], out);
+        return;
+    }
+
+    int query = -1;
+    for (int i = 0; i < (int)(sizeof(queries) / sizeof(queries[0])); i++) {
+        if (count > 0 && strcmp(words[0], queries[i].command) == 0) query = i;
+    }
+    if (query < 0 || count < 2 || count > 4) {
+        render_query_error(out, "unknown request");
+        return;
+    }
+    int from_day = INT_MIN, to_day = INT_MAX;
+    if ((count > 2 && !parse_query_day(words[2], INT_MIN, &from_day)) ||
+        (count > 3 && !parse_query_day(words[3], INT_MAX, &to_day)) || from_day > to_day) {
+        render_query_error(out, "bad date range");
+        return;
+    }
+
+    Patient *patient = patients_acquire(&server->patients, words[1], strlen(words[1]));
+    if (!patient) {
+        render_query_error(out, "unknown patient");
+        return;
+    }
+    render_query(out, patient, queries[query].kind, from_day, to_day);
+    patients_release(&server->patients, patient);
+}
+
+static void *server_worker(void *arg) {
+    QueryServer *server = arg;
+    for (;;) {
+        pthread_mutex_lock(&server->queue_lock);
+        while (!server->queue_head && !server->stopping) {
+            pthread_cond_wait(&server->queue_ready, &server->queue_lock);
+        }
+        ServerTask *task = server->stopping ? NULL : server->queue_head;
+        if (task) {
+            server->queue_head = task->next;
+            if (!server->queue_head) server->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&server->queue_lock);
+        if (!task) {
+            break;
+        }
+
+        // A startup load only has the file name to load
+        if (task->connection < 0) {
+            if (!server_load(server, task->request, &task->response)) {
+                fprintf(stderr, "[WARNING] Could not load '%s/%s'.\n", server->dir, task->request);
+            }
+            output_free(&task->response);
+            pthread_mutex_lock(&server->queue_lock);
+            free(task);
+            if (--server->loading == 0) pthread_cond_signal(&server->loads_done);
+            pthread_mutex_unlock(&server->queue_lock);
+            continue;
+        }
+
+        server_execute(server, task);
+        pthread_mutex_lock(&server->queue_lock);
+        task->next = server->done;
+        server->done = task;
+        pthread_mutex_unlock(&server->queue_lock);
+        uint64_t one = 1;
+        ssize_t put = write(server->wake_fd, &one, sizeof(one));
+        (void)put; // fails only if the counter is full, and then it is already set
+    }
+    return NULL;
+}
+
+static void server_submit(QueryServer *server, ServerTask *task) {
+    task->next = NULL;
+    output_init(&task->response, NULL, 0);
+    pthread_mutex_lock(&server->queue_lock);
+    if (server->queue_tail) server->queue_tail->next = task;
+    else server->queue_head = task;
+    server->queue_tail = task;
+    pthread_cond_signal(&server->queue_ready);
+    pthread_mutex_unlock(&server->queue_lock);
+}
+
+// Listening socket for --serve: unix:PATH, or tcp:PORT on 127.0.0.1 only
+static int server_listen(const char *address, int *tcp) {
+    *tcp = 0;
+    if (strncmp(address, "unix:", 5) == 0) {
+        return stream_listen(address + 5);
+    }
+    char *end;
+    long port = (strncmp(address, "tcp:", 4) == 0) ? strtol(address + 4, &end, 10) : 0;
+    if (port < 1 || port > 65535 || *end != '\0') {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int on = 1;
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons((uint16_t)port);
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    *tcp = 1;
+    return fd;
+}
+
+// Watch for what the client can do next: more requests while there is
+// room for them, writes while answers are waiting
+static void connection_watch(int epoll_fd, ServerConnection *connection, int slot) {
+    unsigned events = 0;
+    if (!connection->closing && connection->length < sizeof(connection->input)) events |= EPOLLIN;
+    if (connection->sent < connection->output.length) events |= EPOLLOUT;
+    if (events == connection->events) {
+        return;
+    }
+    struct epoll_event event;
+    event.events = events;
+    event.data.u64 = (uint64_t)(SERVER_TAG_FIRST_CLIENT + slot);
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+}
+
+static void connection_close(ServerConnection *connection) {
+    close(connection->fd);
+    output_free(&connection->output);
+    connection->fd = -1;
+    connection->generation++;
+}
+
+// Send what the socket takes now. Returns 0 if the client is gone.
+static int connection_send(ServerConnection *connection) {
+    while (connection->sent < connection->output.length) {
+        ssize_t put = send(connection->fd, connection->output.data + connection->sent,
+                           connection->output.length - connection->sent, MSG_NOSIGNAL);
+        if (put > 0) {
+            connection->sent += (size_t)put;
+        } else if (put < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return put < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    connection->output.length = 0;
+    connection->sent = 0;
+    return 1;
+}
+
+// Hand the client's next complete request to the workers, unless one is
+// already there or too many answers are still unsent
+static void connection_dispatch(QueryServer *server, ServerConnection *connection, int slot) {
+    while (!connection->busy && connection->output.length - connection->sent < SERVER_MAX_PENDING) {
+        char *newline = memchr(connection->input, '\n', connection->length);
+        if (!newline) {
+            if (connection->length == sizeof(connection->input)) {
+                render_query_error(&connection->output, "request too long");
+                connection->length = 0;
+                connection->closing = 1;
+            }
+            return;
+        }
+
+        size_t n = (size_t)(newline - connection->input);
+        size_t used = n + 1;
+        if (n > 0 && connection->input[n - 1] == '\r') n--;
+        ServerTask *task = (n > 0) ? malloc(sizeof(ServerTask)) : NULL;
+        if (task) {
+            memcpy(task->request, connection->input, n);
+            task->request[n] = '\0';
+        }
+        connection->length -= used;
+        memmove(connection->input, connection->input + used, connection->length);
+
+        if (n == 0) {
+            continue;
+        }
+        if (!task) {
+            render_query_error(&connection->output, "out of memory");
+        } else if (strcmp(task->request, "QUIT") == 0) {
+            free(task);
+            connection->length = 0;
+            connection->closing = 1;
+            return;
+        } else {
+            task->connection = slot;
+            task->generation = connection->generation;
+            connection->busy = 1;
+            server_submit(server, task);
+        }
+    }
+}
+
+// Move a client on after it was read from, answered or written to:
+// send, queue its next request, close it once it is done
+static void connection_advance(QueryServer *server, ServerConnection *connections, int epoll_fd, int slot) {
+    ServerConnection *connection = &connections[slot];
+    for (;;) {
+        if (!connection_send(connection)) {
+            connection_close(connection);
+            return;
+        }
+        int busy = connection->busy;
+        size_t pending = connection->output.length;
+        connection_dispatch(server, connection, slot);
+        if (connection->busy == busy && connection->output.length == pending) {
+            break;
+        }
+    }
+    if (connection->closing && !connection->busy && connection->output.length == 0 &&
+        !memchr(connection->input, '\n', connection->length)) {
+        connection_close(connection);
+        return;
+    }
+    connection_watch(epoll_fd, connection, slot);
+}
+#endif
+
+// Query server: every patient file in --input-dir is loaded and analyzed
+// once, on --threads workers, and kept in memory. Clients on a Unix socket
+// or 127.0.0.1 TCP port send one request per line and get one JSON line
+// back. An epoll loop owns the sockets and the workers run the queries, so
+// a slow query never holds up other clients. Runs until SIGINT/SIGTERM.
+int run_server(const BatchOptions *options) {
+#ifdef __linux__
+    static ServerConnection connections[SERVER_MAX_CONNECTIONS];
+    pthread_t workers[MAX_INGEST_THREADS];
+    QueryServer server;
+    PatientJob *jobs;
+    int status = EXIT_OK;
+
+    int job_count = discover_patient_files(options->input_dir, options->format, ".", REPORT_AUTO, &jobs);
+    if (job_count < 0) {
+        fprintf(stderr, "[ERROR] Cannot read directory '%s'.\n", options->input_dir);
+        return EXIT_LOAD_FAILED;
+    }
+    int tcp;
+    int listener = server_listen(options->serve, &tcp);
+    if (listener < 0) {
+        fprintf(stderr, "[ERROR] Cannot listen on '%s': %s\n", options->serve, strerror(errno));
+        free(jobs);
+        return (errno == EINVAL) ? EXIT_USAGE : EXIT_LOAD_FAILED;
+    }
+
+    memset(&server, 0, sizeof(server));
+    server.dir = options->input_dir;
+    server.format = options->format;
+    patients_init(&server.patients);
+    pthread_mutex_init(&server.queue_lock, NULL);
+    pthread_cond_init(&server.queue_ready, NULL);
+    pthread_cond_init(&server.loads_done, NULL);
+    server.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // Signals go to the event loop, never to a worker
+    int threads = options->threads > 0 ? options->threads : default_thread_count();
+    if (threads > MAX_INGEST_THREADS) threads = MAX_INGEST_THREADS;
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    int started = 0;
+    while (started < threads && pthread_create(&workers[started], NULL, server_worker, &server) == 0) {
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    // Every patient is loaded before the first client is accepted
+    double load_started = monotonic_seconds();
+    for (int i = 0; started > 0 && i < job_count; i++) {
+        ServerTask *task = malloc(sizeof(ServerTask));
+        if (!task) {
+            break;
+        }
+        snprintf(task->request, sizeof(task->request), "%s", jobs[i].name);
+        task->connection = -1;
+        pthread_mutex_lock(&server.queue_lock);
+        server.loading++;
+        pthread_mutex_unlock(&server.queue_lock);
+        server_submit(&server, task);
+    }
+    pthread_mutex_lock(&server.queue_lock);
+    while (server.loading > 0) pthread_cond_wait(&server.loads_done, &server.queue_lock);
+    pthread_mutex_unlock(&server.queue_lock);
+    free(jobs);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = SERVER_TAG_LISTENER;
+    int ready = started > 0 && server.wake_fd >= 0 && epoll_fd >= 0 &&
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &event) == 0;
+    event.data.u64 = SERVER_TAG_WAKE;
+    ready = ready && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server.wake_fd, &event) == 0;
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    if (!ready) {
+        fprintf(stderr, "[ERROR] Cannot start the server: %s\n", strerror(errno));
+        status = EXIT_LOAD_FAILED;
+        server_stop = 1;
+    } else {
+        PatientShardUsage usage[PATIENT_SHARDS];
+        int patients = 0;
+        size_t bytes = 0;
+        patients_usage(&server.patients, usage);
+        for (int i = 0; i < PATIENT_SHARDS; i++) {
+            patients += usage[i].patients;
+            bytes += usage[i].bytes;
+        }
+        fprintf(stderr, "[SUCCESS] Serving %d patient(s) from '%s' on %s (%.1f MB, loaded in %.2f s, "
+                "%d workers)\n", patients, options->input_dir, options->serve, bytes / (1024.0 * 1024.0),
+                monotonic_seconds() - load_started, started);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = server_on_signal; // no SA_RESTART: epoll_wait() returns at once
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    for (int i = 0; i < SERVER_MAX_CONNECTIONS; i++) connections[i].fd = -1;
+
+    while (!server_stop) {
+        struct epoll_event events[64];
+        int n = epoll_wait(epoll_fd, events, 64, -1);
+        if (n < 0 && errno != EINTR) {
+            fprintf(stderr, "[ERROR] Waiting for clients failed: %s\n", strerror(errno));
+            status = EXIT_LOAD_FAILED;
+            break;
+        }
+
+        for (int e = 0; e < n; e++) {
+            uint64_t tag = events[e].data.u64;
+            if (tag == SERVER_TAG_LISTENER) {
+                int client;
+                while ((client = accept(listener, NULL, NULL)) >= 0) {
+                    int slot = 0;
+                    while (slot < SERVER_MAX_CONNECTIONS && connections[slot].fd >= 0) slot++;
+                    if (slot == SERVER_MAX_CONNECTIONS) {
+                        fprintf(stderr, "[WARNING] Already serving %d clients - connection refused.\n",
+                                SERVER_MAX_CONNECTIONS);
+                        close(client);
+                        continue;
+                    }
+                    int on = 1;
+                    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+                    fcntl(client, F_SETFD, FD_CLOEXEC);
+                    if (tcp) setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+                    ServerConnection *connection = &connections[slot];
+                    connection->fd = client;
+                    connection->events = EPOLLIN;
+                    connection->busy = connection->closing = 0;
+                    connection->length = connection->sent = 0;
+                    output_init(&connection->output, NULL, 0);
+                    struct epoll_event watch;
+                    watch.events = EPOLLIN;
+                    watch.data.u64 = (uint64_t)(SERVER_TAG_FIRST_CLIENT + slot);
+                    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &watch) != 0) {
+                        connection_close(connection);
+                    }
+                }
+            } else if (tag == SERVER_TAG_WAKE) {
+                uint64_t count;
+                ssize_t got = read(server.wake_fd, &count, sizeof(count));
+                (void)got;
+                pthread_mutex_lock(&server.queue_lock);
+                ServerTask *done = server.done;
+                server.done = NULL;
+                pthread_mutex_unlock(&server.queue_lock);
+
+                while (done) {
+                    ServerTask *task = done;
+                    ServerConnection *connection = &connections[task->connection];
+                    done = task->next;
+                    if (connection->fd >= 0 && connection->generation == task->generation) {
+                        if (task->response.failed || !task->response.data) {
+                            render_query_error(&connection->output, "out of memory");
+                        } else {
+                            output_printf(&connection->output, "%s", task->response.data);
+                        }
+                        connection->busy = 0;
+                        connection_advance(&server, connections, epoll_fd, task->connection);
+                    }
+                    output_free(&task->response);
+                    free(task);
+                }
+            } else {
+                int slot = (int)(tag - SERVER_TAG_FIRST_CLIENT);
+                ServerConnection *connection = &connections[slot];
+                if (connection->fd < 0) {
+                    continue;
+                }
+                // Hung up: the client can't read answers any more
+                if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+                    connection_close(connection);
+                    continue;
+                }
+                if (events[e].events & EPOLLIN) {
+                    ssize_t got = recv(connection->fd, connection->input + connection->length,
+                                       sizeof(connection->input) - connection->length, 0);
+                    if (got > 0) {
+                        connection->length += (size_t)got;
+                    } else if (got == 0) {
+                        // Done sending: a last request without a newline still counts
+                        if (connection->length > 0 && connection->length < sizeof(connection->input) &&
+                            connection->input[connection->length - 1] != '\n') {
+                            connection->input[connection->length++] = '\n';
+                        }
+                        connection->closing = 1;
+                    } else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+                        connection_close(connection);
+                        continue;
+                    }
+                }
+                connection_advance(&server, connections, epoll_fd, slot);
+            }
+        }
+    }
+
+    // Workers finish the query they are on; queued ones are dropped
+    pthread_mutex_lock(&server.queue_lock);
+    server.stopping = 1;
+    pthread_cond_broadcast(&server.queue_ready);
+    pthread_mutex_unlock(&server.queue_lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    ServerTask *lists[2] = { server.queue_head, server.done };
+    for (int k = 0; k < 2; k++) {
+        while (lists[k]) {
+            ServerTask *task = lists[k];
+            lists[k] = task->next;
+            output_free(&task->response);
+            free(task);
+        }
+    }
+    for (int i = 0; i < SERVER_MAX_CONNECTIONS; i++) {
+        if (connections[i].fd >= 0) connection_close(&connections[i]);
+    }
+    close(listener);
+    if (strncmp(options->serve, "unix:", 5) == 0) unlink(options->serve + 5);
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (server.wake_fd >= 0) close(server.wake_fd);
+
+    patients_free(&server.patients);
+    pthread_mutex_destroy(&server.queue_lock);
+    pthread_cond_destroy(&server.queue_ready);
+    pthread_cond_destroy(&server.loads_done);
+    fprintf(stderr, "[SUCCESS] Server stopped.\n");
+    return status;
+#else
+    fprintf(stderr, "[ERROR] --serve is not supported on this platform ('%s').\n", options->serve);
+    return EXIT_USAGE;
+#endif
+}
+
+double monotonic_seconds() {
+#ifndef _WIN32
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// Benchmark stages, in the order they are reported
+enum {
+    BENCH_GENERATE,
+    BENCH_CSV_LOAD,
+    BENCH_TXT_LOAD,
+    BENCH_SHM_LOAD,
+    BENCH_SHZ_LOAD,
+    BENCH_STATISTICS,
+    BENCH_ANALYSIS,
+    BENCH_TRENDS,
+    BENCH_EXPORT,
+    BENCH_WAL_APPEND,
+    BENCH_WAL_REPLAY,
+    BENCH_STAGE_COUNT
+};
+
+static long long file_size(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size > 0 ? size : 0;
+}
+
+// Time every pipeline stage on the same synthetic data. Each stage keeps
+// its best time over options->repeat runs.
+int run_benchmark(const BatchOptions *options) {
+    static const char *stage_names[BENCH_STAGE_COUNT] = {
+        "Generate CSV", "CSV load", "TXT load", "SHM load", "SHZ load",
+        "Statistics", "Analysis", "Trend display", "Export report",
+        "WAL append", "WAL replay"
+    };
+    const char *csv_file = "hm_bench.csv";
+    const char *txt_file = "hm_bench.txt";
+    const char *shm_file = "hm_bench.shm";
+    const char *shz_file = "hm_bench.shz";
+    const char *report_file = "hm_bench_report.txt";
+    const char *wal_file = "hm_bench.wal";
+    long long count = options->benchmark;
+    double best[BENCH_STAGE_COUNT];
+    long long records[BENCH_STAGE_COUNT] = {0};
+    long long bytes[BENCH_STAGE_COUNT] = {0};
+    RecordStore store;
+    HealthStats stats;
+    AlertLog alerts;
+    static WriteAheadLog wal;
+    int status = EXIT_OK;
+    double start;
+
+    for (int i = 0; i < BENCH_STAGE_COUNT; i++) {
+        best[i] = INFINITY;
+    }
+    store_init(&store);
+
+    printf("Generating %lld benchmark records (seed %llu)...\n", count, (unsigned long long)options->seed);
+    start = monotonic_seconds();
+    int ok = generate_dataset(csv_file, FORMAT_CSV, count, options->seed, options->anomaly_rate, NULL);
+    best[BENCH_GENERATE] = monotonic_seconds() - start;
+    ok = ok && generate_dataset(txt_file, FORMAT_TXT, count, options->seed, options->anomaly_rate, NULL);
+    ok = ok && generate_dataset(shm_file, FORMAT_SHM, count, options->seed, options->anomaly_rate, NULL);
+    ok = ok && generate_dataset(shz_file, FORMAT_SHZ, count, options->seed, options->anomaly_rate, NULL);
+    if (!ok) {
+        fprintf(stderr, "[ERROR] Failed to write benchmark data files.\n");
+        status = EXIT_EXPORT_FAILED;
+        goto cleanup;
+    }
+
+    records[BENCH_GENERATE] = records[BENCH_CSV_LOAD] = records[BENCH_TXT_LOAD] = count;
+    records[BENCH_SHM_LOAD] = records[BENCH_SHZ_LOAD] = count;
+    records[BENCH_STATISTICS] = records[BENCH_ANALYSIS] = count;
+    records[BENCH_EXPORT] = records[BENCH_WAL_APPEND] = records[BENCH_WAL_REPLAY] = count;
+    records[BENCH_TRENDS] = (count > 10) ? 10 : count;
+    bytes[BENCH_GENERATE] = bytes[BENCH_CSV_LOAD] = file_size(csv_file);
+    bytes[BENCH_TXT_LOAD] = file_size(txt_file);
+    bytes[BENCH_SHM_LOAD] = file_size(shm_file);
+    bytes[BENCH_SHZ_LOAD] = file_size(shz_file);
+    bytes[BENCH_STATISTICS] = count * VITAL_COUNT * (long long)sizeof(int);
+
+    for (int run = 0; run < options->repeat; run++) {
+        double elapsed;
+
+        start = monotonic_seconds();
+        ok = load_txt_data(txt_file, &store, NULL);
+        elapsed = monotonic_seconds() - start;
+        if (elapsed < best[BENCH_TXT_LOAD]) best[BENCH_TXT_LOAD] = elapsed;
+
+        start = monotonic_seconds();
+        ok = ok && load_shm_data(shm_file, &store);
+        elapsed = monotonic_seconds() - start;
+        if (elapsed < best[BENCH_SHM_LOAD]) best[BENCH_SHM_LOAD] = elapsed;
+
+        start = monotonic_seconds();
+        ok = ok && load_shz_data(shz_file, &store) && store.count == count;
+        elapsed = monotonic_seconds() - start;
+        if (elapsed < best[BENCH_SHZ_LOAD]) best[BENCH_SHZ_LOAD] = elapsed;
+
+        // CSV last so the remaining stages run on heap-backed records
+        start = monotonic_seconds();
+        ok = ok && load_csv_data_parallel(csv_file, &store, options->threads);
+        elapsed = monotonic_seconds() - start;
+        if (elapsed < best[BENCH_CSV_LOAD]) best[BENCH_CSV_LOAD] = elapsed;
+
+        if (!ok || store.count != count) {
+            fprintf(stderr, "[ERROR] Benchmark data did not load back completely.\n");
+            status = EXIT_LOAD_FAILED;
+            goto cleanup;
+        }
+
+        start = monotonic_seconds();
+        calculate_statistics(&store, &stats);
+        elapsed = monotonic_seconds() - start;
+        if (elapsed < best[BENCH_STATISTICS]) best[BENCH_STATISTICS] = elapsed;
+
+        // Like a real run: the loads left the detectors off, and the
+        // analysis switches them on over every record
+        start = monotonic_seconds();
+        ok = store_enable_detectors(&store);
+        analyze_health(&store, stats, &alerts);
+        elapsed = monotonic_seconds() - start;
+        if (!ok) {
+            fprintf(stderr, "[ERROR] Out of memory running the anomaly detectors.\n");
+            status = EXIT_LOAD_FAILED;
+            goto cleanup;
+        }
+        if (elapsed < best[BENCH_ANALYSIS]) best[BENCH_ANALYSIS] = elapsed;
+
+        // The trend table goes to /dev/null so only its cost is measured
+        fflush(stdout);
+#ifndef _WIN32
+        int saved_stdout = dup(STDOUT_FILENO);
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (saved_stdout >= 0 && null_fd >= 0) dup2(null_fd, STDOUT_FILENO);
+#endif
+        start = monotonic_seconds();
+        display_trends(&store);
+        fflush(stdout);
+        elapsed = monotonic_seconds() - start;
+#ifndef _WIN32
+        if (saved_stdout >= 0 && null_fd >= 0) dup2(saved_stdout, STDOUT_FILENO);
+        if (null_fd >= 0) close(null_fd);
+        if (saved_stdout >= 0) close(saved_stdout);
+#endif
+        if (elapsed < best[BENCH_TRENDS]) best[BENCH_TRENDS] = elapsed;
+
+        start = monotonic_seconds();
+        if (!write_report_file(stats, &alerts, &store, REPORT_TEXT, report_file)) {
+            fprintf(stderr, "[ERROR] Failed to write benchmark report.\n");
+            status = EXIT_EXPORT_FAILED;
+            goto cleanup;
+        }
+        elapsed = monotonic_seconds() - start;
+        if (elapsed < best[BENCH_EXPORT]) best[BENCH_EXPORT] = elapsed;
+
+        // Every record through the manual record log, group committed
+        remove(wal_file);
+        start = monotonic_seconds();
+        ok = wal_open(&wal, wal_file);
+        for (int i = 0; ok && i < store.count; i++) {
+            HealthRecord record;
+            store_get(&store, i, &record);
+            ok = wal_append(&wal, &record);
+        }
+        ok = wal_close(&wal) && ok;
+        elapsed = monotonic_seconds() - start;
+        if (elapsed < best[BENCH_WAL_APPEND]) best[BENCH_WAL_APPEND] = elapsed;
+
+        start = monotonic_seconds();
+        ok = ok && wal_open(&wal, wal_file) && wal.count == count;
+        elapsed = monotonic_seconds() - start;
+        wal_close(&wal);
+        if (elapsed < best[BENCH_WAL_REPLAY]) best[BENCH_WAL_REPLAY] = elapsed;
+        if (!ok) {
+            fprintf(stderr, "[ERROR] Benchmark records did not go through the record log.\n");
+            status = EXIT_EXPORT_FAILED;
+            goto cleanup;
+        }
+    }
+    bytes[BENCH_EXPORT] = file_size(report_file);
+    bytes[BENCH_WAL_APPEND] = bytes[BENCH_WAL_REPLAY] = file_size(wal_file);
+
+    printf("\n");
+    print_line('=', 64);
+    printf("              SMART HEALTH MONITOR - BENCHMARK\n");
+    print_line('=', 64);
+    printf("Records: %lld   Seed: %llu   Threads: %d   Best of %d run(s)\n", count,
+           (unsigned long long)options->seed,
+           options->threads > 0 ? options->threads : default_thread_count(), options->repeat);
+    print_line('-', 64);
+    printf("%-16s %12s %16s %12s\n", "Stage", "Time (ms)", "Records/s", "MB/s");
+    print_line('-', 64);
+    for (int i = 0; i < BENCH_STAGE_COUNT; i++) {
+        double seconds = best[i] > 0 ? best[i] : 1e-9;
+        printf("%-16s %12.3f %16.0f ", stage_names[i], best[i] * 1000.0, records[i] / seconds);
+        if (bytes[i] > 0) printf("%12.1f\n", bytes[i] / seconds / 1e6);
+        else printf("%12s\n", "-");
+    }
+    print_line('-', 64);
+    printf("Binary sizes: .shm %.1f MB, .shz %.1f MB (%.1f bytes per record)\n",
+           bytes[BENCH_SHM_LOAD] / 1e6, bytes[BENCH_SHZ_LOAD] / 1e6,
+           count > 0 ? (double)bytes[BENCH_SHZ_LOAD] / count : 0.0);
+
+cleanup:
+    store_free(&store);
+    remove(csv_file);
+    remove(txt_file);
+    remove(shm_file);
+    remove(shz_file);
+    remove(report_file);
+    remove(wal_file);
+    return status;
+}
+
+const char *stage_name(Stage stage) {
+    static const char *names[STAGE_COUNT] = {
+        "CSV load", "TXT load", "SHM load", "SHM export", "SHZ load", "SHZ export",
+        "Statistics", "Analysis", "Trend display", "Report export"
+    };
+    return names[stage];
+}
+
+// Start a stage timer; returns 0 without reading the clock when profiling is off
+double profile_start() {
+    return profile_mode ? monotonic_seconds() : 0.0;
+}
+
+void profile_stop(Stage stage, double started) {
+    if (!profile_mode) {
+        return;
+    }
+    thread_profile.seconds[stage] += monotonic_seconds() - started;
+    thread_profile.calls[stage]++;
+}
+
+void profile_rows(long long read, long long rejected, long long bytes) {
+    if (!profile_mode) {
+        return;
+    }
+    thread_profile.rows_read += read;
+    thread_profile.rows_rejected += rejected;
+    thread_profile.bytes_parsed += bytes;
+}
+
+// Add a finished worker's counters to the calling thread's
+void profile_merge(const Profile *other) {
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        thread_profile.seconds[i] += other->seconds[i];
+        thread_profile.calls[i] += other->calls[i];
+    }
+    thread_profile.rows_read += other->rows_read;
+    thread_profile.rows_rejected += other->rows_rejected;
+    thread_profile.bytes_parsed += other->bytes_parsed;
+    thread_profile.alerts_emitted += other->alerts_emitted;
+}
+
+// Print the collected profile as a table or a JSON object. Stage times are
+// summed over all threads, so they can exceed wall-clock time.
+void profile_report(FILE *out) {
+    const Profile *p = &thread_profile;
+    long peak_kb = -1;
+
+    if (!profile_mode) {
+        return;
+    }
+    fflush(stdout); // keep the profile after the run's own output
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peak_kb = usage.ru_maxrss; // kilobytes on Linux
+    }
+#endif
+
+    if (profile_mode == PROFILE_JSON) {
+        fprintf(out, "{\"stages\":[");
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            fprintf(out, "%s{\"name\":\"%s\",\"calls\":%lld,\"seconds\":%.6f}", i ? "," : "",
+                    stage_name((Stage)i), p->calls[i], p->seconds[i]);
+        }
+        fprintf(out, "],\"rows_read\":%lld,\"rows_rejected\":%lld,\"bytes_parsed\":%lld,"
+                "\"alerts_emitted\":%lld,\"peak_rss_kb\":%ld}\n",
+                p->rows_read, p->rows_rejected, p->bytes_parsed, p->alerts_emitted, peak_kb);
+    } else {
+        fprintf(out, "\nPROFILE\n");
+        fprintf(out, "------------------------------------------------------------\n");
+        fprintf(out, "%-16s %8s %14s %14s\n", "Stage", "Calls", "Total (ms)", "Avg (ms)");
+        fprintf(out, "------------------------------------------------------------\n");
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            if (p->calls[i] == 0) continue;
+            fprintf(out, "%-16s %8lld %14.3f %14.3f\n", stage_name((Stage)i), p->calls[i],
+                    p->seconds[i] * 1000.0, p->seconds[i] * 1000.0 / p->calls[i]);
+        }
+        fprintf(out, "------------------------------------------------------------\n");
+        fprintf(out, "%-25s%lld\n", "Rows read:", p->rows_read);
+        fprintf(out, "%-25s%lld\n", "Rows rejected:", p->rows_rejected);
+        fprintf(out, "%-25s%lld\n", "Bytes parsed:", p->bytes_parsed);
+        fprintf(out, "%-25s%lld\n", "Alerts emitted:", p->alerts_emitted);
+        if (peak_kb >= 0) fprintf(out, "%-25s%ld KB\n", "Peak memory (RSS):", peak_kb);
+        else fprintf(out, "%-25sn/a\n", "Peak memory (RSS):");
+    }
+}